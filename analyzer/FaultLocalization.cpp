@@ -0,0 +1,122 @@
+#include "FaultLocalization.h"
+#include <atomic>
+#include <thread>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+	/** 每个线程一次领取的输出tuple数 */
+	constexpr size_t BATCH_SIZE = 1024;
+
+	unsigned lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return static_cast<unsigned>(index);
+#else
+		return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+	}
+}  // namespace
+
+double modified_souffle::suspiciousness(Formula formula, const RelationCount &relation, size_t p, size_t f) {
+	return suspiciousness(formula, relation.pr, relation.fr, p, f);
+}
+
+void modified_souffle::collectSpectrum(proofTreeBuilder &builder, const std::unordered_set<std::string> &correct,
+									   size_t &p, size_t &f, unsigned threads) {
+	const proof_graph::ProofGraph &graph = builder.graph;
+	const size_t tuple_count = graph.tuple_count();
+	const size_t words = (builder.relation_list.size() + 63) / 64;
+	// 每个tuple的证明中用到的规则，按位存放
+	std::vector<uint64_t> rules(tuple_count * words, 0);
+
+	// 迭代的深度优先遍历，来源先于结论完成，保证合并时来源的规则集合已经算好
+	enum : uint8_t { UNVISITED, VISITING, DONE };
+	std::vector<uint8_t> state(tuple_count, UNVISITED);
+	std::vector<uint32_t> stack;
+	for (uint32_t root = 0; root < tuple_count; ++root) {
+		if (state[root] != UNVISITED) continue;
+		stack.push_back(root);
+		while (!stack.empty()) {
+			const uint32_t tuple = stack.back();
+			const proof_graph::TupleEntry &entry = graph.tuple(tuple);
+			// 沿最先推出该tuple的推导回溯，之后的推导只是重复得到了已有的tuple
+			const uint32_t derivation = entry.firstDerivation;
+			const bool derived = entry.derivationCount != 0;
+			const uint32_t *premises = derived ? graph.premises(derivation) : nullptr;
+			const uint32_t premise_count = derived ? graph.derivation(derivation).edgeCount : 0;
+			if (state[tuple] == UNVISITED) {
+				state[tuple] = VISITING;
+				for (uint32_t i = 0; i < premise_count; ++i) {
+					if (state[premises[i]] == UNVISITED) stack.push_back(premises[i]);
+				}
+				continue;
+			}
+			stack.pop_back();
+			if (state[tuple] == DONE) continue;
+			state[tuple] = DONE;
+			// 通过input创造的tuple没有来源
+			if (!derived) continue;
+			uint64_t *used = &rules[tuple * words];
+			const uint32_t rule = graph.derivation(derivation).rule;
+			used[rule / 64] |= uint64_t(1) << (rule % 64);
+			for (uint32_t i = 0; i < premise_count; ++i) {
+				// 仍在遍历中的来源构成了环，忽略
+				if (state[premises[i]] != DONE) continue;
+				const uint64_t *inherited = &rules[premises[i] * words];
+				for (size_t w = 0; w < words; ++w) used[w] |= inherited[w];
+			}
+		}
+	}
+
+	std::vector<uint32_t> outputs;
+	for (uint32_t tuple = 0; tuple < tuple_count; ++tuple) {
+		// tuple是根节点，无需进行统计
+		if (graph.tuple(tuple).derivationCount != 0 && builder.is_output(tuple)) outputs.push_back(tuple);
+	}
+
+	struct Counter {
+		std::vector<size_t> pr;
+		std::vector<size_t> fr;
+		size_t p = 0;
+		size_t f = 0;
+	};
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<Counter> counters(threads);
+	std::atomic<size_t> next{0};
+	auto work = [&](Counter &counter) {
+		counter.pr.assign(builder.relation_list.size(), 0);
+		counter.fr.assign(builder.relation_list.size(), 0);
+		size_t begin;
+		while ((begin = next.fetch_add(BATCH_SIZE)) < outputs.size()) {
+			const size_t end = std::min(begin + BATCH_SIZE, outputs.size());
+			for (size_t i = begin; i < end; ++i) {
+				// 存在于正确的tuple列表中的是正确的元组，否则是错误的元组
+				const bool is_correct = correct.count(builder.tuple_name(outputs[i])) != 0;
+				std::vector<size_t> &count = is_correct ? counter.pr : counter.fr;
+				(is_correct ? counter.p : counter.f)++;
+				const uint64_t *used = &rules[outputs[i] * words];
+				for (size_t w = 0; w < words; ++w) {
+					for (uint64_t bits = used[w]; bits != 0; bits &= bits - 1) {
+						count[w * 64 + lowestBit(bits)]++;
+					}
+				}
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < threads; ++i) workers.emplace_back(work, std::ref(counters[i]));
+	work(counters[0]);
+	for (auto &worker : workers) worker.join();
+
+	for (const Counter &counter : counters) {
+		p += counter.p;
+		f += counter.f;
+		for (size_t rule = 0; rule < builder.relation_list.size(); ++rule) {
+			builder.relation_list[rule].pr += counter.pr[rule];
+			builder.relation_list[rule].fr += counter.fr[rule];
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ProofTreeBuilder.h"
+#include "souffle/Suspiciousness.h"
+#include <unordered_set>
+
+namespace modified_souffle {
+	/**
+	 * 根据规则的pr/fr以及正确、错误输出tuple的总数计算可疑度
+	 * @param p 正确的输出tuple数
+	 * @param f 错误的输出tuple数
+	 */
+	double suspiciousness(Formula formula, const RelationCount &relation, size_t p, size_t f);
+
+	/**
+	 * 统计每条规则出现在多少个正确/错误输出tuple的证明中，结果累加到builder.relation_list。
+	 * 每个tuple用到的规则集合按拓扑序只计算一次，共享的子证明不会被重复遍历；
+	 * 各输出tuple的判定与计数在多个线程中进行
+	 * @param correct 正确的输出tuple，形如"(a,b)@path"
+	 * @param threads 线程数，为0时使用硬件线程数
+	 */
+	void collectSpectrum(proofTreeBuilder &builder, const std::unordered_set<std::string> &correct, size_t &p,
+						 size_t &f, unsigned threads = 0);
+}  // namespace modified_souffle
@@ -0,0 +1,389 @@
+#include "ProofQuery.h"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_set>
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+using modified_souffle::proof_graph::NONE;
+using modified_souffle::proof_graph::Section;
+
+namespace {
+	constexpr char INDEX_MAGIC[8] = {'S', 'O', 'U', 'F', 'F', 'L', 'P', 'I'};
+	/** 格式发生不兼容的变化时递增 */
+	constexpr uint32_t INDEX_VERSION = 1;
+
+	struct IndexHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t headerSize;
+		/** 建立索引时trace文件的大小与修改时间 */
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t tupleCount;
+		uint64_t derivationCount;
+		/** 第i个集合的tuple位于relationTuples的[relationOffsets[i], relationOffsets[i + 1]) */
+		Section relationOffsets;
+		Section relationTuples;
+		/** 以第i个tuple为来源的推导位于uses的[useOffsets[i], useOffsets[i + 1]) */
+		Section useOffsets;
+		Section uses;
+		/** 第i条规则的推导位于ruleDerivations的[ruleOffsets[i], ruleOffsets[i + 1]) */
+		Section ruleOffsets;
+		Section ruleDerivations;
+		Section lookup;
+	};
+
+	struct LookupEntry {
+		uint64_t hash;
+		uint32_t tuple;
+		uint32_t reserved;
+	};
+
+	/** FNV-1a，结果写入文件，不能使用随实现变化的std::hash */
+	uint64_t hashName(const std::string &name) {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (char c: name) {
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	/**
+	 * 计数排序：得到按key分组的元素以及每个key的范围
+	 * @param each 以回调add(key, item)为参数，依次给出所有元素，会被调用两次
+	 */
+	template<typename Each>
+	void groupBy(size_t keys, std::vector<uint64_t> &offsets, std::vector<uint32_t> &items, Each &&each) {
+		offsets.assign(keys + 1, 0);
+		each([&](uint32_t key, uint32_t) { offsets[key + 1]++; });
+		for (size_t i = 0; i < keys; ++i) offsets[i + 1] += offsets[i];
+		items.resize(offsets[keys]);
+		std::vector<uint64_t> next(offsets.begin(), offsets.end() - 1);
+		each([&](uint32_t key, uint32_t item) { items[next[key]++] = item; });
+	}
+
+	void printTuple(std::ostream &os, const modified_souffle::proofTreeBuilder &builder, uint32_t tuple) {
+		os << builder.tuple_name(tuple) << "\n";
+	}
+
+	/** 沿每个tuple最早的推导展开的证明中的tuple，来源在前 */
+	std::vector<uint32_t> shortestProof(const modified_souffle::proof_graph::ProofGraph &graph, uint32_t root) {
+		std::vector<uint32_t> order;
+		std::unordered_set<uint32_t> visited{root};
+		std::vector<std::pair<uint32_t, uint32_t>> stack{{root, 0}};
+		while (!stack.empty()) {
+			auto &[tuple, next] = stack.back();
+			const auto &entry = graph.tuple(tuple);
+			const uint32_t count =
+					entry.derivationCount == 0 ? 0 : graph.derivation(entry.firstDerivation).edgeCount;
+			if (next == count) {
+				order.push_back(tuple);
+				stack.pop_back();
+				continue;
+			}
+			const uint32_t premise = graph.premises(entry.firstDerivation)[next++];
+			if (visited.insert(premise).second) stack.push_back({premise, 0});
+		}
+		return order;
+	}
+}  // namespace
+
+modified_souffle::ProofGraphIndex::~ProofGraphIndex() {
+	release();
+}
+
+bool modified_souffle::ProofGraphIndex::open(const proofTreeBuilder &source_builder, const std::string &source) {
+	release();
+	builder = &source_builder;
+	std::error_code error;
+	const uint64_t size = fs::file_size(source, error);
+	if (error) return false;
+	const int64_t time = fs::last_write_time(source, error).time_since_epoch().count();
+	if (error) return false;
+	const std::string path = source + ".idx";
+	if (map(path, size, time)) return true;
+	return build(path, size, time) && map(path, size, time);
+}
+
+bool modified_souffle::ProofGraphIndex::build(const std::string &path, uint64_t size, int64_t time) const {
+	const proof_graph::ProofGraph &graph = builder->graph;
+	const size_t tuple_count = graph.tuple_count();
+	const size_t derivation_count = graph.derivation_count();
+	std::vector<uint64_t> relationOffsets, useOffsets, ruleOffsets;
+	std::vector<uint32_t> relationTuples, uses, ruleDerivations;
+	groupBy(graph.relation_count(), relationOffsets, relationTuples, [&](auto &&add) {
+		for (uint32_t tuple = 0; tuple < tuple_count; ++tuple) add(graph.tuple(tuple).relation, tuple);
+	});
+	groupBy(tuple_count, useOffsets, uses, [&](auto &&add) {
+		for (uint32_t derivation = 0; derivation < derivation_count; ++derivation) {
+			const uint32_t *premises = graph.premises(derivation);
+			for (uint32_t i = 0; i < graph.derivation(derivation).edgeCount; ++i) add(premises[i], derivation);
+		}
+	});
+	groupBy(graph.rule_count(), ruleOffsets, ruleDerivations, [&](auto &&add) {
+		for (uint32_t derivation = 0; derivation < derivation_count; ++derivation) {
+			add(graph.derivation(derivation).rule, derivation);
+		}
+	});
+	std::vector<LookupEntry> lookup(tuple_count);
+	for (uint32_t tuple = 0; tuple < tuple_count; ++tuple) {
+		lookup[tuple] = {hashName(builder->tuple_name(tuple)), tuple, 0};
+	}
+	std::sort(lookup.begin(), lookup.end(), [](const LookupEntry &a, const LookupEntry &b) {
+		return a.hash < b.hash || (a.hash == b.hash && a.tuple < b.tuple);
+	});
+
+	IndexHeader header{};
+	std::copy(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC), header.magic);
+	header.version = INDEX_VERSION;
+	header.headerSize = sizeof(IndexHeader);
+	header.sourceSize = size;
+	header.sourceTime = time;
+	header.tupleCount = tuple_count;
+	header.derivationCount = derivation_count;
+	uint64_t end = sizeof(IndexHeader);
+	auto layout = [&](Section &section, uint64_t count, size_t width) {
+		section = {end, count};
+		end += (count * width + 7) / 8 * 8;
+	};
+	layout(header.relationOffsets, relationOffsets.size(), sizeof(uint64_t));
+	layout(header.relationTuples, relationTuples.size(), sizeof(uint32_t));
+	layout(header.useOffsets, useOffsets.size(), sizeof(uint64_t));
+	layout(header.uses, uses.size(), sizeof(uint32_t));
+	layout(header.ruleOffsets, ruleOffsets.size(), sizeof(uint64_t));
+	layout(header.ruleDerivations, ruleDerivations.size(), sizeof(uint32_t));
+	layout(header.lookup, lookup.size(), sizeof(LookupEntry));
+
+	// 先写入临时文件，中断时不会留下不完整的索引
+	const std::string temporary = path + ".tmp";
+	{
+		std::ofstream os(temporary, std::ios::binary | std::ios::trunc);
+		if (!os) return false;
+		auto put = [&](const void *data, size_t bytes) {
+			static const char zeros[8] = {};
+			os.write(static_cast<const char *>(data), static_cast<std::streamsize>(bytes));
+			os.write(zeros, static_cast<std::streamsize>((8 - bytes % 8) % 8));
+		};
+		put(&header, sizeof(header));
+		put(relationOffsets.data(), relationOffsets.size() * sizeof(uint64_t));
+		put(relationTuples.data(), relationTuples.size() * sizeof(uint32_t));
+		put(useOffsets.data(), useOffsets.size() * sizeof(uint64_t));
+		put(uses.data(), uses.size() * sizeof(uint32_t));
+		put(ruleOffsets.data(), ruleOffsets.size() * sizeof(uint64_t));
+		put(ruleDerivations.data(), ruleDerivations.size() * sizeof(uint32_t));
+		put(lookup.data(), lookup.size() * sizeof(LookupEntry));
+		if (!os.flush()) return false;
+	}
+	std::error_code error;
+	fs::rename(temporary, path, error);
+	return !error;
+}
+
+bool modified_souffle::ProofGraphIndex::map(const std::string &path, uint64_t size, int64_t time) {
+	release();
+#ifdef _WIN32
+	std::ifstream is(path, std::ios::binary);
+	if (!is) return false;
+	std::vector<char> content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+	buffer.resize((content.size() + 7) / 8);
+	std::memcpy(buffer.data(), content.data(), content.size());
+	base = reinterpret_cast<const char *>(buffer.data());
+	mappingSize = content.size();
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IndexHeader)) {
+		::close(fd);
+		return false;
+	}
+	void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) return false;
+	base = static_cast<const char *>(mapped);
+	mappingSize = st.st_size;
+#endif
+	if (mappingSize < sizeof(IndexHeader)) {
+		release();
+		return false;
+	}
+	const auto *header = reinterpret_cast<const IndexHeader *>(base);
+	const proof_graph::ProofGraph &graph = builder->graph;
+	auto fits = [&](const Section &s, uint64_t count, size_t width) {
+		return s.count == count && s.offset % 8 == 0 && s.offset <= mappingSize &&
+			   s.count <= (mappingSize - s.offset) / width;
+	};
+	const bool valid = std::equal(header->magic, header->magic + sizeof(INDEX_MAGIC), INDEX_MAGIC) &&
+					   header->version == INDEX_VERSION && header->sourceSize == size &&
+					   header->sourceTime == time && header->tupleCount == graph.tuple_count() &&
+					   header->derivationCount == graph.derivation_count() &&
+					   fits(header->relationOffsets, graph.relation_count() + 1, sizeof(uint64_t)) &&
+					   fits(header->relationTuples, graph.tuple_count(), sizeof(uint32_t)) &&
+					   fits(header->useOffsets, graph.tuple_count() + 1, sizeof(uint64_t)) &&
+					   fits(header->uses, header->uses.count, sizeof(uint32_t)) &&
+					   fits(header->ruleOffsets, graph.rule_count() + 1, sizeof(uint64_t)) &&
+					   fits(header->ruleDerivations, graph.derivation_count(), sizeof(uint32_t)) &&
+					   fits(header->lookup, graph.tuple_count(), sizeof(LookupEntry));
+	if (!valid) release();
+	return valid;
+}
+
+void modified_souffle::ProofGraphIndex::release() {
+#ifndef _WIN32
+	if (base != nullptr) munmap(const_cast<char *>(base), mappingSize);
+#endif
+	buffer.clear();
+	base = nullptr;
+	mappingSize = 0;
+}
+
+modified_souffle::ProofGraphIndex::Range
+modified_souffle::ProofGraphIndex::group(const Section &offsets, const Section &items, uint32_t key) const {
+	const auto *first = reinterpret_cast<const uint64_t *>(base + offsets.offset);
+	const auto *values = reinterpret_cast<const uint32_t *>(base + items.offset);
+	return {values + first[key], values + first[key + 1]};
+}
+
+modified_souffle::ProofGraphIndex::Range modified_souffle::ProofGraphIndex::relation_tuples(uint32_t relation) const {
+	const auto *header = reinterpret_cast<const IndexHeader *>(base);
+	return group(header->relationOffsets, header->relationTuples, relation);
+}
+
+modified_souffle::ProofGraphIndex::Range modified_souffle::ProofGraphIndex::consumers(uint32_t tuple) const {
+	const auto *header = reinterpret_cast<const IndexHeader *>(base);
+	return group(header->useOffsets, header->uses, tuple);
+}
+
+modified_souffle::ProofGraphIndex::Range modified_souffle::ProofGraphIndex::rule_derivations(uint32_t rule) const {
+	const auto *header = reinterpret_cast<const IndexHeader *>(base);
+	return group(header->ruleOffsets, header->ruleDerivations, rule);
+}
+
+uint32_t modified_souffle::ProofGraphIndex::find(const std::string &name) const {
+	const auto *header = reinterpret_cast<const IndexHeader *>(base);
+	const auto *first = reinterpret_cast<const LookupEntry *>(base + header->lookup.offset);
+	const auto *last = first + header->lookup.count;
+	const uint64_t hash = hashName(name);
+	auto it = std::lower_bound(first, last, hash, [](const LookupEntry &entry, uint64_t value) {
+		return entry.hash < value;
+	});
+	// 哈希相同的tuple再比较名字
+	for (; it != last && it->hash == hash; ++it) {
+		if (builder->tuple_name(it->tuple) == name) return it->tuple;
+	}
+	return NONE;
+}
+
+bool modified_souffle::runQuery(std::ostream &os, const proofTreeBuilder &builder, const ProofGraphIndex &index,
+								const std::string &query) {
+	const proof_graph::ProofGraph &graph = builder.graph;
+	std::istringstream is(query);
+	std::string command;
+	is >> command;
+	std::string argument;
+	std::getline(is >> std::ws, argument);
+	if (command.empty() || argument.empty()) return false;
+
+	if (command == "relation") {
+		for (uint32_t relation = 0; relation < graph.relation_count(); ++relation) {
+			if (graph.relation_name(relation) != argument) continue;
+			for (uint32_t tuple: index.relation_tuples(relation)) printTuple(os, builder, tuple);
+			return true;
+		}
+		return false;
+	}
+	if (command == "rule") {
+		std::vector<uint32_t> rules;
+		const bool numeric = argument.find_first_not_of("0123456789") == std::string::npos;
+		for (uint32_t rule = 0; rule < graph.rule_count(); ++rule) {
+			if (numeric ? std::to_string(rule) == argument : graph.rule_text(rule).find(argument) != std::string::npos) {
+				rules.push_back(rule);
+			}
+		}
+		for (uint32_t rule: rules) {
+			os << rule << "\t" << graph.rule_text(rule) << "\n";
+			// 推导按tuple排列，同一tuple的推导相邻
+			uint32_t last = NONE;
+			for (uint32_t derivation: index.rule_derivations(rule)) {
+				const uint32_t tuple = graph.derivation(derivation).tuple;
+				if (tuple != last) printTuple(os, builder, tuple);
+				last = tuple;
+			}
+		}
+		return !rules.empty();
+	}
+
+	const uint32_t root = index.find(argument);
+	if (root == NONE) return false;
+	if (command == "ancestors" || command == "descendants") {
+		const bool up = command == "ancestors";
+		std::unordered_set<uint32_t> visited{root};
+		std::vector<uint32_t> queue{root};
+		auto visit = [&](uint32_t tuple) {
+			if (visited.insert(tuple).second) {
+				queue.push_back(tuple);
+				printTuple(os, builder, tuple);
+			}
+		};
+		for (size_t i = 0; i < queue.size(); ++i) {
+			const uint32_t tuple = queue[i];
+			if (up) {
+				const auto &entry = graph.tuple(tuple);
+				for (uint32_t d = entry.firstDerivation; d < entry.firstDerivation + entry.derivationCount; ++d) {
+					for (uint32_t e = 0; e < graph.derivation(d).edgeCount; ++e) visit(graph.premises(d)[e]);
+				}
+			} else {
+				for (uint32_t derivation: index.consumers(tuple)) visit(graph.derivation(derivation).tuple);
+			}
+		}
+		return true;
+	}
+	if (command == "proof") {
+		// 共享的子证明只展开一次
+		std::unordered_set<uint32_t> shown;
+		std::vector<std::pair<uint32_t, size_t>> stack{{root, 0}};
+		while (!stack.empty()) {
+			const auto [tuple, depth] = stack.back();
+			stack.pop_back();
+			const auto &entry = graph.tuple(tuple);
+			os << std::string(depth * 2, ' ') << builder.tuple_name(tuple);
+			if (entry.derivationCount == 0) {
+				os << "\n";
+				continue;
+			}
+			if (!shown.insert(tuple).second) {
+				os << " ...\n";
+				continue;
+			}
+			const auto &derivation = graph.derivation(entry.firstDerivation);
+			os << " <- " << graph.rule_text(derivation.rule) << "\n";
+			for (uint32_t e = derivation.edgeCount; e-- > 0;) {
+				stack.push_back({graph.premises(entry.firstDerivation)[e], depth + 1});
+			}
+		}
+		return true;
+	}
+	if (command == "blame") {
+		std::map<uint32_t, size_t> counts;
+		for (uint32_t tuple: shortestProof(graph, root)) {
+			const auto &entry = graph.tuple(tuple);
+			if (entry.derivationCount != 0) counts[graph.derivation(entry.firstDerivation).rule]++;
+		}
+		std::vector<std::pair<uint32_t, size_t>> rules(counts.begin(), counts.end());
+		std::stable_sort(rules.begin(), rules.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+		for (const auto &[rule, count]: rules) os << count << "\t" << graph.rule_text(rule) << "\n";
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "ProofTreeBuilder.h"
+#include <ostream>
+#include <string>
+
+namespace modified_souffle {
+	/**
+	 * proof graph的索引，保存在trace文件旁的<trace>.idx中并被直接映射，之后的查询不再扫描整个图：
+	 *   集合 -> 其中的tuple，按tuple id排列
+	 *   tuple -> 以它为来源的推导(反向边)
+	 *   规则 -> 由它得到的推导
+	 *   tuple名的哈希 -> tuple，按哈希排序，用于由"(a,b)@path"找到tuple
+	 * 索引记录了trace文件的大小与修改时间，两者不符时重新建立
+	 */
+	class ProofGraphIndex {
+	public:
+		ProofGraphIndex() = default;
+		ProofGraphIndex(const ProofGraphIndex &) = delete;
+		ProofGraphIndex &operator=(const ProofGraphIndex &) = delete;
+		~ProofGraphIndex();
+
+		/** 连续存放的一组id */
+		struct Range {
+			const uint32_t *first;
+			const uint32_t *last;
+
+			const uint32_t *begin() const { return first; }
+
+			const uint32_t *end() const { return last; }
+
+			size_t size() const { return last - first; }
+		};
+
+		/**
+		 * 映射已有的索引，不存在或已过期时先建立
+		 * @param source 生成graph的trace文件
+		 * @return 索引无法写出或映射时返回false
+		 */
+		bool open(const proofTreeBuilder &builder, const std::string &source);
+
+		/** 集合中的tuple */
+		Range relation_tuples(uint32_t relation) const;
+
+		/** 以tuple为来源的推导 */
+		Range consumers(uint32_t tuple) const;
+
+		/** 由规则得到的推导 */
+		Range rule_derivations(uint32_t rule) const;
+
+		/**
+		 * @param name 形如"(a,b)@path"的tuple名
+		 * @return tuple id，不存在时返回proof_graph::NONE
+		 */
+		uint32_t find(const std::string &name) const;
+
+	private:
+		bool build(const std::string &path, uint64_t size, int64_t time) const;
+
+		bool map(const std::string &path, uint64_t size, int64_t time);
+
+		void release();
+
+		/** 按offsets分组的items中第key组 */
+		Range group(const proof_graph::Section &offsets, const proof_graph::Section &items, uint32_t key) const;
+
+		const proofTreeBuilder *builder = nullptr;
+		const char *base = nullptr;
+		size_t mappingSize = 0;
+		/** 无法映射文件的平台上索引的副本，按8字节对齐 */
+		std::vector<uint64_t> buffer;
+	};
+
+	/**
+	 * 执行一条查询并输出结果，tuple写作"(a,b)@path"：
+	 *   ancestors <tuple>     证明tuple时可能用到的所有tuple
+	 *   descendants <tuple>   可能由tuple推出的所有tuple
+	 *   proof <tuple>         最短的证明，沿每个tuple最早的推导展开
+	 *   rule <规则id|文本>    由规则推出的tuple
+	 *   blame <tuple>         最短证明中用到的规则及其次数
+	 *   relation <集合名>     集合中的tuple
+	 * @return 查询无法解读或tuple不存在时返回false
+	 */
+	bool runQuery(std::ostream &os, const proofTreeBuilder &builder, const ProofGraphIndex &index,
+				  const std::string &query);
+}  // namespace modified_souffle
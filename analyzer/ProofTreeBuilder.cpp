@@ -1,113 +1,179 @@
 #include "ProofTreeBuilder.h"
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 
+namespace {
+	/** 每次从文件读入的字节数 */
+	constexpr size_t CHUNK_SIZE = 1 << 20;
 
-bool modified_souffle::proofTreeBuilder::readALine() {
-	std::string line;
-	if (!std::getline(is, line)) return false;
+	bool isWord(char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	}
+
+	/**
+	 * 从pos开始查找下一个形如"(a,b)"的tuple，括号内只能出现单词字符、','和'"'
+	 * @return 找到时返回tuple并将pos移到其后，否则返回空串
+	 */
+	std::string_view nextTuple(std::string_view line, size_t &pos) {
+		while ((pos = line.find('(', pos)) != std::string_view::npos) {
+			size_t end = pos + 1;
+			while (end < line.size() && (isWord(line[end]) || line[end] == ',' || line[end] == '"')) end++;
+			if (end < line.size() && line[end] == ')') {
+				std::string_view tuple = line.substr(pos, end + 1 - pos);
+				pos = end + 1;
+				return tuple;
+			}
+			pos++;
+		}
+		pos = line.size();
+		return {};
+	}
+}  // namespace
+
+std::string_view modified_souffle::StringArena::store(std::string_view text) {
+	if (blocks.empty() || text.size() > capacity - used) {
+		// 过长的字符串单独占用一块
+		capacity = std::max(text.size(), BLOCK_SIZE);
+		blocks.emplace_back(new char[capacity]);
+		used = 0;
+	}
+	char *target = blocks.back().get() + used;
+	std::memcpy(target, text.data(), text.size());
+	used += text.size();
+	return {target, text.size()};
+}
+
+bool modified_souffle::proofTreeBuilder::openStream(const char *path) {
+	const std::string graph_path = std::string(path) + ".pg";
+	std::error_code error;
+	const auto stream_time = std::filesystem::last_write_time(path, error);
+	if (error) return false;
+	const auto graph_time = std::filesystem::last_write_time(graph_path, error);
+	if (!error && graph_time >= stream_time && graph.open(graph_path)) return true;
+	return replay_trace_stream(path, graph_path, TraceFormat::Graph) && graph.open(graph_path);
+}
+
+void modified_souffle::proofTreeBuilder::build(const char *path) {
+	std::ifstream is(path, std::ios::binary);
+	std::vector<char> buffer(CHUNK_SIZE);
+	size_t kept = 0;
+	while (true) {
+		is.read(buffer.data() + kept, static_cast<std::streamsize>(buffer.size() - kept));
+		size_t size = kept + static_cast<size_t>(is.gcount());
+		if (size == kept) break;
+		size_t begin = 0;
+		while (true) {
+			const void *newline = std::memchr(buffer.data() + begin, '\n', size - begin);
+			if (newline == nullptr) break;
+			size_t end = static_cast<const char *>(newline) - buffer.data();
+			parseLine(std::string_view(buffer.data() + begin, end - begin));
+			begin = end + 1;
+		}
+		// 不完整的行留到下一块，一行比整块还长时扩大缓冲区
+		kept = size - begin;
+		std::memmove(buffer.data(), buffer.data() + begin, kept);
+		if (kept == buffer.size()) buffer.resize(buffer.size() * 2);
+	}
+	if (kept != 0) parseLine(std::string_view(buffer.data(), kept));
+
+	std::ostringstream os;
+	writer.write(os, values.data(), values.size());
+	const std::string data = os.str();
+	bool ok = graph.assign(data.data(), data.size());
+	assert(ok && "转换得到的proof graph无效");
+	(void) ok;
+}
+
+uint32_t modified_souffle::proofTreeBuilder::getRelation(std::string_view name) {
+	auto it = set_map.find(name);
+	if (it != set_map.end()) return it->second;
+	uint32_t id = writer.add_relation(std::string(name));
+	set_map.emplace(arena.store(name), id);
+	tuple_map.resize(id + 1);
+	return id;
+}
+
+uint32_t modified_souffle::proofTreeBuilder::getTuple(uint32_t relation, std::string_view tuple) {
+	auto &tuples = tuple_map[relation];
+	auto it = tuples.find(tuple);
+	if (it != tuples.end()) return it->second;
+	uint64_t offset = values.size();
+	// 去掉两侧的括号后按','拆分出各个属性，每个属性作为一个符号
+	std::string_view attributes = tuple.substr(1, tuple.size() - 2);
+	while (!attributes.empty()) {
+		size_t comma = std::min(attributes.find(','), attributes.size());
+		std::string_view symbol = attributes.substr(0, comma);
+		auto symbol_it = symbol_map.find(symbol);
+		if (symbol_it == symbol_map.end()) {
+			symbol_it = symbol_map.emplace(arena.store(symbol), static_cast<int64_t>(symbol_map.size())).first;
+			writer.add_symbol(symbol.data(), symbol.size());
+		}
+		values.push_back(symbol_it->second);
+		attributes.remove_prefix(std::min(comma + 1, attributes.size()));
+	}
+	uint32_t id = writer.add_tuple(relation, offset, static_cast<uint32_t>(values.size() - offset));
+	tuples.emplace(arena.store(tuple), id);
+	return id;
+}
+
+void modified_souffle::proofTreeBuilder::parseRuleBody(std::string_view rule) {
+	// 规则体中的atom形如" edge("，即空白之后紧跟'('的单词，规则头与否定的atom不在其中
+	std::vector<uint32_t> body;
+	for (size_t pos = rule.find('('); pos != std::string_view::npos; pos = rule.find('(', pos + 1)) {
+		size_t begin = pos;
+		while (begin > 0 && isWord(rule[begin - 1])) begin--;
+		if (begin == pos || begin == 0 || !std::isspace(static_cast<unsigned char>(rule[begin - 1]))) continue;
+		body.push_back(getRelation(rule.substr(begin, pos - begin)));
+	}
+	rule_body.push_back(std::move(body));
+}
+
+void modified_souffle::proofTreeBuilder::parseLine(std::string_view line) {
+	if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+	if (line.empty()) return;
 	if (line[0] == '+')  // 向集合中添加tuple
 	{
-		std::sregex_iterator end;
-		std::smatch matches;
-		std::string tuple;
-		if (!is_relation)  // 是叶子节点
-		{
-			std::sregex_iterator iterator(line.begin(), line.end(), tuple_pattern);
-			assert(iterator != end);
-			matches = *iterator;
-			tuple = matches.str() + "@" + curr_setName;
-			tuple_list.push_back(new Tuple(true, tuple));
-			tuple_map[tuple] = curr_tupleId;
-			curr_tupleId++;
-		} else {  // 非叶子节点，要加载父节点数据
-			std::sregex_iterator iterator(line.begin(), line.end(), tuple_pattern);
-			assert(iterator != end && "tuple正则表达式没有匹配到数据");
-			matches = *iterator++;
-			tuple = matches.str() + "@" + curr_setName;
-			// 解析规则中的set
-			std::smatch set_matches;
-			std::sregex_iterator set_iterator(curr_relation.begin(), curr_relation.end(), set_pattern);
-			assert(set_iterator != end && "set正则表达式没有匹配到数据");
-			std::vector<std::string> set_list;
-			while (set_iterator != end) {
-				set_matches = *set_iterator++;
-				set_list.push_back(set_matches.str());
-			}
-			// 处理添加的tuple
-			auto tuple1 = new Tuple(false, tuple, curr_relationId, set_list.size());
-			int i = 0;
-			while (iterator != end) {
-				matches = *iterator++;
-				tuple = matches.str() + "@" + set_list[i].substr(1);
-				auto it = tuple_map.find(tuple);
-				// 从文件中读取的tuple在output中不方便记录，需要手动添加
-				if (it == tuple_map.end()) {
-					tuple_list.push_back(new Tuple(true, tuple));
-					it = tuple_map.insert({tuple, curr_tupleId++}).first;
-				}
-				tuple1->parent_node[i] = it->second;
-				i++;
-			}
-			tuple_list.push_back(tuple1);
-			tuple_map[tuple1->name] = curr_tupleId++;
+		size_t pos = 0;
+		std::string_view head = nextTuple(line, pos);
+		assert(!head.empty() && "没有找到tuple");
+		uint32_t tuple = getTuple(curr_set, head);
+		// 叶子节点没有来源
+		if (!is_relation) return;
+		// 从文件中读取的tuple在output中不方便记录，getTuple会将其作为叶子节点添加
+		const std::vector<uint32_t> &body = rule_body[curr_relationId];
+		premises.clear();
+		for (std::string_view premise = nextTuple(line, pos); !premise.empty(); premise = nextTuple(line, pos)) {
+			assert(premises.size() < body.size() && "来源的数量多于规则体中的集合");
+			premises.push_back(getTuple(body[premises.size()], premise));
 		}
-		return true;
+		writer.add_derivation(tuple, curr_relationId, premises.data(), static_cast<uint32_t>(premises.size()));
+		return;
 	}
 	auto op_pos = line.find(':');
-	if (op_pos == std::string::npos) return true;
-	std::string operation = line.substr(0, op_pos);
-	std::string data = line.substr(op_pos + 1);
+	if (op_pos == std::string_view::npos) return;
+	std::string_view operation = line.substr(0, op_pos);
+	std::string_view data = line.substr(op_pos + 1);
 	if (operation == "read input")
 		is_relation = false;
 	else if (operation == "apply rules") {
 		is_relation = true;
 		op_pos = data.find('.');
-		assert(op_pos != std::string::npos && "op_pos can't be npos.");
-		curr_relation = data.substr(0, op_pos);
-		auto it = relation_map.find(curr_relation);
+		assert(op_pos != std::string_view::npos && "op_pos can't be npos.");
+		std::string_view rule = data.substr(0, op_pos);
+		auto it = relation_map.find(rule);
 		if (it == relation_map.end())  // 当前应用的是新的relation
 		{
-			size_t relation_count = relation_list.size();
-			relation_map[curr_relation] = relation_count;
-			curr_relationId = relation_count;
-			relation_list.emplace_back(curr_relation);
+			curr_relationId = writer.add_rule(std::string(rule), getRelation(rule.substr(0, rule.find('('))));
+			relation_map.emplace(arena.store(rule), curr_relationId);
+			parseRuleBody(rule);
 		} else {
 			curr_relationId = it->second;
 		}
 	} else if (operation == "output set") {
-		output_set.push_back(data);
+		writer.set_flags(getRelation(data), proof_graph::OUTPUT);
 	} else {
-		curr_setName = operation;
-	}
-	return true;
-}
-
-void modified_souffle::correctTupleExtractor::extract() {
-	is.open(path);
-	std::string line;
-	while (std::getline(is, line)) {
-		if (line.find("output set") == 0) {
-			size_t op_pos = line.find(':');
-			assert(op_pos != std::string::npos && "op_pos can't be npos");
-			std::string data = line.substr(op_pos + 1);
-			output_set.push_back(data);
-		}
-	}
-	is.close();
-	is.open(path);
-	while (std::getline(is, line)) {
-		if (line[0] == '+' && flag) {
-			size_t op_pos = line.find(' ');
-			tuple_list.insert(line.substr(1, op_pos - 1) + '@' + set_name);
-			continue;
-		}
-		flag = false;
-		auto op_pos = line.find(':');
-		if (op_pos == std::string::npos) continue;
-		std::string operation = line.substr(0, op_pos);
-		if (operation == "read input" || operation == "apply rules" || operation == "output set")continue;
-		else if (std::find(output_set.begin(), output_set.end(), operation) != output_set.end()) {
-			flag = true;
-			set_name = operation;
-		}
+		curr_set = getRelation(operation);
 	}
 }
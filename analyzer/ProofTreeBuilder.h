@@ -1,104 +1,129 @@
 #pragma once
 
 #include "iostream"
-#include "map"
 #include "string"
 #include "unordered_map"
 #include "vector"
-#include <fstream>
-#include <set>
+#include <memory>
+#include <string_view>
 #include <unordered_set>
 #include <algorithm>
-#include "regex"
-#include "string"
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
+#include "souffle/ProofGraph.h"
+#include "souffle/TraceStream.h"
 
 namespace modified_souffle {
-	struct Tuple {
-		size_t rule_id;
-		std::string name;
-		size_t size;
-		size_t *parent_node;
-		bool is_root;  // 通过input创造的tuple没有父节点
-
-		Tuple(bool is_root, std::string &name)
-				:
-				name(name), parent_node(nullptr), is_root(is_root), rule_id(0), size(0) {};
-
-		Tuple(bool is_root, std::string &name, size_t relation_id, size_t size)
-				:
-				rule_id(relation_id), name(name), is_root(is_root), size(size) {
-			parent_node = (size_t *) malloc(size * sizeof(size_t));
-		}
-
-		~Tuple() {
-			if (parent_node != nullptr) free(parent_node);
-		}
-	};
-
 	struct RelationCount {
 		std::string name;
 		size_t pr;
 		size_t fr;
 
-		explicit RelationCount(std::string &relation) :
+		explicit RelationCount(const std::string &relation) :
 				name(relation), pr(0), fr(0) {};
 	};
 
-	class correctTupleExtractor {
+	/**
+	 * 持有字符串的内容，返回的string_view在其生命周期内一直有效
+	 */
+	class StringArena {
 	public:
-		correctTupleExtractor(const char *path) {
-			this->path = path;
-			extract();
-		}
-
-		/** 提取的正确tuple */
-		std::unordered_set<std::string> tuple_list;
+		std::string_view store(std::string_view text);
 
 	private:
-		void extract();
-
-		const char *path;
-		bool flag;
-		std::string set_name;
-		std::vector<std::string> output_set;
-		std::ifstream is;
+		static constexpr size_t BLOCK_SIZE = 1 << 16;
+		std::vector<std::unique_ptr<char[]>> blocks;
+		size_t capacity = 0;
+		size_t used = 0;
 	};
 
 	class proofTreeBuilder {
 	public:
+		/**
+		 * proof graph文件被直接映射，编译后的程序写出的事件流先回放为同目录下的proof graph，
+		 * 旧版的文本文件被一次性流式解析为同样的格式；文件无法读取时报错并退出
+		 */
 		proofTreeBuilder(const char *path) {
-			is.open(path);
-			set_pattern.assign((R"(\s(\w*?)(?=\())"));
-			tuple_pattern.assign((R"(\([\w,"]*\))"));
-			build();
+			if (proof_graph::ProofGraph::is_proof_graph(path)) {
+				if (!graph.open(path)) {
+					std::cerr << "cannot read the proof graph " << path << std::endl;
+					std::exit(1);
+				}
+			} else if (trace_stream::is_trace_stream(path)) {
+				if (!openStream(path)) {
+					std::cerr << "cannot replay the trace stream " << path << std::endl;
+					std::exit(1);
+				}
+			} else
+				build(path);
+			for (uint32_t i = 0; i < graph.rule_count(); ++i) {
+				std::string rule = graph.rule_text(i);
+				relation_list.emplace_back(rule.substr(0, rule.find('.')));
+			}
 		}
 
-		std::vector<Tuple *> tuple_list;
+		/** tuple、推导及其来源 */
+		proof_graph::ProofGraph graph;
+		/** 按规则id索引 */
 		std::vector<RelationCount> relation_list;
-		std::vector<std::string> output_set;
+
+		/** tuple是否属于最终输出的集合 */
+		bool is_output(uint32_t tuple) const {
+			return (graph.relation(graph.tuple(tuple).relation).flags & proof_graph::OUTPUT) != 0;
+		}
+
+		/** 形如"(a,b)@path"的tuple名 */
+		std::string tuple_name(uint32_t tuple) const {
+			return graph.render_tuple(tuple) + "@" + graph.relation_name(graph.tuple(tuple).relation);
+		}
 
 	private:
-		bool readALine();
+		/** 映射事件流旁的"<path>.pg"，它不是有效的proof graph或比事件流旧时先重新回放 */
+		bool openStream(const char *path);
+
+		/** 按块读入文本文件，逐行解析 */
+		void build(const char *path);
+
+		void parseLine(std::string_view line);
 
-		void build() {
-			while (readALine());
-			tuple_map.clear();
-			relation_map.clear();
-		};
+		uint32_t getRelation(std::string_view name);
+
+		/** @param tuple 形如"(a,b)" */
+		uint32_t getTuple(uint32_t relation, std::string_view tuple);
+
+		/** 当前规则中作为来源的集合，即规则体中的各个atom */
+		void parseRuleBody(std::string_view rule);
 
 		bool is_relation = false;
-		size_t curr_tupleId = 0;
 		/** tuple要被添加到的set */
-		std::string curr_setName;
+		uint32_t curr_set = 0;
 		/** 当前正在应用的规则 */
-		std::string curr_relation;
-		size_t curr_relationId = 0;
-		std::unordered_map<std::string, size_t> tuple_map;
-		std::unordered_map<std::string, size_t> relation_map;
-		std::regex set_pattern;
-		std::regex tuple_pattern;
-		std::ifstream is;
+		uint32_t curr_relationId = 0;
+		proof_graph::ProofGraphWriter writer;
+		std::vector<int64_t> values;
+		std::vector<uint32_t> premises;
+		/** 按规则id索引的规则体中的集合 */
+		std::vector<std::vector<uint32_t>> rule_body;
+		/** 按集合索引，以tuple文本为键 */
+		std::vector<std::unordered_map<std::string_view, uint32_t>> tuple_map;
+		std::unordered_map<std::string_view, uint32_t> relation_map;
+		std::unordered_map<std::string_view, uint32_t> set_map;
+		std::unordered_map<std::string_view, int64_t> symbol_map;
+		/** 以上各表的键 */
+		StringArena arena;
+	};
+
+	class correctTupleExtractor {
+	public:
+		correctTupleExtractor(const char *path) {
+			proofTreeBuilder builder(path);
+			for (uint32_t i = 0; i < builder.graph.tuple_count(); ++i) {
+				if (builder.is_output(i)) tuple_list.insert(builder.tuple_name(i));
+			}
+		}
+
+		/** 提取的正确tuple，形如"(a,b)@path" */
+		std::unordered_set<std::string> tuple_list;
 	};
 }  // namespace modified_souffle
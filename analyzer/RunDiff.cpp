@@ -0,0 +1,297 @@
+#include "RunDiff.h"
+#include "ProofTreeBuilder.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+	/** 每个分区的目标字节数，决定比较时单个线程占用的内存 */
+	constexpr uint64_t PARTITION_SIZE = uint64_t(64) << 20;
+	constexpr size_t MAX_PARTITIONS = 1024;
+	/** 每个分区写出前在内存中积累的字节数 */
+	constexpr size_t WRITE_BUFFER_SIZE = 1 << 16;
+
+	enum Side : uint8_t {
+		CORRECT = 0,
+		WRONG = 1,
+	};
+
+	/**
+	 * 分区文件中的一条记录：side(u8)、集合id(u32)、tuple长度(u32)、规则数(u32)、tuple文本与规则id(u32)。
+	 * 集合与规则的id在两次运行间共用，按名字分配
+	 */
+	struct RecordHeader {
+		uint8_t side;
+		uint32_t relation;
+		uint32_t length;
+		uint32_t ruleCount;
+	};
+	constexpr size_t HEADER_SIZE = 1 + 3 * sizeof(uint32_t);
+
+	class Partitioner {
+	public:
+		Partitioner(const fs::path &directory, size_t count) : buffers(count) {
+			for (size_t i = 0; i < count; ++i) {
+				paths.push_back(directory / ("partition_" + std::to_string(i)));
+				files.emplace_back(paths.back(), std::ios::binary | std::ios::trunc);
+			}
+		}
+
+		uint32_t relation(const std::string &name) {
+			return intern(name, relations, relationIndex);
+		}
+
+		uint32_t rule(const std::string &text) {
+			return intern(text, rules, ruleIndex);
+		}
+
+		void add(Side side, uint32_t relation, std::string_view tuple, const std::vector<uint32_t> &ruleIds) {
+			const size_t hash = std::hash<std::string_view>()(tuple) ^ (relation * 0x9e3779b97f4a7c15ull);
+			const size_t index = hash % buffers.size();
+			std::vector<char> &buffer = buffers[index];
+			char header[HEADER_SIZE];
+			const auto length = static_cast<uint32_t>(tuple.size());
+			const auto ruleCount = static_cast<uint32_t>(ruleIds.size());
+			header[0] = static_cast<char>(side);
+			std::memcpy(header + 1, &relation, sizeof(uint32_t));
+			std::memcpy(header + 5, &length, sizeof(uint32_t));
+			std::memcpy(header + 9, &ruleCount, sizeof(uint32_t));
+			buffer.insert(buffer.end(), header, header + HEADER_SIZE);
+			buffer.insert(buffer.end(), tuple.begin(), tuple.end());
+			const char *ids = reinterpret_cast<const char *>(ruleIds.data());
+			buffer.insert(buffer.end(), ids, ids + ruleIds.size() * sizeof(uint32_t));
+			if (buffer.size() >= WRITE_BUFFER_SIZE) flush(index);
+		}
+
+		void close() {
+			for (size_t i = 0; i < files.size(); ++i) {
+				flush(i);
+				files[i].close();
+			}
+		}
+
+		std::vector<fs::path> paths;
+		std::vector<std::string> relations;
+		std::vector<std::string> rules;
+
+	private:
+		static uint32_t intern(const std::string &name, std::vector<std::string> &names,
+							   std::unordered_map<std::string, uint32_t> &index) {
+			auto it = index.find(name);
+			if (it != index.end()) return it->second;
+			const auto id = static_cast<uint32_t>(names.size());
+			names.push_back(name);
+			index.emplace(name, id);
+			return id;
+		}
+
+		void flush(size_t index) {
+			files[index].write(buffers[index].data(), static_cast<std::streamsize>(buffers[index].size()));
+			buffers[index].clear();
+		}
+
+		std::vector<std::ofstream> files;
+		std::vector<std::vector<char>> buffers;
+		std::unordered_map<std::string, uint32_t> relationIndex;
+		std::unordered_map<std::string, uint32_t> ruleIndex;
+	};
+
+	/** 将trace中的所有tuple写入分区，@开头的临时集合除外 */
+	void scanTrace(const std::string &path, Side side, Partitioner &partitioner) {
+		modified_souffle::proofTreeBuilder builder(path.c_str());
+		const auto &graph = builder.graph;
+		std::vector<uint32_t> relationIds;
+		for (uint32_t i = 0; i < graph.relation_count(); ++i) {
+			relationIds.push_back(partitioner.relation(graph.relation_name(i)));
+		}
+		std::vector<uint32_t> ruleIds;
+		for (uint32_t i = 0; i < graph.rule_count(); ++i) {
+			ruleIds.push_back(partitioner.rule(graph.rule_text(i)));
+		}
+		std::vector<uint32_t> rules;
+		for (uint32_t i = 0; i < graph.tuple_count(); ++i) {
+			const auto &tuple = graph.tuple(i);
+			if (graph.relation_name(tuple.relation)[0] == '@') continue;
+			rules.clear();
+			for (uint32_t d = tuple.firstDerivation; d < tuple.firstDerivation + tuple.derivationCount; ++d) {
+				rules.push_back(ruleIds[graph.derivation(d).rule]);
+			}
+			std::sort(rules.begin(), rules.end());
+			rules.erase(std::unique(rules.begin(), rules.end()), rules.end());
+			partitioner.add(side, relationIds[tuple.relation], graph.render_tuple(i), rules);
+		}
+	}
+
+	/** 将souffle输出的csv文件写入分区，每行的各列以tab分隔 */
+	void scanCsv(const fs::path &path, Side side, Partitioner &partitioner) {
+		const uint32_t relation = partitioner.relation(path.stem().string());
+		const std::vector<uint32_t> rules;
+		std::ifstream is(path);
+		std::string line;
+		std::string tuple;
+		while (std::getline(is, line)) {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (line.empty()) continue;
+			tuple = "(";
+			for (char c : line) tuple += c == '\t' ? ',' : c;
+			tuple += ")";
+			partitioner.add(side, relation, tuple, rules);
+		}
+	}
+
+	void scanRun(const std::string &run, Side side, Partitioner &partitioner) {
+		const std::string trace = modified_souffle::traceFile(run);
+		if (!fs::is_directory(trace)) {
+			scanTrace(trace, side, partitioner);
+			return;
+		}
+		for (const auto &entry : fs::directory_iterator(trace)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".csv") scanCsv(entry.path(), side, partitioner);
+		}
+	}
+
+	uint64_t inputSize(const std::string &run) {
+		const std::string trace = modified_souffle::traceFile(run);
+		if (!fs::is_directory(trace)) return fs::file_size(trace);
+		uint64_t size = 0;
+		for (const auto &entry : fs::directory_iterator(trace)) {
+			if (entry.is_regular_file()) size += entry.file_size();
+		}
+		return size;
+	}
+
+	/** 一个线程比较得到的计数，按集合id与规则id索引 */
+	struct LocalCount {
+		std::vector<modified_souffle::DiffCount> relations;
+		std::vector<modified_souffle::DiffCount> rules;
+	};
+
+	void comparePartition(const fs::path &path, LocalCount &count) {
+		std::ifstream is(path, std::ios::binary);
+		std::vector<char> data(fs::file_size(path));
+		is.read(data.data(), static_cast<std::streamsize>(data.size()));
+
+		struct Entry {
+			/** 两侧的记录，不存在时为nullptr */
+			const char *record[2] = {nullptr, nullptr};
+		};
+		auto hash = [](const std::pair<uint32_t, std::string_view> &key) {
+			return std::hash<std::string_view>()(key.second) ^ (key.first * 0x9e3779b97f4a7c15ull);
+		};
+		std::unordered_map<std::pair<uint32_t, std::string_view>, Entry, decltype(hash)> tuples(0, hash);
+		for (size_t pos = 0; pos < data.size();) {
+			RecordHeader header;
+			header.side = static_cast<uint8_t>(data[pos]);
+			std::memcpy(&header.relation, data.data() + pos + 1, sizeof(uint32_t));
+			std::memcpy(&header.length, data.data() + pos + 5, sizeof(uint32_t));
+			std::memcpy(&header.ruleCount, data.data() + pos + 9, sizeof(uint32_t));
+			std::string_view tuple(data.data() + pos + HEADER_SIZE, header.length);
+			Entry &entry = tuples[{header.relation, tuple}];
+			if (entry.record[header.side] == nullptr) entry.record[header.side] = data.data() + pos;
+			pos += HEADER_SIZE + header.length + header.ruleCount * sizeof(uint32_t);
+		}
+
+		auto slot = [](std::vector<modified_souffle::DiffCount> &counts, uint32_t id) -> modified_souffle::DiffCount & {
+			if (id >= counts.size()) counts.resize(id + 1);
+			return counts[id];
+		};
+		auto forRules = [&](const char *record, size_t modified_souffle::DiffCount::*field) {
+			uint32_t length;
+			uint32_t ruleCount;
+			std::memcpy(&length, record + 5, sizeof(uint32_t));
+			std::memcpy(&ruleCount, record + 9, sizeof(uint32_t));
+			const char *ids = record + HEADER_SIZE + length;
+			for (uint32_t i = 0; i < ruleCount; ++i) {
+				uint32_t rule;
+				std::memcpy(&rule, ids + i * sizeof(uint32_t), sizeof(uint32_t));
+				slot(count.rules, rule).*field += 1;
+			}
+		};
+		for (const auto &[key, entry] : tuples) {
+			modified_souffle::DiffCount &relation = slot(count.relations, key.first);
+			if (entry.record[WRONG] == nullptr) {
+				relation.missing++;
+				forRules(entry.record[CORRECT], &modified_souffle::DiffCount::missing);
+			} else if (entry.record[CORRECT] == nullptr) {
+				relation.extra++;
+				forRules(entry.record[WRONG], &modified_souffle::DiffCount::extra);
+			} else {
+				relation.shared++;
+				forRules(entry.record[WRONG], &modified_souffle::DiffCount::shared);
+			}
+		}
+	}
+
+	void accumulate(std::map<std::string, modified_souffle::DiffCount> &target, const std::vector<std::string> &names,
+					const std::vector<modified_souffle::DiffCount> &counts) {
+		for (size_t i = 0; i < counts.size(); ++i) {
+			modified_souffle::DiffCount &total = target[names[i]];
+			total.missing += counts[i].missing;
+			total.extra += counts[i].extra;
+			total.shared += counts[i].shared;
+		}
+	}
+}  // namespace
+
+std::string modified_souffle::traceFile(const std::string &run) {
+	if (!fs::is_directory(run)) return run;
+	for (const char *name : {"proof_graph", "trace_stream"}) {
+		const fs::path trace = fs::path(run) / name;
+		if (fs::is_regular_file(trace)) return trace.string();
+	}
+	return run;
+}
+
+modified_souffle::DiffReport modified_souffle::diffRuns(const std::string &correct, const std::string &wrong,
+														 unsigned threads) {
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	const uint64_t total = inputSize(correct) + inputSize(wrong);
+	const size_t partitions = std::min<uint64_t>(
+			MAX_PARTITIONS, std::max<uint64_t>(threads, (total + PARTITION_SIZE - 1) / PARTITION_SIZE));
+
+	const fs::path directory =
+			fs::temp_directory_path() / ("souffle-analyze-" + std::to_string(std::random_device()()));
+	fs::create_directories(directory);
+	Partitioner partitioner(directory, partitions);
+	scanRun(correct, CORRECT, partitioner);
+	scanRun(wrong, WRONG, partitioner);
+	partitioner.close();
+
+	std::vector<LocalCount> counts(threads);
+	std::atomic<size_t> next{0};
+	std::vector<std::thread> workers;
+	for (unsigned t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t]() {
+			for (size_t i = next++; i < partitions; i = next++) {
+				comparePartition(partitioner.paths[i], counts[t]);
+				fs::remove(partitioner.paths[i]);
+			}
+		});
+	}
+	for (std::thread &worker : workers) worker.join();
+	fs::remove_all(directory);
+
+	DiffReport report;
+	for (const LocalCount &count : counts) {
+		accumulate(report.relations, partitioner.relations, count.relations);
+		accumulate(report.rules, partitioner.rules, count.rules);
+	}
+	return report;
+}
+
+void modified_souffle::printDiff(std::ostream &os, const DiffReport &report) {
+	auto print = [&](const char *title, const std::map<std::string, DiffCount> &counts) {
+		os << title << "\tmissing\textra\tshared" << std::endl;
+		for (const auto &[name, count] : counts) {
+			os << name << "\t" << count.missing << "\t" << count.extra << "\t" << count.shared << std::endl;
+		}
+	};
+	print("relation", report.relations);
+	os << std::endl;
+	print("rule", report.rules);
+}
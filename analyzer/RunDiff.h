@@ -0,0 +1,43 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace modified_souffle {
+	/** 一个集合或一条规则在两次运行间的差异 */
+	struct DiffCount {
+		/** 只出现在正确运行中的tuple数 */
+		size_t missing = 0;
+		/** 只出现在错误运行中的tuple数 */
+		size_t extra = 0;
+		/** 两次运行都有的tuple数 */
+		size_t shared = 0;
+	};
+
+	struct DiffReport {
+		/** 以集合名为键 */
+		std::map<std::string, DiffCount> relations;
+		/**
+		 * 以规则文本为键：missing计入正确运行中推导出该tuple的规则，
+		 * extra与shared计入错误运行中推导出该tuple的规则
+		 */
+		std::map<std::string, DiffCount> rules;
+	};
+
+	/**
+	 * 一次运行的trace文件：目录中有proof_graph或trace_stream时返回它，否则原样返回
+	 */
+	std::string traceFile(const std::string &run);
+
+	/**
+	 * 比较两次运行得到的tuple。每次运行可以是proof graph、事件流或文本trace，也可以是包含它们或csv输出的目录。
+	 * 两侧的tuple按(集合, tuple)的哈希写入磁盘上的若干分区，之后各分区在多个线程中分别装入内存比较，
+	 * 内存占用只取决于分区的大小而不是tuple总数
+	 * @param threads 线程数，为0时使用硬件线程数
+	 */
+	DiffReport diffRuns(const std::string &correct, const std::string &wrong, unsigned threads = 0);
+
+	/** 按集合与规则输出差异 */
+	void printDiff(std::ostream &os, const DiffReport &report);
+}  // namespace modified_souffle
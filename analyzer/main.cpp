@@ -1,48 +1,80 @@
-#include "ProofTreeBuilder.h"
+#include "FaultLocalization.h"
+#include "ProofQuery.h"
+#include "RunDiff.h"
+#include <chrono>
 
 using namespace modified_souffle;
 
-void proofTreeTravel(proofTreeBuilder &builder, Tuple *tuple, bool is_correct) {
-	if (tuple->is_root)return;
-	if (is_correct)builder.relation_list[tuple->rule_id].pr++;
-	else builder.relation_list[tuple->rule_id].fr++;
-	for (size_t i = 0; i < tuple->size; ++i) {
-		proofTreeTravel(builder, builder.tuple_list[tuple->parent_node[i]], is_correct);
+namespace {
+	int usage() {
+		std::cerr << "usage: souffle-analyze diff <correct run> <wrong run>" << std::endl;
+		std::cerr << "       souffle-analyze spectrum <correct run> <wrong run>" << std::endl;
+		std::cerr << "       souffle-analyze query <run> [query]" << std::endl;
+		std::cerr << "a run is a trace file (proof graph, trace stream or text) or the directory holding it;"
+				  << std::endl;
+		std::cerr << "diff also accepts a directory of csv outputs" << std::endl;
+		std::cerr << "query reads one query per line from stdin when none is given:" << std::endl;
+		std::cerr << "  ancestors|descendants|proof|blame <tuple>, rule <id|text>, relation <name>" << std::endl;
+		std::cerr << "  where a tuple is written as (a,b)@path" << std::endl;
+		return 1;
 	}
-}
 
-int main() {
-	size_t p = 0;
-	size_t f = 0;
-	correctTupleExtractor correct(
-			R"(D:\souffle-2.1\souffle-2.1\souffle-analyze-data\output_0)");
-	proofTreeBuilder wrong(R"(D:\souffle-2.1\souffle-2.1\souffle-analyze-data\output_1)");
-	for (Tuple *tuple: wrong.tuple_list) {
-		// tuple是根节点，无需进行统计
-		if (tuple->is_root) continue;
-		std::string set_name = tuple->name.substr(tuple->name.find('@') + 1);
-		// 是最终输出的tuple
-		if (std::find(wrong.output_set.begin(), wrong.output_set.end(), set_name) != wrong.output_set.end()) {
-			auto it = correct.tuple_list.find(tuple->name);
-			// 存在于正确的tuple列表中，从tuple_list移除该tuple，节约后续查找时间
-			if (it != correct.tuple_list.end()) {
-				correct.tuple_list.erase(it);
-				p++;
-				proofTreeTravel(wrong, tuple, true);
-			}
-				// 不存在列表中，是错误的元组，进行计数
-			else {
-				f++;
-				proofTreeTravel(wrong, tuple, false);
+	int query(int argc, char **argv) {
+		const std::string trace = traceFile(argv[2]);
+		proofTreeBuilder builder(trace.c_str());
+		ProofGraphIndex index;
+		if (!index.open(builder, trace)) {
+			std::cerr << "cannot write the index of " << trace << std::endl;
+			return 1;
+		}
+		auto run = [&](const std::string &line) {
+			const auto start = std::chrono::steady_clock::now();
+			const bool ok = runQuery(std::cout, builder, index, line);
+			const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << std::flush;
+			if (!ok) std::cerr << "no answer: " << line << std::endl;
+			std::cerr << "(" << elapsed.count() << " ms)" << std::endl;
+			return ok;
+		};
+		if (argc > 3) {
+			std::string line = argv[3];
+			for (int i = 4; i < argc; ++i) line += std::string(" ") + argv[i];
+			return run(line) ? 0 : 1;
+		}
+		std::string line;
+		while (std::getline(std::cin, line)) {
+			if (!line.empty()) run(line);
+		}
+		return 0;
+	}
+
+	int spectrum(const std::string &correctRun, const std::string &wrongRun) {
+		size_t p = 0;
+		size_t f = 0;
+		correctTupleExtractor correct(traceFile(correctRun).c_str());
+		proofTreeBuilder wrong(traceFile(wrongRun).c_str());
+		collectSpectrum(wrong, correct.tuple_list, p, f);
+		std::cout << "P = " << p << "\tF = " << f << std::endl;
+		for (RelationCount &relation: wrong.relation_list) {
+			std::cout << relation.name << "\t Pr = " << relation.pr << "\t Fr = " << relation.fr;
+			for (Formula formula: FORMULAS) {
+				std::cout << "\t " << formulaName(formula) << " = " << suspiciousness(formula, relation, p, f);
 			}
+			std::cout << std::endl;
 		}
+		return 0;
 	}
-	// 最终correct.tuple_list留下来的是缺失的元组
-	std::cout << "P = " << p << "\tF = " << f << std::endl;
-	for (RelationCount &relation: wrong.relation_list) {
-		double op_val = relation.fr - relation.pr / (p + 1.0);
-		std::cout << relation.name << "\t Pr = " << relation.pr << "\t Fr = " << relation.fr << "\t Op = " << op_val
-				  << std::endl;
+}  // namespace
+
+int main(int argc, char **argv) {
+	if (argc < 3) return usage();
+	const std::string command = argv[1];
+	if (command == "query") return query(argc, argv);
+	if (argc != 4) return usage();
+	if (command == "diff") {
+		printDiff(std::cout, diffRuns(argv[2], argv[3]));
+		return 0;
 	}
-	return 0;
-}
\ No newline at end of file
+	if (command == "spectrum") return spectrum(argv[2], argv[3]);
+	return usage();
+}
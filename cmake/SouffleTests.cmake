@@ -119,6 +119,7 @@ function(SOUFFLE_RUN_TEST_HELPER)
     # PARAM_CATEGORY - e.g. syntactic, example etc.
     # PARAM_TEST_NAME - the name of the test, the short directory name under tests/<category>/<test_name>
     # PARAM_COMPILED - with or without -c
+    # PARAM_UNTRACED - interpreted with --no-trace
     # PARAM_FUNCTORS - with -L for finding functor library in the testsuite  
     # PARAM_NEGATIVE - should it fail or not
     # PARAM_MULTI_TEST - used to distinguish "multi-tests", sort of left over from automake
@@ -130,7 +131,7 @@ function(SOUFFLE_RUN_TEST_HELPER)
     #                        Usually just "facts" but can be different when running multi-tests
     cmake_parse_arguments(
         PARAM
-        "COMPILED;FUNCTORS;NEGATIVE;MULTI_TEST" # Options
+        "COMPILED;UNTRACED;FUNCTORS;NEGATIVE;MULTI_TEST" # Options
         "TEST_NAME;CATEGORY;FACTS_DIR_NAME;EXTRA_DATA" #Single valued options
         ""
         ${ARGV}
@@ -140,6 +141,13 @@ function(SOUFFLE_RUN_TEST_HELPER)
         set(EXTRA_FLAGS "-c")
         set(EXEC_STYLE "compiled")
         set(SHORT_EXEC_STYLE "_c")
+    elseif (PARAM_UNTRACED)
+        # The interpreter takes different paths when it does not trace, e.g. block-at-a-time scans.
+        # Adaptive dispatch with a zero threshold runs the first iteration of a recursive query on
+        # the switch and the rest as closures, so that both dispatchers are covered.
+        set(EXTRA_FLAGS "--no-trace --interpreter-dispatch=adaptive --hot-query-threshold=0")
+        set(EXEC_STYLE "untraced")
+        set(SHORT_EXEC_STYLE "_u")
     else()
         set(EXEC_STYLE "interpreted")
         set(SHORT_EXEC_STYLE "")
@@ -241,10 +249,11 @@ function(SOUFFLE_ADD_BINARY_TEST TEST_NAME CATEGORY)
     set_tests_properties(${QUALIFIED_TEST_NAME} PROPERTIES LABELS "unit_test;${CATEGORY}")
 endfunction()
 
-# Run a souffle test, both as interpred and as compiled
+# Run a souffle test as interpreted (traced and untraced) and as compiled
 # For additional parameters, see souffle_run_test_helper above
 function(SOUFFLE_RUN_TEST)
     souffle_run_test_helper(${ARGV})
+    souffle_run_test_helper(${ARGV} UNTRACED)
     souffle_run_test_helper(${ARGV} COMPILED)
 endfunction()
 
@@ -0,0 +1,109 @@
+#!/bin/bash
+
+# Benchmark the interpreter with tracing off, full and filtered.
+#
+# Every program is evaluated on a prefix of each of its fact files (SCALES gives
+# the prefixes in percent of the lines) in three modes:
+#   off       --no-trace
+#   full      every relation traced
+#   filtered  --trace-filter=<relation>, by default the first output relation
+# Each run prints one JSON object per line with the median wall time, the peak
+# RSS (needs GNU time, null otherwise), trace events per second and trace bytes
+# as counted by --trace-stats, so that the output can be kept and compared.
+#
+# usage: sh/run_trace_benchmark.sh [souffle binary] [repetitions] [program[:filter]...]
+#   programs are names of directories in tests/evaluation or tests/example.
+
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+SOUFFLE="$(realpath "${1:-$ROOT/build/src/souffle}")"
+REPS=${2:-3}
+shift 2 || shift $#
+# transitive closure, points-to, aggregates and two larger evaluation programs
+PROGRAMS=${@:-"tc java-pointsto choice_highest_mark:highest_mark magic_samegen access1"}
+SCALES=${SCALES:-"25 50 100"}
+JOBS=${JOBS:-1}
+GNU_TIME=${GNU_TIME:-/usr/bin/time}
+[ -x "$GNU_TIME" ] || GNU_TIME=
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# $WORK/facts holding the first $2 percent of the lines of every fact file in $1
+scale_facts() {
+  rm -rf "$WORK/facts" && mkdir "$WORK/facts"
+  for file in "$1"/*; do
+    [ -f "$file" ] || continue
+    local lines=$(wc -l < "$file")
+    head -n $(((lines * $2 + 99) / 100)) "$file" > "$WORK/facts/$(basename "$file")"
+  done
+}
+
+# "<median wall ms> <peak rss kB of that run>" of running "$@" $REPS times inside $WORK;
+# the trace counters of the median run are left in $WORK/stats.json
+run_median() {
+  local runs=()
+  for ((i = 0; i < REPS; i++)); do
+    rm -f "$WORK/stats.json" "$WORK/rss"
+    local start=$(date +%s%N)
+    if [ -n "$GNU_TIME" ]; then
+      (cd "$WORK/out" && "$GNU_TIME" -f %M -o "$WORK/rss" "$@" > /dev/null 2>&1)
+    else
+      (cd "$WORK/out" && "$@" > /dev/null 2>&1)
+    fi
+    local end=$(date +%s%N)
+    local rss=null
+    [ -s "$WORK/rss" ] && rss=$(tail -n 1 "$WORK/rss")
+    [ -f "$WORK/stats.json" ] && cp "$WORK/stats.json" "$WORK/stats.$i.json"
+    runs+=("$(((end - start) / 1000000)) $rss $i")
+  done
+  local median=$(printf "%s\n" "${runs[@]}" | sort -n | sed -n "$(((REPS + 1) / 2))p")
+  rm -f "$WORK/stats.json"
+  [ -f "$WORK/stats.${median##* }.json" ] && mv "$WORK/stats.${median##* }.json" "$WORK/stats.json"
+  rm -f "$WORK"/stats.*.json
+  echo "${median% *}"
+}
+
+# value of the numeric field $1 in $WORK/stats.json, 0 without one
+stats_field() {
+  [ -f "$WORK/stats.json" ] || { echo 0; return; }
+  sed -n "s/.*\"$1\": *\([0-9.e+]*\).*/\1/p" "$WORK/stats.json" | awk '{ printf "%d", $1 }'
+}
+
+for entry in $PROGRAMS; do
+  prog=${entry%%:*}
+  dir="$ROOT/tests/evaluation/$prog"
+  [ -d "$dir" ] || dir="$ROOT/tests/example/$prog"
+  filter=${entry#*:}
+  if [ "$filter" = "$entry" ]; then
+    filter=$(sed -n 's/^[[:space:]]*\.output[[:space:]]*\([A-Za-z_?][A-Za-z0-9_?]*\).*/\1/p' "$dir/$prog.dl" | head -n 1)
+  fi
+  scales=$SCALES
+  # programs with inline facts only run at full scale
+  [ -d "$dir/facts" ] || scales=100
+
+  for scale in $scales; do
+    facts="$dir"
+    if [ -d "$dir/facts" ]; then
+      scale_facts "$dir/facts" "$scale"
+      facts="$WORK/facts"
+    fi
+    for mode in off full filtered; do
+      rm -rf "$WORK/out" && mkdir "$WORK/out"
+      args=(-j"$JOBS" -F "$facts" -D "$WORK/out" --trace-progress=0)
+      case $mode in
+        off) args+=(--no-trace) ;;
+        full) args+=(--trace-stats="$WORK/stats.json") ;;
+        filtered) args+=(--trace-stats="$WORK/stats.json" --trace-filter="$filter") ;;
+      esac
+      read -r wall rss <<< "$(run_median "$SOUFFLE" "${args[@]}" "$dir/$prog.dl")"
+      events=$(stats_field events)
+      bytes=$(stats_field trace_bytes)
+      rate=$(awk -v e="$events" -v t="$wall" 'BEGIN { if (t > 0) printf "%d", e * 1000 / t; else print 0 }')
+      printf '{"program":"%s","scale":%d,"mode":"%s","filter":"%s","wall_ms":%d,"peak_rss_kb":%s,' \
+        "$prog" "$scale" "$mode" "$([ $mode = filtered ] && echo "$filter")" "$wall" "$rss"
+      printf '"events":%d,"events_per_s":%d,"trace_bytes":%d}\n' "$events" "$rate" "$bytes"
+    done
+  done
+done
@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# Measure the cost of tracing in the interpreter.
+#
+# Every program is evaluated untraced (--no-trace) and traced; if UPSTREAM_SOUFFLE
+# points to an unmodified Souffle 2.1 binary, it is timed as well so that the
+# untraced column can be compared against it.
+#
+# usage: sh/run_trace_parity.sh [souffle binary] [repetitions] [program...]
+#   programs are names of directories in tests/evaluation and default to a few
+#   of the larger ones.
+
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+SOUFFLE="$(realpath "${1:-$ROOT/build/src/souffle}")"
+REPS=${2:-5}
+shift 2 || shift $#
+PROGRAMS=${@:-"magic_samegen access1 access3 mrtc cprog1"}
+JOBS=${JOBS:-1}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# median wall-clock time in ms of running "$@" $REPS times inside $WORK
+time_median() {
+  local times=()
+  for ((i = 0; i < REPS; i++)); do
+    local start=$(date +%s%N)
+    (cd "$WORK" && "$@" > /dev/null 2>&1)
+    local end=$(date +%s%N)
+    times+=($(((end - start) / 1000000)))
+  done
+  printf "%s\n" "${times[@]}" | sort -n | sed -n "$(((REPS + 1) / 2))p"
+}
+
+printf "%-20s %12s %12s %12s %10s\n" "program" "upstream/ms" "untraced/ms" "traced/ms" "overhead"
+for prog in $PROGRAMS; do
+  dir="$ROOT/tests/evaluation/$prog"
+  facts="$dir/facts"
+  [ -d "$facts" ] || facts="$dir"
+  args=(-j"$JOBS" -F "$facts" -D "$WORK" "$dir/$prog.dl")
+
+  upstream="-"
+  if [ -n "$UPSTREAM_SOUFFLE" ]; then
+    upstream=$(time_median "$UPSTREAM_SOUFFLE" "${args[@]}")
+  fi
+  untraced=$(time_median "$SOUFFLE" --no-trace "${args[@]}")
+  traced=$(time_median "$SOUFFLE" "${args[@]}")
+  overhead=$(awk -v a="$traced" -v b="$untraced" 'BEGIN { if (b > 0) printf "%.2fx", a / b; else print "-" }')
+  printf "%-20s %12s %12s %12s %10s\n" "$prog" "$upstream" "$untraced" "$traced" "$overhead"
+done
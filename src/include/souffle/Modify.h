@@ -5,48 +5,419 @@
 #pragma once
 #include "cassert"
 #include "iostream"
+#include "souffle/ProofGraph.h"
+#include "souffle/RamTypes.h"
+#include "souffle/Suspiciousness.h"
 #include "souffle/SymbolTable.h"
 #include "sstream"
 #include "string"
 #include "vector"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <thread>
 
+namespace souffle {
+class RecordTableInterface;
+}
+
 namespace modified_souffle {
 
+/** 事件中可携带的最大tuple长度，覆盖解释器支持的全部arity */
+constexpr std::size_t MAX_TRACE_ARITY = 32;
+
+/** 异步模式下环形队列可容纳的事件数 */
+constexpr std::size_t TRACE_RING_CAPACITY = 1 << 14;
+
+/** 文本输出与溢出文件每次写出的字节数 */
+constexpr std::size_t TRACE_BUFFER_SIZE = 1 << 20;
+
+/** 未给出--trace-memory时一条规则的推导在内存中最多占用的字节数 */
+constexpr std::size_t DEFAULT_TRACE_MEMORY = std::size_t(256) << 20;
+
+/** 跟踪策略：引擎按策略实例化，NoTrace下所有跟踪代码在编译期被去除 */
+struct NoTrace {
+    static constexpr bool enabled = false;
+};
+struct FullTrace {
+    static constexpr bool enabled = true;
+};
+
+/**
+ * @enum TraceFormat
+ * @brief 分析结果的输出格式，由--trace-format给出
+ */
+enum class TraceFormat {
+    /** 按规则分段的文本，便于直接阅读 */
+    Text,
+    /** 二进制的proof graph，见ProofGraph.h */
+    Graph,
+};
+
+/**
+ * @enum TraceDedup
+ * @brief 重复推导的记录方式，由--trace-dedup给出
+ */
+enum class TraceDedup {
+    /** 记录每次插入 */
+    None,
+    /** 只记录使tuple加入集合的插入，由引擎按insert的返回值判断 */
+    Tuple,
+    /** 每条规则对每个tuple只记录第一次推导，由分析器按(规则, tuple)去重 */
+    Rule,
+};
+
+/**
+ * @enum TraceOp
+ * @brief 引擎传递给分析器的事件类型
+ */
+enum class TraceOp : uint8_t {
+    /** 进入DEBUG标记的规则，relId为规则id */
+    Debug,
+    InsertTarget,
+    Insert,
+    /** 从文件读入的tuple */
+    InputTuple,
+    /** relId与viewId分别为被交换的两个集合 */
+    Swap,
+    Clear,
+    ScanTarget,
+    ExistTarget,
+    /** 扫描到的tuple，按索引中的顺序存放，viewId为register_order()给出的order id */
+    ScanEval,
+    /** 通过view查到的tuple，viewId的含义同ScanEval */
+    ScanIndex,
+    EndScan,
+    Output,
+    /** 一个stratum执行完毕，relId为stratum的编号 */
+    Stratum,
+    /** 要插入的tuple已在集合中，按TraceDedup::Tuple不携带tuple，只用于结束这次插入 */
+    Redundant,
+};
+
+/**
+ * @struct TraceEvent
+ * @brief 定长的二进制事件记录，payload为未经解码的RamDomain
+ */
+struct TraceEvent {
+    TraceOp op;
+    uint32_t relId;
+    uint32_t viewId;
+    uint32_t arity;
+    souffle::RamDomain data[MAX_TRACE_ARITY];
+};
+
+/** 并行扫描中一个分区按执行顺序产生的事件 */
+using TraceLane = std::vector<TraceEvent>;
+
+/**
+ * @class TraceRing
+ * @brief 有界的单生产者单消费者无锁环形队列，引擎线程写入事件，分析线程读出事件
+ */
+class TraceRing {
+public:
+    /** @param capacity 容量，向上取整为2的幂 */
+    explicit TraceRing(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+    /**
+     * @brief 生产者取得下一个空槽位，队列满时等待消费者(back-pressure)
+     */
+    TraceEvent& claim() {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        while (h - cachedTail > mask) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h - cachedTail > mask) std::this_thread::yield();
+        }
+        return slots[h & mask];
+    }
+    /**
+     * @brief 生产者提交claim()取得的槽位
+     */
+    void publish() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    /**
+     * @brief 消费者读取队首事件
+     * @return 队列为空时返回nullptr
+     */
+    const TraceEvent* peek() {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t == cachedHead) return nullptr;
+        }
+        return &slots[t & mask];
+    }
+    /**
+     * @brief 消费者处理完队首事件后将其移出，槽位随即可被生产者复用
+     */
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    /**
+     * @brief 所有已提交的事件是否都已被消费
+     */
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+    std::size_t capacity() const {
+        return slots.size();
+    }
+
+private:
+    std::vector<TraceEvent> slots;
+    std::size_t mask;
+    /** 生产者写入的位置及其对tail的缓存 */
+    alignas(64) std::atomic<std::size_t> head{0};
+    std::size_t cachedTail = 0;
+    /** 消费者读取的位置及其对head的缓存 */
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::size_t cachedHead = 0;
+};
+
+/**
+ * @class TraceFilter
+ * @brief 限定需要跟踪的集合与规则，由--trace-filter或同名pragma给出，
+ * 如"path,t.dl:12"表示跟踪path的所有规则以及t.dl第12行的规则
+ */
+class TraceFilter {
+public:
+    explicit TraceFilter(const std::string& spec);
+    /**
+     * @brief 未给出过滤条件时跟踪所有内容
+     */
+    bool empty() const {
+        return relations.empty() && locations.empty();
+    }
+    /**
+     * @brief 判断规则是否需要跟踪
+     * @param rule DEBUG信息，形如"path(x,y) :- edge(x,y). in file t.dl [3:1-3:20]"
+     */
+    bool match_rule(const std::string& rule) const;
+    /**
+     * @brief 判断集合是否需要跟踪，@delta_与@new_开头的集合视为其对应的原集合
+     */
+    bool match_relation(const std::string& name) const;
+    /**
+     * @brief 增加需要跟踪的集合(如被选中规则的头部)，只影响match_relation
+     */
+    void include_relation(const std::string& name);
+    /**
+     * @return 规则头部的集合名
+     */
+    static std::string rule_head(const std::string& rule);
+
+private:
+    struct Location {
+        std::string file;
+        int line;
+    };
+    std::set<std::string> relations;
+    std::vector<Location> locations;
+    std::set<std::string> included;
+};
+
+/** 没有对应集合或规则时使用的id */
+constexpr uint32_t NO_ID = UINT32_MAX;
+
+/**
+ * @class TupleStore
+ * @brief 对tuple去重并分配id，tuple以未解码的RamDomain连续存放，相同内容的tuple只存一份
+ */
+class TupleStore {
+public:
+    TupleStore() : index(0, Hash{this}, Equal{this}) {}
+    TupleStore(const TupleStore&) = delete;
+    TupleStore& operator=(const TupleStore&) = delete;
+    /**
+     * @brief 返回tuple的id，首次出现时为其分配新id
+     */
+    uint32_t intern(const souffle::RamDomain* data, std::size_t arity);
+    const souffle::RamDomain* data(uint32_t id) const {
+        return values.data() + offsets[id];
+    }
+    std::size_t arity(uint32_t id) const {
+        return offsets[id + 1] - offsets[id];
+    }
+    std::size_t size() const {
+        return offsets.size() - 1;
+    }
+    /** tuple的值在所有值中的位置 */
+    std::size_t offset(uint32_t id) const {
+        return offsets[id];
+    }
+    /** 所有tuple的值 */
+    const std::vector<souffle::RamDomain>& all_values() const {
+        return values;
+    }
+
+private:
+    struct Hash {
+        const TupleStore* store;
+        std::size_t operator()(uint32_t id) const;
+    };
+    struct Equal {
+        const TupleStore* store;
+        bool operator()(uint32_t a, uint32_t b) const;
+    };
+    std::vector<souffle::RamDomain> values;
+    /** 第i个tuple位于values[offsets[i], offsets[i+1]) */
+    std::vector<std::size_t> offsets{0};
+    std::unordered_set<uint32_t, Hash, Equal> index;
+};
+
+/**
+ * @struct Premise
+ * @brief 推导的一个来源：集合relId中的tuple
+ */
+struct Premise {
+    uint32_t relId;
+    uint32_t tupleId;
+};
+
+/**
+ * @struct Derivation
+ * @brief 一次推导：规则ruleId由premise中的tuple推出了集合relId中的tuple
+ */
+struct Derivation {
+    uint32_t relId;
+    uint32_t tupleId;
+    /** 从文件读入或没有来源的tuple为NO_ID */
+    uint32_t ruleId;
+    /** 来源位于premise数组的[premiseBegin, premiseBegin + premiseCount) */
+    uint32_t premiseBegin;
+    uint32_t premiseCount;
+};
+
+/**
+ * @class ValueDecoder
+ * @brief 按属性的类型限定符(如"i:number")将值解码为文本。符号第一次出现时从符号表中取出，
+ * 之后直接使用本地缓存；数字、无符号数与浮点数直接格式化，记录通过记录表展开
+ */
+class ValueDecoder {
+public:
+    explicit ValueDecoder(souffle::SymbolTable* symbolTable) : symbolTable(symbolTable) {}
+    /**
+     * @brief 登记记录类型，之后该类型的值按字段展开
+     * @param type 记录的类型限定符，如"r:Pair"
+     * @param fields 各字段的类型限定符
+     */
+    void register_record(const std::string& type, const std::vector<std::string>& fields);
+    /**
+     * @brief 将值追加到out，类型为空时按符号解码
+     */
+    void append(std::string& out, souffle::RamDomain value, const std::string& type);
+    /**
+     * @return 编号为index的符号
+     */
+    const std::string& symbol(souffle::RamDomain index);
+    /**
+     * @return 类型能否解码，未登记的记录与ADT按编号输出
+     */
+    bool expands_record(const std::string& type) const {
+        return recordTable != nullptr && records.count(type) != 0;
+    }
+    /** 为nullptr时记录按编号输出 */
+    const souffle::RecordTableInterface* recordTable = nullptr;
+
+private:
+    souffle::SymbolTable* symbolTable;
+    /** 按编号索引的符号，尚未取出的为nullptr */
+    std::vector<const std::string*> symbols;
+    std::map<std::string, std::vector<std::string>> records;
+};
+
+/**
+ * @struct SpillChunk
+ * @brief 溢出文件中属于同一集合的一段连续推导
+ */
+struct SpillChunk {
+    uint64_t offset;
+    uint64_t size;
+};
+
 /**
  * @class set_data
- * @brief 用于存储souffle中集合的变化
+ * @brief 用于存储souffle中集合的变化，只保存tuple id，输出时才解码。
+ * 推导占用的内存超过上限时按集合依次写入溢出文件，每次写入为一段，输出时按原顺序读回
  */
 class set_data {
 public:
     set_data() = default;
+    ~set_data();
     /** @param target_set 目标集合
      * @param tuple 要添加的元素
+     * @param rule 推出该元素的规则
+     * @param premises 来源元素
      * @brief 将元素和来源细节添加到目标集合中
      * */
-    void insert_tuple(const std::string& target_set, const std::string& tuple, const std::string& detail);
+    void insert_tuple(uint32_t target_set, uint32_t tuple, uint32_t rule = NO_ID,
+            const Premise* premises = nullptr, std::size_t premise_count = 0);
     /**
      * @param source_set 源集合
      * @param target_set 目标集合
      * @brief 将源集合合并至目标集合中
      */
-    void merge_set(const std::string& source_set, const std::string& target_set);
+    void merge_set(uint32_t source_set, uint32_t target_set);
+    /**
+     * @return 内存中的推导占用的字节数
+     */
+    std::size_t memory_usage() const {
+        return derivations.size() * sizeof(Derivation) + premises.size() * sizeof(Premise) +
+               indexed * sizeof(uint32_t);
+    }
+    /**
+     * @brief 将内存中的推导按集合写入溢出文件的新一段，并释放这些推导
+     * @param path 溢出文件，第一次溢出时创建
+     * @return 写入的字节数
+     */
+    std::size_t spill(const std::string& path);
     /**
-     * @brief 展示集合的变化
+     * @brief 展示集合的变化，按集合名排序，跳过@开头的临时集合，溢出的推导排在内存中的推导之前
+     * @return 写出的字节数
      */
-    void show(std::ostream& os);
+    std::size_t show(std::ostream& os, const std::vector<std::string>& relation_names,
+            const std::vector<std::vector<std::string>>& relation_types, ValueDecoder& decoder) const;
     /**
-     * @brief 清空存储的所有集合
+     * @brief 清空存储的所有集合，tuple id保持不变
      */
     void clear();
+    /**
+     * @brief 关闭并删除溢出文件，之后再溢出时重新创建
+     */
+    void close_spill();
+    /** 所有出现过的tuple */
+    TupleStore tuples;
     friend class TupleDataAnalyzer;
 
 private:
+    /** @return 集合中的推导，按需创建 */
+    std::vector<uint32_t>& get_set(uint32_t relId);
     size_t counter = 0;
-    std::map<std::string, size_t> set_index;
-    std::vector<std::vector<std::string>> set;
-    std::vector<std::vector<std::string>> detail_data;
+    /** 按relId索引，存放derivations中的下标 */
+    std::vector<std::vector<uint32_t>> set;
+    /** 存放过元素的集合 */
+    std::vector<uint32_t> used_sets;
+    std::vector<bool> in_use;
+    std::vector<Derivation> derivations;
+    std::vector<Premise> premises;
+    /** 各集合中推导下标的总数 */
+    std::size_t indexed = 0;
+    /** 按relId索引的已溢出的段，按写入顺序排列 */
+    std::vector<std::vector<SpillChunk>> spilled;
+    std::fstream* spill_file = nullptr;
+    std::string spill_path;
+    /** 当前规则的推导在溢出文件中的末尾，清空后从头复用 */
+    uint64_t spill_end = 0;
 };
 /**
  * @class TupleScanManager
@@ -55,16 +426,18 @@ private:
 class TupleScanManager {
 public:
     explicit TupleScanManager(int depth) : max_loop_depth(depth) {
-        scan_result.resize(max_loop_depth + 1);
+        scan_result.resize(max_loop_depth + 1, {NO_ID, NO_ID});
         scan_flags.resize(max_loop_depth + 1);
     };
     /**
      * @brief 进入下一级循环，并设置flag(0 = normal,1 = check_existence)
+     * @param relId 该级循环扫描的集合
      */
-    void enter_loop(uint8_t flag) {
+    void enter_loop(uint8_t flag, uint32_t relId) {
         scan_flags[curr_loop_index] = flag;
         curr_loop_index += 1;
         assert(curr_loop_index <= max_loop_depth);
+        scan_result[curr_loop_index].relId = relId;
     }
     /**
      * @brief 在insert完毕后使用，返回flag = 0的循环
@@ -84,45 +457,158 @@ public:
         assert(curr_loop_index <= max_loop_depth);
     }
     /**
-     * @brief 读取当前正在扫描的tuple并进行存储
-     * @param tuple 当前正在扫描，且已被两种decode处理过的tuple
+     * @brief 记录当前循环正在扫描的tuple
+     * @param tuple 当前正在扫描，且已按order还原的tuple的id
      */
-    void scan_tuple(const std::string& tuple);
+    void scan_tuple(uint32_t tuple) {
+        scan_result[curr_loop_index].tupleId = tuple;
+    }
+    /**
+     * @brief 是否已进入最内层循环，否则当前的insert是对整个集合的合并
+     */
+    bool is_complete() const {
+        return curr_loop_index == max_loop_depth;
+    }
     /**
-     * @brief 获得当前正在扫描的tuple的集合
-     * @return 当前正在扫描的tuple的集合形成的详细信息
+     * @brief 获得各层循环正在扫描的tuple，即当前插入的tuple的来源
      */
-    std::string read_tuple();
+    const Premise* read_tuples() const {
+        return scan_result.data() + 1;
+    }
+    std::size_t tuple_count() const {
+        return max_loop_depth;
+    }
 
 private:
-    std::vector<std::string> scan_result;
+    std::vector<Premise> scan_result;
     std::vector<uint8_t> scan_flags;
     size_t curr_loop_index = 0;
     size_t max_loop_depth;
 };
 
 /**
- * @class InfoOrderManager
- * @brief 管理IndexScan中出现的view中tuple的order
+ * @class LiveSpectrum
+ * @brief 运行中的错误定位：推出的tuple一插入就与预期输出比较，并计入其证明中用到的规则。
+ * 与analyzer的spectrum一致，每个tuple只按最先推出它的推导计算
  */
-class InfoOrderManager {
+class LiveSpectrum {
 public:
-    InfoOrderManager() = default;
+    /** @param dir 存放预期输出<集合名>.csv的目录，csv中各值以'\t'分隔 */
+    explicit LiveSpectrum(const std::string& dir) : dir(dir) {}
     /**
-     * @brief 增加一种新的order
-     * @param viewId 视图id
-     * @param order 对应的order
+     * @brief 集合是否有预期输出，第一次询问时读入其csv文件
      */
-    void add_order(size_t viewId, std::vector<size_t>& order);
+    bool expects(uint32_t relId, const std::string& name);
     /**
-     * @brief 根据视图id返回对应的order
-     * @param viewId 视图id
-     * @return 对应的order
+     * @brief 登记tuple的推导，已推出过的tuple被忽略
+     * @param key tuple的(原集合, tuple id)
+     * @param premises 来源tuple的key，从文件读入的tuple不含规则
+     * @return 证明中用到的规则集合的id，tuple已推出过时返回NO_ID
      */
-    std::vector<size_t>& get_order(size_t viewId);
+    uint32_t derive(uint64_t key, uint32_t rule, const uint64_t* premises, std::size_t premise_count);
+    /**
+     * @brief 按预期输出判定新推出的tuple，并计入其证明中的规则
+     * @param text 以'\t'分隔的各值，与csv中的行相同
+     * @param rules derive()返回的规则集合
+     */
+    void judge(uint32_t relId, const std::string& text, uint32_t rules);
+    /**
+     * @brief 输出各规则当前的可疑度，按Ochiai从高到低排列，只含出现在证明中的规则
+     */
+    void report(std::ostream& os, uint32_t stratum, const std::vector<std::string>& rule_list) const;
+    /** 判定为正确与错误的tuple数 */
+    std::size_t p = 0;
+    std::size_t f = 0;
+    /** 按规则id索引，证明中用到该规则的正确与错误tuple数 */
+    std::vector<std::size_t> pr;
+    std::vector<std::size_t> fr;
 
 private:
-    std::map<size_t, std::vector<size_t>> order_map;
+    std::string dir;
+    /** 按relId索引的预期输出 */
+    std::vector<std::unordered_set<std::string>> expected;
+    /** 按relId索引，0为尚未读入，1为没有预期输出，2为已读入 */
+    std::vector<uint8_t> expected_state;
+    /** 以tuple的key为键的证明中用到的规则集合 */
+    std::unordered_map<uint64_t, uint32_t> tuple_rules;
+    /** 去重后的规则集合，集合中的规则id有序 */
+    std::vector<std::vector<uint32_t>> rule_sets;
+    std::map<std::vector<uint32_t>, uint32_t> rule_set_index;
+};
+
+/** 未给出--trace-progress时两次输出进度的间隔 */
+constexpr std::chrono::milliseconds DEFAULT_PROGRESS_INTERVAL{1000};
+
+/**
+ * @class TraceProgress
+ * @brief 运行进度。引擎与分析线程以relaxed原子量更新各项指标，不需要同步；
+ * 分析线程处理事件时按设定的间隔在标准错误上输出一行进度，没有单独的线程
+ */
+class TraceProgress {
+public:
+    /**
+     * @param interval 两次输出的最短间隔，为0时不输出
+     */
+    void set_interval(std::chrono::milliseconds interval) {
+        this->interval = interval;
+    }
+    void enter_stratum(uint32_t id) {
+        stratum.store(id, std::memory_order_relaxed);
+    }
+    void set_iteration(std::size_t number) {
+        iteration.store(number, std::memory_order_relaxed);
+    }
+    void enter_rule(uint32_t id) {
+        rule.store(id, std::memory_order_relaxed);
+    }
+    /** 只由分析线程调用 */
+    void add_tuple() {
+        tuples.store(tuples.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    void add_bytes(uint64_t count) {
+        bytes.store(bytes.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+    uint64_t tuple_count() const {
+        return tuples.load(std::memory_order_relaxed);
+    }
+    uint64_t byte_count() const {
+        return bytes.load(std::memory_order_relaxed);
+    }
+    /** 分析线程已处理的事件数，只应在分析结束后由其他线程读取 */
+    uint64_t event_count() const {
+        return events;
+    }
+    /**
+     * @brief 分析线程每处理一个事件调用一次，每CHECK_EVENTS个事件才读取一次时钟
+     * @param rule_list 按规则id索引的规则文本
+     */
+    void tick(const std::vector<std::string>& rule_list) {
+        if (++events % CHECK_EVENTS != 0 || interval.count() == 0) return;
+        const auto now = std::chrono::steady_clock::now();
+        if (now - last < interval) return;
+        render(rule_list, now);
+    }
+    /**
+     * @brief 输出最终的进度并换行，从未输出过或已经结束时什么也不做
+     */
+    void finish(const std::vector<std::string>& rule_list);
+
+private:
+    static constexpr uint64_t CHECK_EVENTS = 1 << 12;
+    void render(const std::vector<std::string>& rule_list, std::chrono::steady_clock::time_point now);
+    std::atomic<uint32_t> stratum{NO_ID};
+    std::atomic<uint32_t> rule{NO_ID};
+    std::atomic<std::size_t> iteration{0};
+    /** 插入的tuple数与写出的trace字节数 */
+    std::atomic<uint64_t> tuples{0};
+    std::atomic<uint64_t> bytes{0};
+    std::chrono::milliseconds interval{0};
+    uint64_t events = 0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    /** 上一次输出的时间与当时的tuple数 */
+    std::chrono::steady_clock::time_point last = start;
+    uint64_t last_tuples = 0;
+    bool rendered = false;
 };
 
 /**
@@ -131,41 +617,235 @@ private:
  */
 class TupleDataAnalyzer {
 public:
-    TupleDataAnalyzer(
-            const std::string& output_path, souffle::SymbolTable* symbolTable, bool is_debug = false);
+    /**
+     * @param output_path 输出文件，为空时以文本格式输出到标准输出
+     * @param format 输出格式
+     */
+    TupleDataAnalyzer(const std::string& output_path, souffle::SymbolTable* symbolTable, bool is_debug = false,
+            TraceFormat format = TraceFormat::Text);
     ~TupleDataAnalyzer();
     /**
-     * @brief 从输入流中读取一行，并进行解读
-     * @return 是否成功读取数据
+     * @brief 登记集合，之后的事件通过relId引用该集合
+     * @param relId 引擎中集合的编号
+     * @param name 集合名
+     * @param types 各属性的类型限定符，为空时所有属性都按符号解码
+     */
+    void register_relation(
+            std::size_t relId, const std::string& name, const std::vector<std::string>& types = {});
+    /**
+     * @brief 登记记录类型及记录表，输出时记录按字段展开
+     */
+    void register_record(const std::string& type, const std::vector<std::string>& fields);
+    void set_record_table(const souffle::RecordTableInterface* recordTable) {
+        decoder.recordTable = recordTable;
+    }
+    /**
+     * @brief 设置一条规则的推导在内存中最多占用的字节数，超过后文本格式写入溢出文件，Graph格式提前加入proof graph
+     */
+    void set_memory_budget(std::size_t bytes) {
+        memory_budget = bytes;
+    }
+    /**
+     * @brief 设置重复推导的记录方式，TraceDedup::Tuple由引擎完成，分析器照常处理收到的事件
+     */
+    void set_dedup(TraceDedup mode) {
+        dedup = mode;
+    }
+    /**
+     * @brief 开启运行中的错误定位：推出的tuple按dir中的预期输出判定，每个stratum结束时输出各规则的可疑度
+     * @param dir 存放预期输出<集合名>.csv的目录
+     * @param report 可疑度的输出位置
+     */
+    void set_expected_output(const std::string& dir, std::ostream& report = std::cerr);
+    /**
+     * @return 运行中的错误定位的计数，未开启时为nullptr
      */
-    bool parse();
-    void insert_from_file(int size, const int32_t* data);
-    TupleDataAnalyzer& operator<<(const std::string& s);
-    TupleDataAnalyzer& operator<<(std::ostream& (*manipulator)(std::ostream&));
-    TupleDataAnalyzer& operator<<(const int& s);
+    const LiveSpectrum* live_spectrum() const {
+        return spectrum;
+    }
+    /** 运行进度，引擎在进入stratum与循环迭代时更新 */
+    TraceProgress progress;
+    /**
+     * @brief 登记DEBUG标记的规则，相同的规则文本返回相同的id
+     * @return 规则id
+     */
+    uint32_t register_rule(const std::string& rule);
+    /**
+     * @brief 登记索引中tuple的order，相同的order返回相同的id；须在发送引用它的事件之前登记
+     * @return order id，由ScanEval与ScanIndex事件的viewId携带
+     */
+    uint32_t register_order(const std::vector<uint32_t>& order);
+    /**
+     * @brief 发送不带payload的事件
+     */
+    void emit(TraceOp op, std::size_t relId = 0, std::size_t viewId = 0);
+    /**
+     * @brief 发送携带tuple的事件
+     * @param data 未解码的tuple
+     * @param arity tuple长度
+     */
+    void emit(TraceOp op, std::size_t relId, std::size_t viewId, const souffle::RamDomain* data,
+            std::size_t arity);
+    void insert_from_file(std::size_t size, const souffle::RamDomain* data);
+    /**
+     * @brief 开始读入集合relId的文件，之后insert_from_file收到的tuple属于该集合
+     */
+    void begin_input(std::size_t relId);
+    /**
+     * @brief 文件读入结束，之后读入的tuple不再被跟踪
+     */
+    void end_input();
+    /**
+     * @brief 当前读入的文件是否需要跟踪
+     */
+    bool tracing_input() const {
+        return input_traced;
+    }
+    /**
+     * @brief 等待分析线程处理完所有已发送的事件并刷新输出，Graph格式下写出完整的proof graph；
+     * 分析线程随之结束，之后的事件同步解读，溢出文件被删除，最终的进度被输出
+     */
+    void flush();
+    /**
+     * @brief 在并行扫描开始前为每个分区准备一条lane
+     * @param count 分区数量
+     */
+    void begin_lanes(std::size_t count);
+    /**
+     * @brief 当前线程此后发送的事件写入指定分区的lane，而不是直接交给分析器
+     * @param index 分区编号
+     */
+    void enter_lane(std::size_t index);
+    /**
+     * @brief 当前线程恢复直接发送事件
+     */
+    void leave_lane();
+    /**
+     * @brief 在并行扫描结束后按分区顺序回放所有lane中的事件，结果与串行扫描一致
+     */
+    void merge_lanes();
+    /**
+     * @brief 将事件渲染为旧版的文本格式，如"SCAN_INDEX 3 (1,2) "
+     */
+    std::string render(const TraceEvent& event) const;
 
 private:
-    std::string decodeTupleWithAssignedData(std::string tuple);
-    std::string decodeTupleWithAssignedData(std::vector<size_t>& tuple);
-    void decodeTupleByOrder(std::vector<size_t>& tuple, std::vector<size_t>& order);
-    std::string curr_insertSet;
-    std::string curr_scanSet;
-    std::ostream* os;
-    std::vector<std::size_t> curr_order;
-    std::stringstream tuple_data;
+    /**
+     * @brief 取得用于填写事件的槽位，异步模式下直接位于环形队列中
+     */
+    TraceEvent& acquire();
+    /**
+     * @brief 提交acquire()取得的事件
+     */
+    void submit();
+    /**
+     * @brief 分析线程的主循环，从环形队列中取出事件并解读
+     */
+    void drain();
+    /**
+     * @brief 处理完队列中的事件后结束分析线程并释放队列，同步模式下什么也不做
+     */
+    void stop_consumer();
+    /**
+     * @brief 解读一个事件
+     */
+    void consume(const TraceEvent& event);
+    /**
+     * @brief 按order还原tuple的原始顺序并登记
+     * @return tuple id
+     */
+    uint32_t internByOrder(const TraceEvent& event, const std::vector<uint32_t>& order);
+    /**
+     * @brief 规则应用或输出结束时，输出并清空set中积累的推导
+     */
+    void commit_set();
+    /**
+     * @brief 将set中的推导加入proof graph
+     */
+    void record_graph();
+    /**
+     * @return proof graph中集合relId的tuple的id，@delta_与@new_开头的集合视为其对应的原集合
+     */
+    uint32_t graph_tuple(uint32_t relId, uint32_t tupleId);
+    /**
+     * @return 集合对应的原集合
+     */
+    uint32_t base_relation(uint32_t relId);
+    void write_graph();
+    /**
+     * @brief 推导占用的内存超过上限时将其移出内存
+     */
+    void check_memory();
+    /**
+     * @brief 按TraceDedup::Rule判断当前规则是否第一次推出该tuple，其他方式下总是返回true
+     */
+    bool first_derivation(uint32_t tuple);
+    /**
+     * @brief 将当前规则推出的tuple计入运行中的错误定位
+     */
+    void score(uint32_t tuple);
+    std::size_t memory_budget = DEFAULT_TRACE_MEMORY;
+    TraceDedup dedup = TraceDedup::None;
+    /** TraceDedup::Rule下按规则id索引，已记录过的tuple的(原集合, tuple id) */
+    std::vector<std::unordered_set<uint64_t>> rule_derived;
+    /** 文本输出文件的缓冲区 */
+    std::vector<char> output_buffer;
+    /** 按relId索引的集合名与属性类型 */
+    std::vector<std::string> relation_names;
+    std::vector<std::vector<std::string>> relation_types;
+    /** 按规则id索引的规则文本及其循环深度 */
+    std::vector<std::string> rule_list;
+    std::vector<int> rule_depth;
+    std::map<std::string, uint32_t> rule_index;
+    uint32_t curr_insertSet = NO_ID;
+    uint32_t curr_scanSet = NO_ID;
+    uint32_t curr_rule = NO_ID;
+    /** 文本格式的输出，Graph格式下为nullptr */
+    std::ostream* os = nullptr;
+    std::string output_path;
+    /** Graph格式下积累的proof graph，文本格式下为nullptr */
+    proof_graph::ProofGraphWriter* graph = nullptr;
+    /** 以(原集合, tuple id)为键的proof graph中的tuple */
+    std::unordered_map<uint64_t, uint32_t> graph_tuples;
+    std::vector<uint32_t> base_relations;
+    /** 按relId索引的集合标记(proof_graph::RelationFlag) */
+    std::vector<uint32_t> relation_flags;
+    /** 按order id索引的order */
+    std::vector<std::vector<uint32_t>> orders;
+    std::map<std::vector<uint32_t>, uint32_t> order_index;
     set_data set;
+    /** 运行中的错误定位，未开启时为nullptr */
+    LiveSpectrum* spectrum = nullptr;
+    std::ostream* spectrum_os = nullptr;
+    /** score()中来源tuple的key */
+    std::vector<uint64_t> premise_keys;
     TupleScanManager* scan_manager = nullptr;
-    InfoOrderManager* order_manager = nullptr;
     souffle::SymbolTable* symbolTable = nullptr;
-    std::thread* worker = nullptr;
-    std::atomic<bool> running = true;
+    ValueDecoder decoder;
+    /** 异步模式下的事件队列与分析线程，同步模式下为nullptr */
+    TraceRing* ring = nullptr;
+    std::thread* consumer = nullptr;
+    std::atomic<bool> consuming = true;
+    /** 同步模式下暂存正在填写的事件 */
+    TraceEvent pending;
+    /** 并行扫描中按分区存放的事件 */
+    std::vector<TraceLane> lanes;
     bool is_relation = false;
     bool is_skip_loop = false;
+    bool input_traced = false;
     bool is_debug = false;
 };
 
 extern TupleDataAnalyzer *analyzer;
 
+/**
+ * @brief 将编译后的程序写出的事件流(见TraceStream.h)交给分析器回放，得到与解释器相同的输出
+ * @param stream_path 事件流文件
+ * @param output_path 分析结果的输出文件
+ * @return 事件流无效时返回false
+ */
+bool replay_trace_stream(const std::string& stream_path, const std::string& output_path, TraceFormat format);
+
 }  // namespace modified_souffle
 
 
@@ -0,0 +1,496 @@
+/**
+ * @file ProofGraph.h
+ * proof graph的二进制文件格式，由引擎中的TupleDataAnalyzer写入，analyzer直接映射读取
+ *
+ * 文件由定长的Header和若干段组成，每段从8字节对齐处开始，整数按本机字节序存放：
+ *   symbol段      第i个符号位于symbolData的[symbolOffsets[i], symbolOffsets[i + 1])
+ *   name段        集合名、集合的属性类型与规则文本
+ *   relation段    集合表
+ *   rule段        规则表
+ *   tuple段       每个tuple所在的集合、值的位置以及推导出它的记录的范围
+ *   value段       tuple的值，统一存为int64，按所在集合的属性类型解码(见ValueKind)
+ *   derivation段  按tuple排序的推导记录，同一tuple的推导保持发生的顺序
+ *   edge段        推导的来源tuple
+ * 本文件只依赖标准库，以便独立构建的analyzer共用
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace modified_souffle {
+namespace proof_graph {
+
+constexpr char MAGIC[8] = {'S', 'O', 'U', 'F', 'F', 'L', 'P', 'G'};
+/** 格式发生不兼容的变化时递增 */
+constexpr uint32_t VERSION = 2;
+/** 没有对应规则(从文件读入的tuple)或集合时使用的id */
+constexpr uint32_t NONE = UINT32_MAX;
+
+/** 集合的标记 */
+enum RelationFlag : uint32_t {
+    INPUT = 1,
+    OUTPUT = 2,
+};
+
+/** 属性值的解码方式，集合的每个属性占一个字符 */
+enum ValueKind : char {
+    SYMBOL = 's',
+    NUMBER = 'i',
+    UNSIGNED = 'u',
+    FLOAT = 'f',
+};
+
+/**
+ * @brief 由类型限定符(如"i:number")得到解码方式，记录与ADT按其引用的编号输出
+ */
+inline char value_kind(const std::string& qualifier) {
+    if (!qualifier.empty()) {
+        switch (qualifier[0]) {
+            case SYMBOL:
+            case UNSIGNED:
+            case FLOAT: return qualifier[0];
+            default: break;
+        }
+    }
+    return NUMBER;
+}
+
+struct Section {
+    uint64_t offset;
+    /** 元素个数，字符数据为字节数 */
+    uint64_t count;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    /** 写入前值的位数，UNSIGNED与FLOAT按此宽度还原 */
+    uint32_t domainBits;
+    uint32_t reserved;
+    Section symbolOffsets;
+    Section symbolData;
+    Section names;
+    Section relations;
+    Section rules;
+    Section tuples;
+    Section values;
+    Section derivations;
+    Section edges;
+};
+
+struct RelationEntry {
+    uint64_t nameOffset;
+    /** 每个属性的ValueKind，位于name段，为空时所有属性都按符号解码 */
+    uint64_t typesOffset;
+    uint32_t nameLength;
+    uint32_t typesLength;
+    uint32_t arity;
+    uint32_t flags;
+};
+
+struct RuleEntry {
+    uint64_t textOffset;
+    uint32_t textLength;
+    /** 规则头部的集合 */
+    uint32_t head;
+};
+
+struct TupleEntry {
+    uint64_t valueOffset;
+    uint32_t relation;
+    uint32_t arity;
+    /** 推导出该tuple的记录位于[firstDerivation, firstDerivation + derivationCount)，为0时是输入的tuple */
+    uint32_t firstDerivation;
+    uint32_t derivationCount;
+};
+
+struct DerivationEntry {
+    uint64_t edgeOffset;
+    uint32_t tuple;
+    uint32_t rule;
+    uint32_t edgeCount;
+    uint32_t reserved;
+};
+
+/**
+ * @class ProofGraphWriter
+ * @brief 积累proof graph的内容并写出，tuple的值由调用者在写出时统一给出
+ */
+class ProofGraphWriter {
+public:
+    /**
+     * @brief 增加集合，集合id按增加的顺序分配
+     * @param types 每个属性的ValueKind
+     */
+    uint32_t add_relation(const std::string& name, uint32_t flags = 0, const std::string& types = "") {
+        const uint64_t nameOffset = add_name(name);
+        const uint64_t typesOffset = add_name(types);
+        relations.push_back({nameOffset, typesOffset, static_cast<uint32_t>(name.size()),
+                static_cast<uint32_t>(types.size()), 0, flags});
+        return static_cast<uint32_t>(relations.size() - 1);
+    }
+    void set_flags(uint32_t relation, uint32_t flags) {
+        relations[relation].flags |= flags;
+    }
+    /**
+     * @brief 增加规则，规则id按增加的顺序分配
+     * @param head 规则头部的集合，未知时为NONE
+     */
+    uint32_t add_rule(const std::string& text, uint32_t head) {
+        rules.push_back({add_name(text), static_cast<uint32_t>(text.size()), head});
+        return static_cast<uint32_t>(rules.size() - 1);
+    }
+    /**
+     * @brief 增加符号，值为i的属性解码为第i个符号
+     */
+    void add_symbol(const char* symbol, std::size_t length) {
+        symbolData.insert(symbolData.end(), symbol, symbol + length);
+        symbolOffsets.push_back(symbolData.size());
+    }
+    /**
+     * @brief 增加tuple，集合可以在写出前再增加
+     * @param valueOffset 值在write()给出的数组中的位置
+     * @return tuple id
+     */
+    uint32_t add_tuple(uint32_t relation, uint64_t valueOffset, uint32_t arity) {
+        tuples.push_back({valueOffset, relation, arity, 0, 0});
+        return static_cast<uint32_t>(tuples.size() - 1);
+    }
+    /**
+     * @brief 改变tuple的值在write()给出的数组中的位置
+     */
+    void move_tuple(uint32_t tuple, uint64_t valueOffset) {
+        tuples[tuple].valueOffset = valueOffset;
+    }
+    /**
+     * @brief 记录一次推导：规则rule由premises中的tuple推出了tuple
+     */
+    void add_derivation(uint32_t tuple, uint32_t rule, const uint32_t* premises, uint32_t count) {
+        derivations.push_back({edges.size(), tuple, rule, count, 0});
+        edges.insert(edges.end(), premises, premises + count);
+        tuples[tuple].derivationCount++;
+    }
+    std::size_t tuple_count() const {
+        return tuples.size();
+    }
+    std::size_t derivation_count() const {
+        return derivations.size();
+    }
+    /**
+     * @brief 清空符号、集合与规则，保留tuple与推导，用于重新给出这些表后再次写出
+     */
+    void clear_tables() {
+        symbolOffsets.assign(1, 0);
+        symbolData.clear();
+        names.clear();
+        relations.clear();
+        rules.clear();
+    }
+    /**
+     * @brief 写出完整的文件
+     * @param values 所有tuple的值
+     */
+    template <typename T>
+    void write(std::ostream& os, const T* values, std::size_t valueCount) {
+        Header header{};
+        std::copy(MAGIC, MAGIC + sizeof(MAGIC), header.magic);
+        header.version = VERSION;
+        header.headerSize = sizeof(Header);
+        header.domainBits = sizeof(T) * 8;
+        std::size_t position = 0;
+        auto put = [&](const void* data, std::size_t bytes) {
+            os.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+            position += bytes;
+        };
+        auto align = [&]() {
+            static const char zeros[8] = {};
+            put(zeros, (8 - position % 8) % 8);
+        };
+        // 各段依次排在文件头之后，先计算位置再写出
+        auto layout = [&](Section& section, uint64_t count, std::size_t width, uint64_t& end) {
+            section = {end, count};
+            end += (count * width + 7) / 8 * 8;
+        };
+        uint64_t end = sizeof(Header);
+        layout(header.symbolOffsets, symbolOffsets.size(), sizeof(uint64_t), end);
+        layout(header.symbolData, symbolData.size(), 1, end);
+        layout(header.names, names.size(), 1, end);
+        layout(header.relations, relations.size(), sizeof(RelationEntry), end);
+        layout(header.rules, rules.size(), sizeof(RuleEntry), end);
+        layout(header.tuples, tuples.size(), sizeof(TupleEntry), end);
+        layout(header.values, valueCount, sizeof(int64_t), end);
+        layout(header.derivations, derivations.size(), sizeof(DerivationEntry), end);
+        layout(header.edges, edges.size(), sizeof(uint32_t), end);
+
+        // 推导按tuple稳定排序，每个tuple的推导连续存放
+        std::vector<uint32_t> order(derivations.size());
+        uint32_t first = 0;
+        for (auto& tuple : tuples) {
+            if (tuple.relation < relations.size()) relations[tuple.relation].arity = tuple.arity;
+            tuple.firstDerivation = first;
+            first += tuple.derivationCount;
+        }
+        {
+            std::vector<uint32_t> next(tuples.size());
+            for (std::size_t i = 0; i < tuples.size(); ++i) next[i] = tuples[i].firstDerivation;
+            for (uint32_t i = 0; i < derivations.size(); ++i) order[next[derivations[i].tuple]++] = i;
+        }
+
+        put(&header, sizeof(header));
+        put(symbolOffsets.data(), symbolOffsets.size() * sizeof(uint64_t));
+        align();
+        put(symbolData.data(), symbolData.size());
+        align();
+        put(names.data(), names.size());
+        align();
+        put(relations.data(), relations.size() * sizeof(RelationEntry));
+        put(rules.data(), rules.size() * sizeof(RuleEntry));
+        put(tuples.data(), tuples.size() * sizeof(TupleEntry));
+        for (std::size_t i = 0; i < valueCount; ++i) {
+            const int64_t value = values[i];
+            put(&value, sizeof(value));
+        }
+        uint64_t edgeOffset = 0;
+        for (uint32_t index : order) {
+            DerivationEntry entry = derivations[index];
+            entry.edgeOffset = edgeOffset;
+            edgeOffset += entry.edgeCount;
+            put(&entry, sizeof(entry));
+        }
+        for (uint32_t index : order) {
+            const DerivationEntry& entry = derivations[index];
+            put(edges.data() + entry.edgeOffset, entry.edgeCount * sizeof(uint32_t));
+        }
+        align();
+        os.flush();
+    }
+
+private:
+    uint64_t add_name(const std::string& name) {
+        const uint64_t offset = names.size();
+        names.insert(names.end(), name.begin(), name.end());
+        return offset;
+    }
+    std::vector<uint64_t> symbolOffsets{0};
+    std::vector<char> symbolData;
+    std::vector<char> names;
+    std::vector<RelationEntry> relations;
+    std::vector<RuleEntry> rules;
+    std::vector<TupleEntry> tuples;
+    std::vector<DerivationEntry> derivations;
+    std::vector<uint32_t> edges;
+};
+
+/**
+ * @class ProofGraph
+ * @brief 只读的proof graph，各段直接指向映射的文件，不做任何复制
+ */
+class ProofGraph {
+public:
+    ProofGraph() = default;
+    ProofGraph(const ProofGraph&) = delete;
+    ProofGraph& operator=(const ProofGraph&) = delete;
+    ~ProofGraph() {
+        release();
+    }
+    /**
+     * @brief 判断文件是否为proof graph
+     */
+    static bool is_proof_graph(const std::string& path) {
+        char magic[sizeof(MAGIC)] = {};
+        std::ifstream is(path, std::ios::binary);
+        is.read(magic, sizeof(magic));
+        return is && std::equal(magic, magic + sizeof(magic), MAGIC);
+    }
+    /**
+     * @brief 映射文件
+     * @return 文件不存在、不是proof graph或版本不符时返回false
+     */
+    bool open(const std::string& path) {
+        release();
+#ifdef _WIN32
+        std::ifstream is(path, std::ios::binary);
+        if (!is) return false;
+        std::vector<char> content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        return assign(content.data(), content.size());
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return false;
+        mapping = mapped;
+        mappingSize = st.st_size;
+        return attach(static_cast<const char*>(mapped), mappingSize);
+#endif
+    }
+    /**
+     * @brief 使用内存中的数据，数据会被复制一次
+     */
+    bool assign(const char* data, std::size_t size) {
+        release();
+        buffer.resize((size + 7) / 8);
+        std::memcpy(buffer.data(), data, size);
+        return attach(reinterpret_cast<const char*>(buffer.data()), size);
+    }
+
+    std::size_t relation_count() const {
+        return header->relations.count;
+    }
+    std::size_t rule_count() const {
+        return header->rules.count;
+    }
+    std::size_t tuple_count() const {
+        return header->tuples.count;
+    }
+    std::size_t derivation_count() const {
+        return header->derivations.count;
+    }
+    std::size_t symbol_count() const {
+        return header->symbolOffsets.count - 1;
+    }
+    const RelationEntry& relation(uint32_t id) const {
+        return section<RelationEntry>(header->relations)[id];
+    }
+    const RuleEntry& rule(uint32_t id) const {
+        return section<RuleEntry>(header->rules)[id];
+    }
+    const TupleEntry& tuple(uint32_t id) const {
+        return section<TupleEntry>(header->tuples)[id];
+    }
+    const DerivationEntry& derivation(uint32_t id) const {
+        return section<DerivationEntry>(header->derivations)[id];
+    }
+    const int64_t* values(uint32_t tuple) const {
+        return section<int64_t>(header->values) + this->tuple(tuple).valueOffset;
+    }
+    /**
+     * @return 推导的来源tuple
+     */
+    const uint32_t* premises(uint32_t derivation) const {
+        return section<uint32_t>(header->edges) + this->derivation(derivation).edgeOffset;
+    }
+    std::string relation_name(uint32_t id) const {
+        return std::string(section<char>(header->names) + relation(id).nameOffset, relation(id).nameLength);
+    }
+    std::string rule_text(uint32_t id) const {
+        return std::string(section<char>(header->names) + rule(id).textOffset, rule(id).textLength);
+    }
+    /**
+     * @return 集合第attribute个属性的ValueKind
+     */
+    char value_kind(uint32_t relation, uint32_t attribute) const {
+        const RelationEntry& entry = this->relation(relation);
+        if (attribute >= entry.typesLength) return SYMBOL;
+        return section<char>(header->names)[entry.typesOffset + attribute];
+    }
+    /**
+     * @brief 按kind解码值并追加到out，不在符号表中的符号按数字输出
+     */
+    void append_value(std::string& out, int64_t value, char kind = SYMBOL) const {
+        const bool wide = header->domainBits == 64;
+        switch (kind) {
+            case NUMBER: out += std::to_string(value); return;
+            case UNSIGNED:
+                out += wide ? std::to_string(static_cast<uint64_t>(value))
+                            : std::to_string(static_cast<uint32_t>(value));
+                return;
+            case FLOAT: {
+                std::ostringstream os;
+                if (wide) {
+                    double number;
+                    std::memcpy(&number, &value, sizeof(number));
+                    os << number;
+                } else {
+                    const auto bits = static_cast<uint32_t>(value);
+                    float number;
+                    std::memcpy(&number, &bits, sizeof(number));
+                    os << number;
+                }
+                out += os.str();
+                return;
+            }
+            default: break;
+        }
+        if (value < 0 || static_cast<uint64_t>(value) >= symbol_count()) {
+            out += std::to_string(value);
+            return;
+        }
+        const uint64_t* offsets = section<uint64_t>(header->symbolOffsets);
+        out.append(section<char>(header->symbolData) + offsets[value], offsets[value + 1] - offsets[value]);
+    }
+    /**
+     * @brief 解码tuple，形如"(a,b)"
+     */
+    std::string render_tuple(uint32_t id) const {
+        std::string out = "(";
+        const int64_t* data = values(id);
+        const TupleEntry& entry = tuple(id);
+        for (uint32_t i = 0; i < entry.arity; ++i) {
+            if (i != 0) out += ",";
+            append_value(out, data[i], value_kind(entry.relation, i));
+        }
+        return out + ")";
+    }
+
+private:
+    template <typename T>
+    const T* section(const Section& s) const {
+        return reinterpret_cast<const T*>(base + s.offset);
+    }
+    bool attach(const char* data, std::size_t size) {
+        if (size < sizeof(Header)) return false;
+        header = reinterpret_cast<const Header*>(data);
+        base = data;
+        if (!std::equal(header->magic, header->magic + sizeof(MAGIC), MAGIC) || header->version != VERSION) {
+            return false;
+        }
+        auto fits = [&](const Section& s, std::size_t width) {
+            return s.offset % 8 == 0 && s.offset <= size && s.count <= (size - s.offset) / width;
+        };
+        return header->symbolOffsets.count >= 1 && fits(header->symbolOffsets, sizeof(uint64_t)) &&
+               fits(header->symbolData, 1) && fits(header->names, 1) &&
+               fits(header->relations, sizeof(RelationEntry)) && fits(header->rules, sizeof(RuleEntry)) &&
+               fits(header->tuples, sizeof(TupleEntry)) && fits(header->values, sizeof(int64_t)) &&
+               fits(header->derivations, sizeof(DerivationEntry)) && fits(header->edges, sizeof(uint32_t));
+    }
+    void release() {
+#ifndef _WIN32
+        if (mapping != nullptr) munmap(mapping, mappingSize);
+#endif
+        mapping = nullptr;
+        mappingSize = 0;
+        buffer.clear();
+        header = nullptr;
+        base = nullptr;
+    }
+    const Header* header = nullptr;
+    const char* base = nullptr;
+    void* mapping = nullptr;
+    std::size_t mappingSize = 0;
+    /** assign()时数据的副本，按8字节对齐 */
+    std::vector<uint64_t> buffer;
+};
+
+}  // namespace proof_graph
+}  // namespace modified_souffle
@@ -0,0 +1,64 @@
+/**
+ * @file Suspiciousness.h
+ * 基于谱的错误定位中规则可疑度的计算公式，由引擎运行中的评分与analyzer共用；
+ * 本文件只依赖标准库，以便独立构建的analyzer使用
+ */
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace modified_souffle {
+
+/** 规则可疑度的计算公式 */
+enum class Formula {
+    Op,
+    Ochiai,
+    Tarantula,
+    DStar,
+};
+
+/** 依次输出的全部公式 */
+constexpr Formula FORMULAS[] = {Formula::Op, Formula::Ochiai, Formula::Tarantula, Formula::DStar};
+
+/** 公式名，用于输出 */
+inline const char* formulaName(Formula formula) {
+    switch (formula) {
+        case Formula::Op: return "Op";
+        case Formula::Ochiai: return "Ochiai";
+        case Formula::Tarantula: return "Tarantula";
+        case Formula::DStar: return "DStar";
+    }
+    return "";
+}
+
+/**
+ * 根据规则的pr/fr以及正确、错误输出tuple的总数计算可疑度
+ * @param pr 证明中用到该规则的正确tuple数
+ * @param fr 证明中用到该规则的错误tuple数
+ * @param p 正确的输出tuple数
+ * @param f 错误的输出tuple数
+ */
+inline double suspiciousness(Formula formula, std::size_t pr, std::size_t fr, std::size_t p, std::size_t f) {
+    const double ep = static_cast<double>(pr);
+    const double ef = static_cast<double>(fr);
+    switch (formula) {
+        case Formula::Op: return ef - ep / (p + 1.0);
+        case Formula::Ochiai: return ef == 0 ? 0 : ef / std::sqrt(f * (ef + ep));
+        case Formula::Tarantula: {
+            if (ef == 0) return 0;
+            const double failed = ef / f;
+            const double passed = p == 0 ? 0 : ep / p;
+            return failed / (failed + passed);
+        }
+        case Formula::DStar: {
+            // D*，*取2
+            const double denominator = ep + (f - ef);
+            if (denominator == 0) return ef == 0 ? 0 : std::numeric_limits<double>::infinity();
+            return ef * ef / denominator;
+        }
+    }
+    return 0;
+}
+
+}  // namespace modified_souffle
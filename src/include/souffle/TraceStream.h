@@ -0,0 +1,311 @@
+/**
+ * @file TraceStream.h
+ * 编译后的程序写出的二进制事件流，之后交给TupleDataAnalyzer回放，得到与解释器相同的分析结果
+ *
+ * 文件以magic与版本号开头，之后是一串记录，每条记录以1字节的tag开头：
+ *   tag < RELATION  事件，tag为TraceOp，之后是relId(u32)、arity(u8)与arity个RamDomain
+ *   RELATION/RULE   集合或规则的登记，之后是id(u32)、长度(u32)与文本
+ *   INPUT           开始读入集合relId(u32)的文件，之后的InputTuple属于该集合
+ *   TYPES           集合各属性的类型限定符，格式同RELATION，文本以','分隔
+ *   END             事件结束，之后是符号表：符号数(u32)，每个符号为编号(u32)、长度(u32)与文本
+ * 文件的最后8字节为END记录的位置，回放时先读出符号表再按顺序解读事件。
+ * 编译后的程序中tuple总是按属性的原始顺序存放，事件中的tuple不需要order
+ */
+#pragma once
+#include "souffle/Modify.h"
+#include "souffle/RamTypes.h"
+#include "souffle/SymbolTable.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace modified_souffle {
+namespace trace_stream {
+
+constexpr char MAGIC[8] = {'S', 'O', 'U', 'F', 'F', 'L', 'T', 'S'};
+/** 格式发生不兼容的变化时递增 */
+constexpr uint32_t VERSION = 3;
+
+/** 事件以外的记录，取值大于所有TraceOp */
+enum Record : uint8_t {
+    RELATION = 0x80,
+    RULE,
+    INPUT,
+    END,
+    TYPES,
+};
+
+/** 写出前在内存中积累的字节数 */
+constexpr std::size_t BUFFER_SIZE = 1 << 20;
+
+/**
+ * @class TraceStreamWriter
+ * @brief 生成的代码通过它记录事件，事件先写入内存中的缓冲区，缓冲区满时整块写出；
+ * 未调用open()时所有记录都被忽略，嵌入使用的程序不受影响
+ */
+class TraceStreamWriter {
+public:
+    TraceStreamWriter() = default;
+    TraceStreamWriter(const TraceStreamWriter&) = delete;
+    TraceStreamWriter& operator=(const TraceStreamWriter&) = delete;
+
+    /**
+     * @param relations 按relId索引的集合名
+     * @param rules 按规则id索引的规则文本
+     * @param types 按relId索引的各属性的类型限定符，缺少时回放按符号解码
+     * @return 文件无法创建时返回false
+     */
+    bool open(const std::string& path, const std::vector<std::string>& relations,
+            const std::vector<std::string>& rules, const std::vector<std::vector<std::string>>& types = {}) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        buffer.reserve(BUFFER_SIZE);
+        put(MAGIC, sizeof(MAGIC));
+        put_u32(VERSION);
+        for (std::size_t i = 0; i < relations.size(); ++i) {
+            put_text(RELATION, static_cast<uint32_t>(i), relations[i]);
+            if (i < types.size()) {
+                std::string text;
+                for (const std::string& type : types[i]) {
+                    if (!text.empty()) text += ',';
+                    text += type;
+                }
+                put_text(TYPES, static_cast<uint32_t>(i), text);
+            }
+        }
+        for (std::size_t i = 0; i < rules.size(); ++i) {
+            put_text(RULE, static_cast<uint32_t>(i), rules[i]);
+        }
+        active = true;
+        return true;
+    }
+    bool is_open() const {
+        return active;
+    }
+
+    /**
+     * @brief 记录不带tuple的事件
+     */
+    void emit(TraceOp op, uint32_t relId = 0) {
+        if (!active) return;
+        put_event(op, relId, 0);
+    }
+    /**
+     * @brief 记录携带tuple的事件
+     */
+    void emit(TraceOp op, uint32_t relId, const souffle::RamDomain* data, std::size_t arity) {
+        if (!active) return;
+        assert(arity <= MAX_TRACE_ARITY && "tuple超出事件容量");
+        put_event(op, relId, static_cast<uint8_t>(arity));
+        put(data, arity * sizeof(souffle::RamDomain));
+    }
+    /**
+     * @brief 向集合relId插入tuple
+     */
+    void insert(uint32_t relId, const souffle::RamDomain* data, std::size_t arity) {
+        if (!active) return;
+        emit(TraceOp::InsertTarget, relId);
+        emit(TraceOp::Insert, 0, data, arity);
+    }
+    /**
+     * @brief 文件读入后逐个记录集合中的tuple
+     */
+    template <typename Rel>
+    void input(uint32_t relId, const Rel& rel, std::size_t arity) {
+        if (!active) return;
+        put_u8(INPUT);
+        put_u32(relId);
+        for (const auto& tuple : rel) {
+            emit(TraceOp::InputTuple, 0, tuple.data(), arity);
+        }
+    }
+
+    /**
+     * @brief 在并行循环开始前为每个分区准备一条lane
+     */
+    void begin_lanes(std::size_t count) {
+        if (!active) return;
+        lanes.assign(count, {});
+    }
+    /**
+     * @brief 当前线程此后的记录写入指定分区的lane
+     */
+    void enter_lane(std::size_t index) {
+        if (!active) return;
+        current_lane() = &lanes[index];
+    }
+    void leave_lane() {
+        current_lane() = nullptr;
+    }
+    /**
+     * @brief 并行循环结束后按分区顺序拼接各lane，结果与串行执行一致
+     */
+    void merge_lanes() {
+        if (!active) return;
+        for (const auto& lane : lanes) {
+            put(lane.data(), lane.size());
+        }
+        lanes.clear();
+    }
+
+    /**
+     * @brief 写出符号表并关闭文件
+     */
+    void close(const souffle::SymbolTable& symbolTable) {
+        if (!active) return;
+        const uint64_t end = written + buffer.size();
+        put_u8(END);
+        uint32_t count = 0;
+        for (auto it = symbolTable.begin(); it != symbolTable.end(); ++it) {
+            count++;
+        }
+        put_u32(count);
+        for (const auto& symbol : symbolTable) {
+            put_u32(static_cast<uint32_t>(symbol.second));
+            put_u32(static_cast<uint32_t>(symbol.first.size()));
+            put(symbol.first.data(), symbol.first.size());
+        }
+        put(&end, sizeof(end));
+        flush();
+        file.close();
+        active = false;
+    }
+
+private:
+    static std::vector<char>*& current_lane() {
+        static thread_local std::vector<char>* lane = nullptr;
+        return lane;
+    }
+    void put(const void* data, std::size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        std::vector<char>* lane = current_lane();
+        if (lane != nullptr) {
+            lane->insert(lane->end(), bytes, bytes + size);
+            return;
+        }
+        buffer.insert(buffer.end(), bytes, bytes + size);
+        if (buffer.size() >= BUFFER_SIZE) flush();
+    }
+    void put_u8(uint8_t value) {
+        put(&value, sizeof(value));
+    }
+    void put_u32(uint32_t value) {
+        put(&value, sizeof(value));
+    }
+    void put_event(TraceOp op, uint32_t relId, uint8_t arity) {
+        char record[6];
+        record[0] = static_cast<char>(op);
+        std::memcpy(record + 1, &relId, sizeof(relId));
+        record[5] = static_cast<char>(arity);
+        put(record, sizeof(record));
+    }
+    void put_text(uint8_t tag, uint32_t id, const std::string& text) {
+        put_u8(tag);
+        put_u32(id);
+        put_u32(static_cast<uint32_t>(text.size()));
+        put(text.data(), text.size());
+    }
+    void flush() {
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        written += buffer.size();
+        buffer.clear();
+    }
+
+    std::ofstream file;
+    std::vector<char> buffer;
+    /** 已写入文件的字节数 */
+    uint64_t written = 0;
+    std::vector<std::vector<char>> lanes;
+    bool active = false;
+};
+
+/**
+ * @class TraceStreamReader
+ * @brief 按块读入事件流，依次给出其中的记录
+ */
+class TraceStreamReader {
+public:
+    /**
+     * @brief 打开事件流并读出其中的符号表
+     * @return 不是事件流或文件不完整时返回false
+     */
+    bool open(const std::string& path) {
+        chunk.resize(BUFFER_SIZE);
+        file.rdbuf()->pubsetbuf(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        file.open(path, std::ios::binary);
+        if (!file) return false;
+        char magic[sizeof(MAGIC)];
+        uint32_t version = 0;
+        if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+        if (!file.read(reinterpret_cast<char*>(&version), sizeof(version)) || version != VERSION) return false;
+        const std::streamoff begin = file.tellg();
+
+        uint64_t end = 0;
+        file.seekg(-static_cast<std::streamoff>(sizeof(end)), std::ios::end);
+        if (!file.read(reinterpret_cast<char*>(&end), sizeof(end))) return false;
+        file.seekg(static_cast<std::streamoff>(end));
+        uint8_t tag = 0;
+        uint32_t count = 0;
+        if (!read(&tag, sizeof(tag)) || tag != END || !read(&count, sizeof(count))) return false;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t index = 0;
+            uint32_t length = 0;
+            if (!read(&index, sizeof(index)) || !read(&length, sizeof(length))) return false;
+            std::string symbol(length, '\0');
+            if (!read(&symbol[0], length)) return false;
+            symbols.emplace_back(index, std::move(symbol));
+        }
+        file.clear();
+        file.seekg(begin);
+        return true;
+    }
+
+    /** 事件流结束时记录的(编号, 符号) */
+    std::vector<std::pair<uint32_t, std::string>> symbols;
+
+    /**
+     * @brief 读出下一条记录，事件的tuple写入event.data
+     * @return 到达END记录时返回false
+     */
+    bool next(uint8_t& tag, TraceEvent& event, std::string& text) {
+        if (!read(&tag, sizeof(tag)) || tag == END) return false;
+        event.viewId = 0;
+        event.arity = 0;
+        if (!read(&event.relId, sizeof(event.relId))) return false;
+        if (tag == RELATION || tag == RULE || tag == TYPES) {
+            uint32_t length = 0;
+            if (!read(&length, sizeof(length))) return false;
+            text.resize(length);
+            return length == 0 || read(&text[0], length);
+        }
+        if (tag == INPUT) return true;
+        uint8_t arity = 0;
+        if (!read(&arity, sizeof(arity)) || arity > MAX_TRACE_ARITY) return false;
+        event.op = static_cast<TraceOp>(tag);
+        event.arity = arity;
+        return read(event.data, arity * sizeof(souffle::RamDomain));
+    }
+
+private:
+    bool read(void* data, std::size_t size) {
+        return static_cast<bool>(file.read(static_cast<char*>(data), static_cast<std::streamsize>(size)));
+    }
+
+    std::ifstream file;
+    std::vector<char> chunk;
+};
+
+/**
+ * @brief 根据文件开头的magic判断是否为事件流
+ */
+inline bool is_trace_stream(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+}  // namespace trace_stream
+}  // namespace modified_souffle
@@ -49,13 +49,17 @@ public:
 
     template <typename T>
     void readAll(T& relation) {
+        // 未开启跟踪时analyzer为nullptr，被过滤的集合读入时不跟踪
+        auto* analyzer = modified_souffle::analyzer;
+        const bool traced = analyzer != nullptr && analyzer->tracing_input();
         while (const auto next = readNextTuple()) {
             const RamDomain* ramDomain = next.get();
             relation.insert(ramDomain);
+            if (!traced) continue;
             if constexpr (has_arity<T>::value) {
-                modified_souffle::analyzer->insert_from_file(relation.arity, ramDomain);
+                analyzer->insert_from_file(relation.arity, ramDomain);
             } else {
-                modified_souffle::analyzer->insert_from_file(T::Arity, ramDomain); // 访问静态成员 Arity
+                analyzer->insert_from_file(T::Arity, ramDomain); // 访问静态成员 Arity
             }
         }
     }
@@ -0,0 +1,251 @@
+/**
+ * @file ProofGraphProvenance.h
+ * 求值结束后从输出集合反向重建proof graph，求值期间不需要任何跟踪
+ */
+#pragma once
+
+#include "souffle/ProofGraph.h"
+#include "souffle/RamTypes.h"
+#include "souffle/SouffleInterface.h"
+#include "souffle/SymbolTable.h"
+#include "souffle/provenance/ExplainProvenance.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace modified_souffle {
+
+/**
+ * @class ProofGraphProvenance
+ * @brief 利用provenance插桩(每个tuple附带的规则编号与高度)和各规则的subproof子程序，
+ * 从输出集合的tuple出发按需重建它们的证明，只有能到达输出的tuple会出现在proof graph中。
+ * 与ExplainProvenanceImpl使用同样的子程序，解释器与编译后的程序都可使用
+ */
+class ProofGraphProvenance {
+public:
+    explicit ProofGraphProvenance(souffle::SouffleProgram& prog) : prog(prog) {}
+
+    /**
+     * @brief 重建所有输出tuple的证明并写出proof graph
+     * @return 重建的推导数
+     */
+    std::size_t write(const std::string& path) {
+        proof_graph::ProofGraphWriter writer;
+        collect_relations(writer);
+        collect_rules(writer);
+
+        // 以工作表代替递归，每个tuple只展开一次
+        for (auto& entry : relations) {
+            const RelationInfo& relation = entry.second;
+            if ((relation.flags & proof_graph::OUTPUT) == 0) continue;
+            for (auto& tuple : *relation.handle) {
+                Pending pending{&relation, {}, tuple[relation.arity], tuple[relation.arity + 1]};
+                for (uint32_t i = 0; i < relation.arity; ++i) {
+                    pending.values.push_back(tuple[i]);
+                }
+                intern(writer, std::move(pending));
+            }
+        }
+        std::size_t derivations = 0;
+        std::vector<souffle::RamDomain> args;
+        std::vector<souffle::RamDomain> ret;
+        std::vector<uint32_t> premises;
+        while (!worklist.empty()) {
+            Pending pending = std::move(worklist.back());
+            worklist.pop_back();
+            // 高度为0的是输入或事实，是proof graph中的叶子
+            if (pending.level == 0) continue;
+            auto rule = rules.find({pending.relation->name, pending.rule});
+            if (rule == rules.end()) continue;
+            const uint32_t tuple = tuples.at({pending.relation->id, pending.values});
+
+            args = pending.values;
+            args.push_back(pending.level);
+            ret.clear();
+            prog.executeSubroutine(
+                    pending.relation->name + "_" + std::to_string(pending.rule) + "_subproof", args, ret);
+
+            // 返回值按规则体的顺序排列，与ExplainProvenanceImpl::explain的解读方式相同
+            premises.clear();
+            std::size_t cursor = 0;
+            for (const BodyAtom& atom : rule->second.body) {
+                if (atom.relation == nullptr) {
+                    // 约束与否定不对应任何tuple，只跳过它们占用的位置
+                    cursor += atom.width;
+                    continue;
+                }
+                Pending premise{atom.relation, {}, 0, 0};
+                premise.values.assign(ret.begin() + cursor, ret.begin() + cursor + atom.relation->arity);
+                premise.rule = ret[cursor + atom.relation->arity];
+                premise.level = ret[cursor + atom.relation->arity + 1];
+                cursor += atom.width;
+                premises.push_back(intern(writer, std::move(premise)));
+            }
+            writer.add_derivation(tuple, rule->second.id, premises.data(), static_cast<uint32_t>(premises.size()));
+            derivations++;
+        }
+
+        std::vector<const std::string*> symbols;
+        for (const auto& symbol : prog.getSymbolTable()) {
+            if (static_cast<std::size_t>(symbol.second) >= symbols.size()) symbols.resize(symbol.second + 1);
+            symbols[symbol.second] = &symbol.first;
+        }
+        for (const std::string* symbol : symbols) {
+            if (symbol != nullptr)
+                writer.add_symbol(symbol->data(), symbol->size());
+            else
+                writer.add_symbol("", 0);
+        }
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        writer.write(file, values.data(), values.size());
+        return derivations;
+    }
+
+private:
+    struct RelationInfo {
+        uint32_t id;
+        std::string name;
+        souffle::Relation* handle;
+        /** 不含规则编号与高度的arity */
+        uint32_t arity;
+        uint32_t flags;
+    };
+
+    struct BodyAtom {
+        /** 约束与否定为nullptr */
+        const RelationInfo* relation;
+        /** 在subproof子程序的返回值中占用的位置数 */
+        std::size_t width;
+    };
+
+    struct RuleInfo {
+        uint32_t id;
+        std::vector<BodyAtom> body;
+    };
+
+    /** 等待展开的tuple */
+    struct Pending {
+        const RelationInfo* relation;
+        std::vector<souffle::RamDomain> values;
+        souffle::RamDomain rule;
+        souffle::RamDomain level;
+    };
+
+    using TupleKey = std::pair<uint32_t, std::vector<souffle::RamDomain>>;
+
+    struct TupleKeyHash {
+        std::size_t operator()(const TupleKey& key) const {
+            std::size_t seed = key.first;
+            for (souffle::RamDomain value : key.second) {
+                seed ^= std::hash<souffle::RamDomain>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            }
+            return seed;
+        }
+    };
+
+    static bool is_info(const std::string& name) {
+        return name.find(".@info") != std::string::npos;
+    }
+
+    void collect_relations(proof_graph::ProofGraphWriter& writer) {
+        const auto inputs = prog.getInputRelations();
+        const auto outputs = prog.getOutputRelations();
+        for (souffle::Relation* rel : prog.getAllRelations()) {
+            if (is_info(rel->getName())) continue;
+            uint32_t flags = 0;
+            if (std::find(inputs.begin(), inputs.end(), rel) != inputs.end()) flags |= proof_graph::INPUT;
+            if (std::find(outputs.begin(), outputs.end(), rel) != outputs.end()) flags |= proof_graph::OUTPUT;
+            // 记录与ADT在这里无法展开，按编号输出
+            std::string kinds;
+            for (uint32_t i = 0; i < rel->getPrimaryArity(); ++i) {
+                kinds += proof_graph::value_kind(rel->getAttrType(i));
+            }
+            const uint32_t id = writer.add_relation(rel->getName(), flags, kinds);
+            relations[rel->getName()] = {id, rel->getName(), rel, rel->getPrimaryArity(), flags};
+        }
+    }
+
+    void collect_rules(proof_graph::ProofGraphWriter& writer) {
+        static const std::vector<std::string> constraints = {
+                "=", "!=", "<", "<=", ">=", ">", "match", "contains", "not_match", "not_contains"};
+        for (souffle::Relation* rel : prog.getAllRelations()) {
+            const std::string& name = rel->getName();
+            if (!is_info(name)) continue;
+            auto head = relations.find(name.substr(0, name.find(".@info")));
+            if (head == relations.end()) continue;
+            for (auto& tuple : *rel) {
+                // 第一列为规则编号，之后是各个atom，最后一列为规则本身，atom中的第一个为规则头
+                souffle::RamDomain number;
+                tuple >> number;
+                std::vector<std::string> atoms;
+                for (std::size_t i = 1; i + 1 < rel->getArity(); i++) {
+                    std::string atom;
+                    tuple >> atom;
+                    atoms.push_back(atom);
+                }
+                std::string text;
+                tuple >> text;
+
+                RuleInfo rule{writer.add_rule(normalize(text), head->second.id), {}};
+                for (std::size_t i = 1; i < atoms.size(); ++i) {
+                    const std::string atom = souffle::splitString(atoms[i], ',')[0];
+                    if (std::find(constraints.begin(), constraints.end(), atom) != constraints.end()) {
+                        // 只处理二元约束，其值连同两个辅助列共占4个位置
+                        rule.body.push_back({nullptr, 4});
+                        continue;
+                    }
+                    const bool negated = atom[0] == '!';
+                    auto body = relations.find(negated ? atom.substr(1) : atom);
+                    if (body == relations.end()) continue;
+                    const std::size_t width = body->second.handle->getArity();
+                    rule.body.push_back({negated ? nullptr : &body->second, width});
+                }
+                rules[{head->first, number}] = std::move(rule);
+            }
+        }
+    }
+
+    /**
+     * @brief 将规则文本中的换行与缩进压缩为单个空格
+     */
+    static std::string normalize(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                if (!out.empty() && out.back() != ' ') out += ' ';
+            } else
+                out += c;
+        }
+        return out;
+    }
+
+    /**
+     * @return tuple在proof graph中的id，首次出现时将其加入工作表
+     */
+    uint32_t intern(proof_graph::ProofGraphWriter& writer, Pending&& pending) {
+        TupleKey key{pending.relation->id, pending.values};
+        auto it = tuples.find(key);
+        if (it != tuples.end()) return it->second;
+        const uint32_t id = writer.add_tuple(pending.relation->id, values.size(), pending.relation->arity);
+        values.insert(values.end(), pending.values.begin(), pending.values.end());
+        tuples.emplace(std::move(key), id);
+        worklist.push_back(std::move(pending));
+        return id;
+    }
+
+    souffle::SouffleProgram& prog;
+    std::map<std::string, RelationInfo> relations;
+    std::map<std::pair<std::string, souffle::RamDomain>, RuleInfo> rules;
+    std::unordered_map<TupleKey, uint32_t, TupleKeyHash> tuples;
+    std::vector<souffle::RamDomain> values;
+    std::vector<Pending> worklist;
+};
+
+}  // namespace modified_souffle
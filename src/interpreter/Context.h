@@ -99,8 +99,18 @@ public:
         ViewPtr view;
         if (views.size() < viewPos + 1) {
             views.resize(viewPos + 1);
+            viewOrders.resize(viewPos + 1);
         }
         views[viewPos] = rel.createView(indexPos);
+        if (indexPos < rel.traceOrders.size()) {
+            viewOrders[viewPos] = rel.traceOrders[indexPos];
+        }
+    }
+
+    /** @brief Return the analyzer order id of the index behind a view */
+    uint32_t getViewOrder(std::size_t id) const {
+        assert(id < viewOrders.size());
+        return viewOrders[id];
     }
 
     /** @brief Return a view */
@@ -120,6 +130,8 @@ private:
     VecOwn<RamDomain[]> allocatedDataContainer;
     /** @brief Views */
     VecOwn<ViewWrapper> views;
+    /** @brief Analyzer order id of each view, only filled while tracing */
+    std::vector<uint32_t> viewOrders;
 };
 
 }  // namespace souffle::interpreter
@@ -20,6 +20,7 @@
 #include "interpreter/Context.h"
 #include "interpreter/Index.h"
 #include "interpreter/Node.h"
+#include "interpreter/Scheduler.h"
 #include "interpreter/Relation.h"
 #include "interpreter/ViewContext.h"
 #include "ram/Aggregate.h"
@@ -92,6 +93,7 @@
 #include "souffle/utility/MiscUtil.h"
 #include "souffle/utility/ParallelUtil.h"
 #include "souffle/utility/StringUtil.h"
+#include "souffle/utility/json11.h"
 #include "souffle/Modify.h"
 #include <algorithm>
 #include <array>
@@ -101,6 +103,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <deque>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <iterator>
@@ -114,20 +117,6 @@
 #include <dlfcn.h>
 #include <ffi.h>
 
-namespace modified_souffle {
-template <std::size_t Arity>
-std::string tupleToString(const souffle::Tuple<souffle::RamDomain, Arity>& tuple) {
-    std::string s = "(";
-    for (auto it = tuple.begin(); it < tuple.end(); it++) {
-        s += std::to_string((int)*it);
-        if (it != tuple.end() - 1) s += ",";
-    }
-    s += ")";
-    return s;
-}
-
-}
-
 namespace souffle::interpreter {
 
 // Handle difference in dynamic libraries suffixes.
@@ -153,6 +142,11 @@ namespace souffle::interpreter {
 namespace {
 constexpr RamDomain RAM_BIT_SHIFT_MASK = RAM_DOMAIN_SIZE - 1;
 
+/** Tuples a scan binds before running its filters over them, see Engine::evalBlocks */
+constexpr std::size_t BLOCK_SIZE = 1024;
+/** Wide relations get fewer tuples per block so that a block stays within this many bytes */
+constexpr std::size_t BLOCK_BYTES = 64 * 1024;
+
 #ifdef _OPENMP
 std::size_t number_of_threads(const std::size_t user_specified) {
     if (user_specified > 0) {
@@ -168,18 +162,114 @@ std::size_t number_of_threads(const std::size_t) {
 }
 #endif
 
+/** One side of the pattern of a super-instruction, with its generic expressions lowered */
+class LoweredPattern {
+public:
+    template <typename Lower>
+    LoweredPattern(const std::vector<RamDomain>& constants,
+            const std::vector<std::array<std::size_t, 3>>& tupleElements,
+            const std::vector<std::pair<std::size_t, Own<Node>>>& expressions, Lower lower)
+            : constants(&constants), tupleElements(&tupleElements) {
+        for (const auto& expression : expressions) {
+            this->expressions.emplace_back(expression.first, lower(expression.second.get()));
+        }
+    }
+
+    template <std::size_t Arity>
+    void fill(souffle::Tuple<RamDomain, Arity>& tuple, Context& ctxt) const {
+        std::copy_n(constants->begin(), Arity, tuple.begin());
+        for (const auto& tupleElement : *tupleElements) {
+            tuple[tupleElement[0]] = ctxt[tupleElement[1]][tupleElement[2]];
+        }
+        for (const auto& expression : expressions) {
+            tuple[expression.first] = expression.second(ctxt);
+        }
+    }
+
+    /** Copy the columns this pattern binds, i.e. all but the constant ones */
+    template <std::size_t Arity>
+    void copyBound(const souffle::Tuple<RamDomain, Arity>& from, souffle::Tuple<RamDomain, Arity>& to) const {
+        for (const auto& tupleElement : *tupleElements) {
+            to[tupleElement[0]] = from[tupleElement[0]];
+        }
+        for (const auto& expression : expressions) {
+            to[expression.first] = from[expression.first];
+        }
+    }
+
+private:
+    const std::vector<RamDomain>* constants;
+    const std::vector<std::array<std::size_t, 3>>* tupleElements;
+    std::vector<std::pair<std::size_t, Closure>> expressions;
+};
+
 }  // namespace
 
 using namespace modified_souffle;
 
+// Report to the trace analyzer; compiled out entirely when the engine runs untraced.
+#define TRACE(...)                               \
+    if constexpr (TracePolicy::enabled) {        \
+        modified_souffle::analyzer->__VA_ARGS__; \
+    }
+
 Engine::Engine(ram::TranslationUnit& tUnit, const std::string& analyzer_output_path, bool is_debug)
         : profileEnabled(Global::config().has("profile")),
           frequencyCounterEnabled(Global::config().has("profile-frequency")),
           isProvenance(Global::config().has("provenance")),
+          // The profile counts reads and rule frequencies on the switch dispatcher only.
+          closureDispatch(Global::config().get("interpreter-dispatch") == "closure" && !profileEnabled),
+          adaptiveDispatch(Global::config().get("interpreter-dispatch") == "adaptive" && !profileEnabled),
+          hotQueryThreshold(std::stoull(Global::config().get("hot-query-threshold"))),
           numOfThreads(number_of_threads(std::stoi(Global::config().get("jobs")))), tUnit(tUnit),
           isa(tUnit.getAnalysis<ram::analysis::IndexAnalysis>()), recordTable(numOfThreads),
-          symbolTable(numOfThreads) {
-                analyzer  = new modified_souffle::TupleDataAnalyzer(analyzer_output_path, &symbolTable, is_debug);
+          symbolTable(numOfThreads), traceEnabled(!Global::config().has("no-trace")) {
+    if (traceEnabled) {
+        const auto format = Global::config().get("trace-format") == "text"
+                                    ? modified_souffle::TraceFormat::Text
+                                    : modified_souffle::TraceFormat::Graph;
+        analyzer = new modified_souffle::TupleDataAnalyzer(
+                analyzer_output_path, &symbolTable, is_debug, format);
+        analyzer->set_record_table(&recordTable);
+        analyzer->set_memory_budget(std::stoull(Global::config().get("trace-memory")) << 20);
+        if (!is_debug) {
+            analyzer->progress.set_interval(
+                    std::chrono::milliseconds(std::stoull(Global::config().get("trace-progress"))));
+        }
+        const std::string& dedup = Global::config().get("trace-dedup");
+        traceNewTuples = dedup == "tuple";
+        analyzer->set_dedup(dedup == "tuple"  ? modified_souffle::TraceDedup::Tuple
+                            : dedup == "rule" ? modified_souffle::TraceDedup::Rule
+                                              : modified_souffle::TraceDedup::None);
+        if (Global::config().has("trace-expected")) {
+            analyzer->set_expected_output(Global::config().get("trace-expected"));
+        }
+        // Record layouts are only attached to IO directives; every directive carries all of them.
+        bool recordsFound = false;
+        visit(tUnit.getProgram(), [&](const ram::IO& io) {
+            const auto& directives = io.getDirectives();
+            auto types = directives.find("types");
+            if (recordsFound || types == directives.end()) return;
+            std::string error;
+            const json11::Json json = json11::Json::parse(types->second, error);
+            for (const auto& record : json["records"].object_items()) {
+                std::vector<std::string> fields;
+                for (const auto& field : record.second["types"].array_items()) {
+                    fields.push_back(field.string_value());
+                }
+                analyzer->register_record(record.first, fields);
+            }
+            recordsFound = true;
+        });
+    }
+}
+
+Engine::~Engine() {
+    // The global analyzer refers to the symbol and record tables of this engine.
+    if (traceEnabled) {
+        delete analyzer;
+        analyzer = nullptr;
+    }
 }
 
 Engine::RelationHandle& Engine::getRelationHandle(const std::size_t idx) {
@@ -189,9 +279,12 @@ Engine::RelationHandle& Engine::getRelationHandle(const std::size_t idx) {
 void Engine::swapRelation(const std::size_t ramRel1, const std::size_t ramRel2) {
     RelationHandle& rel1 = getRelationHandle(ramRel1);
     RelationHandle& rel2 = getRelationHandle(ramRel2);
-    (*analyzer) << "SWAP" << rel1->getName() << rel2->getName() << std::endl;
-    (*analyzer).parse();
+    if (traceEnabled) {
+        analyzer->emit(TraceOp::Swap, ramRel1, ramRel2);
+    }
     std::swap(rel1, rel2);
+    // Trace ids identify the RAM relation rather than the swapped storage; trace orders stay with the indexes.
+    std::swap(rel1->traceId, rel2->traceId);
 }
 
 int Engine::incCounter() {
@@ -237,6 +330,13 @@ void Engine::createRelation(const ram::Relation& id, const std::size_t idx) {
             res = createBTreeRelation(id, isa->getIndexSelection(id.getName()));
         }
     }
+    res->traceId = idx;
+    if (traceEnabled) {
+        analyzer->register_relation(idx, id.getName(), id.getAttributeTypes());
+        for (std::size_t i = 0; i < res->getIndexCount(); ++i) {
+            res->traceOrders.push_back(analyzer->register_order(res->getIndexOrder(i).getOrder()));
+        }
+    }
     relations[idx] = mk<RelationHandle>(std::move(res));
 }
 
@@ -307,8 +407,10 @@ void Engine::executeMain() {
     Context ctxt;
 
     if (!profileEnabled) {
-        Context ctxt;
-        execute(main.get(), ctxt);
+        if (!executeStrata()) {
+            Context ctxt;
+            execute(main.get(), ctxt);
+        }
     } else {
         ProfileEventSingleton::instance().setOutputFile(Global::config().get("profile"));
         // Prepare the frequency table for threaded use
@@ -354,9 +456,68 @@ void Engine::executeMain() {
                     "@relation-reads;" + cur.first, cur.second, 0);
         }
     }
+    if (traceEnabled) {
+        analyzer->flush();
+        if (Global::config().has("trace-stats")) {
+            // Read by sh/run_trace_benchmark.sh; all counters are final once the analyzer is flushed.
+            const auto& progress = analyzer->progress;
+            std::ofstream stats(Global::config().get("trace-stats"));
+            stats << json11::Json(json11::Json::object{
+                                          {"events", static_cast<double>(progress.event_count())},
+                                          {"tuples", static_cast<double>(progress.tuple_count())},
+                                          {"trace_bytes", static_cast<double>(progress.byte_count())}})
+                             .dump()
+                  << std::endl;
+        }
+    }
     SignalHandler::instance()->reset();
 }
 
+bool Engine::executeStrata() {
+    // The trace analyzer expects the events of one stratum after another.
+    if (traceEnabled || numOfThreads <= 1) {
+        return false;
+    }
+    std::vector<std::size_t> strata;
+    std::vector<const ram::Statement*> statements;
+    std::function<bool(const Node*)> collect = [&](const Node* node) {
+        if (node->getType() == I_Sequence) {
+            for (const auto& child : static_cast<const Sequence*>(node)->getChildren()) {
+                if (!collect(child.get())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        if (node->getType() == I_Call) {
+            const auto& call = static_cast<const ram::Call&>(*node->getShadow());
+            strata.push_back(static_cast<const Call*>(node)->getSubroutineId());
+            statements.push_back(&tUnit.getProgram().getSubroutine(call.getName()));
+            return true;
+        }
+        return false;
+    };
+    if (!collect(main.get()) || strata.size() < 2) {
+        return false;
+    }
+
+    // Functor calls resolve their handles lazily; load the libraries before the workers share them.
+    loadDLL();
+    StratumScheduler scheduler(statements);
+    scheduler.run(numOfThreads, [&](std::size_t i, std::size_t threads) {
+#ifdef _OPENMP
+        // Parallel operations of the stratum start their own team on this worker.
+        omp_set_num_threads(static_cast<int>(threads));
+#endif
+        Context ctxt;
+        execute(subroutine[strata[i]].get(), ctxt);
+    });
+#ifdef _OPENMP
+    omp_set_num_threads(static_cast<int>(numOfThreads));
+#endif
+    return true;
+}
+
 void Engine::generateIR() {
     const ram::Program& program = tUnit.getProgram();
     NodeGenerator generator(*this);
@@ -382,11 +543,19 @@ void Engine::executeSubroutine(
     execute(subroutine[i].get(), ctxt);
 }
 
+RamDomain Engine::execute(const Node* node, Context& ctxt) {
+    if (traceEnabled) {
+        return execute<FullTrace>(node, ctxt);
+    }
+    return execute<NoTrace>(node, ctxt);
+}
+
+template <typename TracePolicy>
 RamDomain Engine::execute(const Node* node, Context& ctxt) {
 #define DEBUG(Kind) std::cout << "Running Node: " << #Kind << "\n";
-#define EVAL_CHILD(ty, idx) ramBitCast<ty>(execute(shadow.getChild(idx), ctxt))
-#define EVAL_LEFT(ty) ramBitCast<ty>(execute(shadow.getLhs(), ctxt))
-#define EVAL_RIGHT(ty) ramBitCast<ty>(execute(shadow.getRhs(), ctxt))
+#define EVAL_CHILD(ty, idx) ramBitCast<ty>(execute<TracePolicy>(shadow.getChild(idx), ctxt))
+#define EVAL_LEFT(ty) ramBitCast<ty>(execute<TracePolicy>(shadow.getLhs(), ctxt))
+#define EVAL_RIGHT(ty) ramBitCast<ty>(execute<TracePolicy>(shadow.getRhs(), ctxt))
 
 // Overload CASE based on number of arguments.
 // CASE(Kind) -> BASE_CASE(Kind)
@@ -411,27 +580,35 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
     ();            \
     }
 
+// Statements excluded by the trace filter run the untraced instantiation for their whole subtree.
+#define UNTRACED_SUBTREE                         \
+    if constexpr (TracePolicy::enabled) {        \
+        if (!shadow.isTraced()) {                \
+            return execute<NoTrace>(node, ctxt); \
+        }                                        \
+    }
+
 #define TUPLE_COPY_FROM(dst, src)     \
     assert(dst.size() == src.size()); \
     std::copy_n(src.begin(), dst.size(), dst.begin())
 
-#define CAL_SEARCH_BOUND(superInfo, low, high)                          \
-    /** Unbounded and Constant */                                       \
-    TUPLE_COPY_FROM(low, superInfo.first);                              \
-    TUPLE_COPY_FROM(high, superInfo.second);                            \
-    /* TupleElement */                                                  \
-    for (const auto& tupleElement : superInfo.tupleFirst) {             \
-        low[tupleElement[0]] = ctxt[tupleElement[1]][tupleElement[2]];  \
-    }                                                                   \
-    for (const auto& tupleElement : superInfo.tupleSecond) {            \
-        high[tupleElement[0]] = ctxt[tupleElement[1]][tupleElement[2]]; \
-    }                                                                   \
-    /* Generic */                                                       \
-    for (const auto& expr : superInfo.exprFirst) {                      \
-        low[expr.first] = execute(expr.second.get(), ctxt);             \
-    }                                                                   \
-    for (const auto& expr : superInfo.exprSecond) {                     \
-        high[expr.first] = execute(expr.second.get(), ctxt);            \
+#define CAL_SEARCH_BOUND(superInfo, low, high)                            \
+    /** Unbounded and Constant */                                         \
+    TUPLE_COPY_FROM(low, superInfo.first);                                \
+    TUPLE_COPY_FROM(high, superInfo.second);                              \
+    /* TupleElement */                                                    \
+    for (const auto& tupleElement : superInfo.tupleFirst) {               \
+        low[tupleElement[0]] = ctxt[tupleElement[1]][tupleElement[2]];    \
+    }                                                                     \
+    for (const auto& tupleElement : superInfo.tupleSecond) {              \
+        high[tupleElement[0]] = ctxt[tupleElement[1]][tupleElement[2]];   \
+    }                                                                     \
+    /* Generic */                                                         \
+    for (const auto& expr : superInfo.exprFirst) {                        \
+        low[expr.first] = execute<TracePolicy>(expr.second.get(), ctxt);  \
+    }                                                                     \
+    for (const auto& expr : superInfo.exprSecond) {                       \
+        high[expr.first] = execute<TracePolicy>(expr.second.get(), ctxt); \
     }
 
     switch (node->getType()) {
@@ -513,23 +690,23 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
             const auto& args = cur.getArguments();
             switch (cur.getOperator()) {
                 /** Unary Functor Operators */
-                case FunctorOp::ORD: return execute(shadow.getChild(0), ctxt);
+                case FunctorOp::ORD: return execute<TracePolicy>(shadow.getChild(0), ctxt);
                 case FunctorOp::STRLEN:
-                    return getSymbolTable().decode(execute(shadow.getChild(0), ctxt)).size();
-                case FunctorOp::NEG: return -execute(shadow.getChild(0), ctxt);
+                    return getSymbolTable().decode(execute<TracePolicy>(shadow.getChild(0), ctxt)).size();
+                case FunctorOp::NEG: return -execute<TracePolicy>(shadow.getChild(0), ctxt);
                 case FunctorOp::FNEG: {
-                    RamDomain result = execute(shadow.getChild(0), ctxt);
+                    RamDomain result = execute<TracePolicy>(shadow.getChild(0), ctxt);
                     return ramBitCast(-ramBitCast<RamFloat>(result));
                 }
-                case FunctorOp::BNOT: return ~execute(shadow.getChild(0), ctxt);
+                case FunctorOp::BNOT: return ~execute<TracePolicy>(shadow.getChild(0), ctxt);
                 case FunctorOp::UBNOT: {
-                    RamDomain result = execute(shadow.getChild(0), ctxt);
+                    RamDomain result = execute<TracePolicy>(shadow.getChild(0), ctxt);
                     return ramBitCast(~ramBitCast<RamUnsigned>(result));
                 }
-                case FunctorOp::LNOT: return !execute(shadow.getChild(0), ctxt);
+                case FunctorOp::LNOT: return !execute<TracePolicy>(shadow.getChild(0), ctxt);
 
                 case FunctorOp::ULNOT: {
-                    RamDomain result = execute(shadow.getChild(0), ctxt);
+                    RamDomain result = execute<TracePolicy>(shadow.getChild(0), ctxt);
                     // Casting is a bit tricky here, since ! returns a boolean.
                     return ramBitCast(static_cast<RamUnsigned>(!ramBitCast<RamUnsigned>(result)));
                 }
@@ -542,7 +719,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                 case FunctorOp::I2I:
                 case FunctorOp::U2U:
                 case FunctorOp::S2S:
-                    return execute(shadow.getChild(0), ctxt);
+                    return execute<TracePolicy>(shadow.getChild(0), ctxt);
 
                 UNARY_OP(F2I, RamFloat   , static_cast<RamSigned>)
                 UNARY_OP(F2U, RamFloat   , static_cast<RamUnsigned>)
@@ -569,19 +746,20 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                     // clang-format on
 
                 case FunctorOp::EXP: {
-                    return std::pow(execute(shadow.getChild(0), ctxt), execute(shadow.getChild(1), ctxt));
+                    return std::pow(execute<TracePolicy>(shadow.getChild(0), ctxt),
+                            execute<TracePolicy>(shadow.getChild(1), ctxt));
                 }
 
                 case FunctorOp::UEXP: {
-                    auto first = ramBitCast<RamUnsigned>(execute(shadow.getChild(0), ctxt));
-                    auto second = ramBitCast<RamUnsigned>(execute(shadow.getChild(1), ctxt));
+                    auto first = ramBitCast<RamUnsigned>(execute<TracePolicy>(shadow.getChild(0), ctxt));
+                    auto second = ramBitCast<RamUnsigned>(execute<TracePolicy>(shadow.getChild(1), ctxt));
                     // Extra casting required: pow returns a floating point.
                     return ramBitCast(static_cast<RamUnsigned>(std::pow(first, second)));
                 }
 
                 case FunctorOp::FEXP: {
-                    auto first = ramBitCast<RamFloat>(execute(shadow.getChild(0), ctxt));
-                    auto second = ramBitCast<RamFloat>(execute(shadow.getChild(1), ctxt));
+                    auto first = ramBitCast<RamFloat>(execute<TracePolicy>(shadow.getChild(0), ctxt));
+                    auto second = ramBitCast<RamFloat>(execute<TracePolicy>(shadow.getChild(1), ctxt));
                     return ramBitCast(static_cast<RamFloat>(std::pow(first, second)));
                 }
 
@@ -612,16 +790,16 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                 case FunctorOp::CAT: {
                     std::stringstream ss;
                     for (std::size_t i = 0; i < args.size(); i++) {
-                        ss << getSymbolTable().decode(execute(shadow.getChild(i), ctxt));
+                        ss << getSymbolTable().decode(execute<TracePolicy>(shadow.getChild(i), ctxt));
                     }
                     return getSymbolTable().encode(ss.str());
                 }
                 /** Ternary Functor Operators */
                 case FunctorOp::SUBSTR: {
-                    auto symbol = execute(shadow.getChild(0), ctxt);
+                    auto symbol = execute<TracePolicy>(shadow.getChild(0), ctxt);
                     const std::string& str = getSymbolTable().decode(symbol);
-                    auto idx = execute(shadow.getChild(1), ctxt);
-                    auto len = execute(shadow.getChild(2), ctxt);
+                    auto idx = execute<TracePolicy>(shadow.getChild(1), ctxt);
+                    auto len = execute<TracePolicy>(shadow.getChild(2), ctxt);
                     std::string sub_str;
                     try {
                         sub_str = str.substr(idx, len);
@@ -657,7 +835,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
             auto numArgs = cur.getArguments().size();
             auto runNested = [&](auto&& tuple) {
                 ctxt[cur.getTupleId()] = tuple.data();
-                execute(shadow.getChild(numArgs), ctxt);
+                execute<TracePolicy>(shadow.getChild(numArgs), ctxt);
             };
 
 #define RUN_RANGE(ty)                                                                                     \
@@ -698,7 +876,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                 void* recordTable = (void*)&getRecordTable();
                 values[1] = &recordTable;
                 for (std::size_t i = 0; i < arity; i++) {
-                    intVal[i] = execute(shadow.getChild(i), ctxt);
+                    intVal[i] = execute<TracePolicy>(shadow.getChild(i), ctxt);
                     args[i + 2] = &FFI_RamSigned;
                     values[i + 2] = &intVal[i];
                 }
@@ -728,7 +906,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 
                 /* Initialize arguments for ffi-call */
                 for (std::size_t i = 0; i < arity; i++) {
-                    RamDomain arg = execute(shadow.getChild(i), ctxt);
+                    RamDomain arg = execute<TracePolicy>(shadow.getChild(i), ctxt);
                     switch (types[i]) {
                         case TypeAttribute::Symbol:
                             args[i] = &FFI_Symbol;
@@ -803,7 +981,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
             std::size_t arity = values.size();
             RamDomain data[arity];
             for (std::size_t i = 0; i < arity; ++i) {
-                data[i] = execute(shadow.getChild(i), ctxt);
+                data[i] = execute<TracePolicy>(shadow.getChild(i), ctxt);
             }
             return getRecordTable().pack(data, arity);
         ESAC(PackRecord)
@@ -821,11 +999,11 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
         ESAC(False)
 
         CASE(Conjunction)
-            return execute(shadow.getLhs(), ctxt) && execute(shadow.getRhs(), ctxt);
+            return execute<TracePolicy>(shadow.getLhs(), ctxt) && execute<TracePolicy>(shadow.getRhs(), ctxt);
         ESAC(Conjunction)
 
         CASE(Negation)
-            return !execute(shadow.getChild(), ctxt);
+            return !execute<TracePolicy>(shadow.getChild(), ctxt);
         ESAC(Negation)
 
 #define EMPTINESS_CHECK(Structure, Arity, ...)                          \
@@ -846,17 +1024,17 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
         FOR_EACH(RELATION_SIZE)
 #undef RELATION_SIZE
 
-#define EXISTENCE_CHECK(Structure, Arity, ...)            \
-    CASE(ExistenceCheck, Structure, Arity)                \
-        return evalExistenceCheck<RelType>(shadow, ctxt); \
+#define EXISTENCE_CHECK(Structure, Arity, ...)                         \
+    CASE(ExistenceCheck, Structure, Arity)                             \
+        return evalExistenceCheck<TracePolicy, RelType>(shadow, ctxt); \
     ESAC(ExistenceCheck)
 
         FOR_EACH(EXISTENCE_CHECK)
 #undef EXISTENCE_CHECK
 
-#define PROVENANCE_EXISTENCE_CHECK(Structure, Arity, ...)           \
-    CASE(ProvenanceExistenceCheck, Structure, Arity)                \
-        return evalProvenanceExistenceCheck<RelType>(shadow, ctxt); \
+#define PROVENANCE_EXISTENCE_CHECK(Structure, Arity, ...)                        \
+    CASE(ProvenanceExistenceCheck, Structure, Arity)                             \
+        return evalProvenanceExistenceCheck<TracePolicy, RelType>(shadow, ctxt); \
     ESAC(ProvenanceExistenceCheck)
 
         FOR_EACH_PROVENANCE(PROVENANCE_EXISTENCE_CHECK)
@@ -888,8 +1066,8 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                 COMPARE(GE, >=)
 
                 case BinaryConstraintOp::MATCH: {
-                    RamDomain left = execute(shadow.getLhs(), ctxt);
-                    RamDomain right = execute(shadow.getRhs(), ctxt);
+                    RamDomain left = execute<TracePolicy>(shadow.getLhs(), ctxt);
+                    RamDomain right = execute<TracePolicy>(shadow.getRhs(), ctxt);
                     const std::string& pattern = getSymbolTable().decode(left);
                     const std::string& text = getSymbolTable().decode(right);
                     bool result = false;
@@ -902,8 +1080,8 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                     return result;
                 }
                 case BinaryConstraintOp::NOT_MATCH: {
-                    RamDomain left = execute(shadow.getLhs(), ctxt);
-                    RamDomain right = execute(shadow.getRhs(), ctxt);
+                    RamDomain left = execute<TracePolicy>(shadow.getLhs(), ctxt);
+                    RamDomain right = execute<TracePolicy>(shadow.getRhs(), ctxt);
                     const std::string& pattern = getSymbolTable().decode(left);
                     const std::string& text = getSymbolTable().decode(right);
                     bool result = false;
@@ -916,15 +1094,15 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                     return result;
                 }
                 case BinaryConstraintOp::CONTAINS: {
-                    RamDomain left = execute(shadow.getLhs(), ctxt);
-                    RamDomain right = execute(shadow.getRhs(), ctxt);
+                    RamDomain left = execute<TracePolicy>(shadow.getLhs(), ctxt);
+                    RamDomain right = execute<TracePolicy>(shadow.getRhs(), ctxt);
                     const std::string& pattern = getSymbolTable().decode(left);
                     const std::string& text = getSymbolTable().decode(right);
                     return text.find(pattern) != std::string::npos;
                 }
                 case BinaryConstraintOp::NOT_CONTAINS: {
-                    RamDomain left = execute(shadow.getLhs(), ctxt);
-                    RamDomain right = execute(shadow.getRhs(), ctxt);
+                    RamDomain left = execute<TracePolicy>(shadow.getLhs(), ctxt);
+                    RamDomain right = execute<TracePolicy>(shadow.getRhs(), ctxt);
                     const std::string& pattern = getSymbolTable().decode(left);
                     const std::string& text = getSymbolTable().decode(right);
                     return text.find(pattern) == std::string::npos;
@@ -940,7 +1118,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
         ESAC(Constraint)
 
         CASE(TupleOperation)
-            bool result = execute(shadow.getChild(), ctxt);
+            bool result = execute<TracePolicy>(shadow.getChild(), ctxt);
 
             auto& currentFrequencies = frequencies[cur.getProfileText()];
             while (currentFrequencies.size() <= getIterationNumber()) {
@@ -955,38 +1133,36 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 #define SCAN(Structure, Arity, ...)                                     \
     CASE(Scan, Structure, Arity)                                        \
         const auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
-        (*analyzer) << "SCAN_TARGET" << rel.getName() << std::endl;     \
-        (*analyzer).parse();                                            \
-        return evalScan(rel, cur, shadow, ctxt);                        \
+        TRACE(emit(TraceOp::ScanTarget, rel.traceId));                  \
+        return evalScan<TracePolicy>(rel, cur, shadow, ctxt);           \
     ESAC(Scan)
 
         FOR_EACH(SCAN)
 #undef SCAN
 
-#define PARALLEL_SCAN(Structure, Arity, ...)                                 \
-    CASE(ParallelScan, Structure, Arity)                                     \
-        const auto& rel = *static_cast<RelType*>(shadow.getRelation());      \
-        (*analyzer) << "PARALLEL_SCAN_TARGET" << rel.getName() << std::endl; \
-        (*analyzer).parse();                                                 \
-        return evalParallelScan(rel, cur, shadow, ctxt);                     \
+#define PARALLEL_SCAN(Structure, Arity, ...)                            \
+    CASE(ParallelScan, Structure, Arity)                                \
+        const auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
+        TRACE(emit(TraceOp::ScanTarget, rel.traceId));                  \
+        return evalParallelScan<TracePolicy>(rel, cur, shadow, ctxt);   \
     ESAC(ParallelScan)
         FOR_EACH(PARALLEL_SCAN)
 #undef PARALLEL_SCAN
 
-#define INDEX_SCAN(Structure, Arity, ...)                               \
-    CASE(IndexScan, Structure, Arity)                                   \
-        (*analyzer) << "SCAN_TARGET" << cur.getRelation() << std::endl; \
-        (*analyzer).parse();                                            \
-        return evalIndexScan<RelType>(cur, shadow, ctxt);               \
+#define INDEX_SCAN(Structure, Arity, ...)                                \
+    CASE(IndexScan, Structure, Arity)                                    \
+        TRACE(emit(TraceOp::ScanTarget, shadow.getRelation()->traceId)); \
+        return evalIndexScan<TracePolicy, RelType>(cur, shadow, ctxt);   \
     ESAC(IndexScan)
 
         FOR_EACH(INDEX_SCAN)
 #undef INDEX_SCAN
 
-#define PARALLEL_INDEX_SCAN(Structure, Arity, ...)                      \
-    CASE(ParallelIndexScan, Structure, Arity)                           \
-        const auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
-        return evalParallelIndexScan(rel, cur, shadow, ctxt);           \
+#define PARALLEL_INDEX_SCAN(Structure, Arity, ...)                         \
+    CASE(ParallelIndexScan, Structure, Arity)                              \
+        const auto& rel = *static_cast<RelType*>(shadow.getRelation());    \
+        TRACE(emit(TraceOp::ScanTarget, rel.traceId));                     \
+        return evalParallelIndexScan<TracePolicy>(rel, cur, shadow, ctxt); \
     ESAC(ParallelIndexScan)
 
         FOR_EACH(PARALLEL_INDEX_SCAN)
@@ -995,40 +1171,40 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 #define IFEXISTS(Structure, Arity, ...)                                 \
     CASE(IfExists, Structure, Arity)                                    \
         const auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
-        return evalIfExists(rel, cur, shadow, ctxt);                    \
+        return evalIfExists<TracePolicy>(rel, cur, shadow, ctxt);       \
     ESAC(IfExists)
 
         FOR_EACH(IFEXISTS)
 #undef IFEXISTS
 
-#define PARALLEL_IFEXISTS(Structure, Arity, ...)                        \
-    CASE(ParallelIfExists, Structure, Arity)                            \
-        const auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
-        return evalParallelIfExists(rel, cur, shadow, ctxt);            \
+#define PARALLEL_IFEXISTS(Structure, Arity, ...)                          \
+    CASE(ParallelIfExists, Structure, Arity)                              \
+        const auto& rel = *static_cast<RelType*>(shadow.getRelation());   \
+        return evalParallelIfExists<TracePolicy>(rel, cur, shadow, ctxt); \
     ESAC(ParallelIfExists)
 
         FOR_EACH(PARALLEL_IFEXISTS)
 #undef PARALLEL_IFEXISTS
 
-#define INDEX_IFEXISTS(Structure, Arity, ...)                 \
-    CASE(IndexIfExists, Structure, Arity)                     \
-        return evalIndexIfExists<RelType>(cur, shadow, ctxt); \
+#define INDEX_IFEXISTS(Structure, Arity, ...)                              \
+    CASE(IndexIfExists, Structure, Arity)                                  \
+        return evalIndexIfExists<TracePolicy, RelType>(cur, shadow, ctxt); \
     ESAC(IndexIfExists)
 
         FOR_EACH(INDEX_IFEXISTS)
 #undef INDEX_IFEXISTS
 
-#define PARALLEL_INDEX_IFEXISTS(Structure, Arity, ...)                  \
-    CASE(ParallelIndexIfExists, Structure, Arity)                       \
-        const auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
-        return evalParallelIndexIfExists(rel, cur, shadow, ctxt);       \
+#define PARALLEL_INDEX_IFEXISTS(Structure, Arity, ...)                         \
+    CASE(ParallelIndexIfExists, Structure, Arity)                              \
+        const auto& rel = *static_cast<RelType*>(shadow.getRelation());        \
+        return evalParallelIndexIfExists<TracePolicy>(rel, cur, shadow, ctxt); \
     ESAC(ParallelIndexIfExists)
 
         FOR_EACH(PARALLEL_INDEX_IFEXISTS)
 #undef PARALLEL_INDEX_IFEXISTS
 
         CASE(UnpackRecord)
-            RamDomain ref = execute(shadow.getExpr(), ctxt);
+            RamDomain ref = execute<TracePolicy>(shadow.getExpr(), ctxt);
 
             // check for nil
             if (ref == 0) {
@@ -1043,39 +1219,40 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
             ctxt[cur.getTupleId()] = tuple;
 
             // run nested part - using base class visitor
-            return execute(shadow.getNestedOperation(), ctxt);
+            return execute<TracePolicy>(shadow.getNestedOperation(), ctxt);
         ESAC(UnpackRecord)
 
-#define PARALLEL_AGGREGATE(Structure, Arity, ...)                       \
-    CASE(ParallelAggregate, Structure, Arity)                           \
-        const auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
-        return evalParallelAggregate(rel, cur, shadow, ctxt);           \
+#define PARALLEL_AGGREGATE(Structure, Arity, ...)                          \
+    CASE(ParallelAggregate, Structure, Arity)                              \
+        const auto& rel = *static_cast<RelType*>(shadow.getRelation());    \
+        return evalParallelAggregate<TracePolicy>(rel, cur, shadow, ctxt); \
     ESAC(ParallelAggregate)
 
         FOR_EACH(PARALLEL_AGGREGATE)
 #undef PARALLEL_AGGREGATE
 
-#define AGGREGATE(Structure, Arity, ...)                                                                  \
-    CASE(Aggregate, Structure, Arity)                                                                     \
-        const auto& rel = *static_cast<RelType*>(shadow.getRelation());                                   \
-        return evalAggregate(cur, *shadow.getCondition(), shadow.getExpr(), *shadow.getNestedOperation(), \
-                rel.scan(), ctxt);                                                                        \
+#define AGGREGATE(Structure, Arity, ...)                                                 \
+    CASE(Aggregate, Structure, Arity)                                                    \
+        const auto& rel = *static_cast<RelType*>(shadow.getRelation());                  \
+        return evalAggregate<TracePolicy>(cur, *shadow.getCondition(), shadow.getExpr(), \
+                *shadow.getNestedOperation(), rel.scan(), ctxt);                         \
     ESAC(Aggregate)
 
         FOR_EACH(AGGREGATE)
 #undef AGGREGATE
 
-#define PARALLEL_INDEX_AGGREGATE(Structure, Arity, ...)                \
-    CASE(ParallelIndexAggregate, Structure, Arity)                     \
-        return evalParallelIndexAggregate<RelType>(cur, shadow, ctxt); \
+#define PARALLEL_INDEX_AGGREGATE(Structure, Arity, ...)                         \
+    CASE(ParallelIndexAggregate, Structure, Arity)                              \
+        const auto& rel = *static_cast<RelType*>(shadow.getRelation());         \
+        return evalParallelIndexAggregate<TracePolicy>(rel, cur, shadow, ctxt); \
     ESAC(ParallelIndexAggregate)
 
         FOR_EACH(PARALLEL_INDEX_AGGREGATE)
 #undef PARALLEL_INDEX_AGGREGATE
 
-#define INDEX_AGGREGATE(Structure, Arity, ...)                 \
-    CASE(IndexAggregate, Structure, Arity)                     \
-        return evalIndexAggregate<RelType>(cur, shadow, ctxt); \
+#define INDEX_AGGREGATE(Structure, Arity, ...)                              \
+    CASE(IndexAggregate, Structure, Arity)                                  \
+        return evalIndexAggregate<TracePolicy, RelType>(cur, shadow, ctxt); \
     ESAC(IndexAggregate)
 
         FOR_EACH(INDEX_AGGREGATE)
@@ -1083,18 +1260,18 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 
         CASE(Break)
             // check condition
-            if (execute(shadow.getCondition(), ctxt)) {
+            if (execute<TracePolicy>(shadow.getCondition(), ctxt)) {
                 return false;
             }
-            return execute(shadow.getNestedOperation(), ctxt);
+            return execute<TracePolicy>(shadow.getNestedOperation(), ctxt);
         ESAC(Break)
 
         CASE(Filter)
             bool result = true;
             // check condition
-            if (execute(shadow.getCondition(), ctxt)) {
+            if (execute<TracePolicy>(shadow.getCondition(), ctxt)) {
                 // process nested
-                result = execute(shadow.getNestedOperation(), ctxt);
+                result = execute<TracePolicy>(shadow.getNestedOperation(), ctxt);
             }
 
             if (profileEnabled && frequencyCounterEnabled && !cur.getProfileText().empty()) {
@@ -1110,18 +1287,17 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 #define GUARDED_INSERT(Structure, Arity, ...)                     \
     CASE(GuardedInsert, Structure, Arity)                         \
         auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
-        return evalGuardedInsert(rel, shadow, ctxt);              \
+        return evalGuardedInsert<TracePolicy>(rel, shadow, ctxt); \
     ESAC(GuardedInsert)
 
         FOR_EACH(GUARDED_INSERT)
 #undef GUARDED_INSERT
 
-#define INSERT(Structure, Arity, ...)                                 \
-    CASE(Insert, Structure, Arity)                                    \
-        auto& rel = *static_cast<RelType*>(shadow.getRelation());     \
-        (*analyzer) << "INSERT_TARGET" << rel.getName() << std::endl; \
-        (*analyzer).parse();                                          \
-        return evalInsert(rel, shadow, ctxt);                         \
+#define INSERT(Structure, Arity, ...)                             \
+    CASE(Insert, Structure, Arity)                                \
+        auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
+        TRACE(emit(TraceOp::InsertTarget, rel.traceId));          \
+        return evalInsert<TracePolicy>(rel, shadow, ctxt);        \
     ESAC(Insert)
 
         FOR_EACH(INSERT)
@@ -1132,7 +1308,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                 if (shadow.getChild(i) == nullptr) {
                     ctxt.addReturnValue(0);
                 } else {
-                    ctxt.addReturnValue(execute(shadow.getChild(i), ctxt));
+                    ctxt.addReturnValue(execute<TracePolicy>(shadow.getChild(i), ctxt));
                 }
             }
             return true;
@@ -1140,7 +1316,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 
         CASE(Sequence)
             for (const auto& child : shadow.getChildren()) {
-                if (!execute(child.get(), ctxt)) {
+                if (!execute<TracePolicy>(child.get(), ctxt)) {
                     return false;
                 }
             }
@@ -1149,7 +1325,7 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 
         CASE(Parallel)
             for (const auto& child : shadow.getChildren()) {
-                if (!execute(child.get(), ctxt)) {
+                if (!execute<TracePolicy>(child.get(), ctxt)) {
                     return false;
                 }
             }
@@ -1158,42 +1334,41 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 
         CASE(Loop)
             resetIterationNumber();
-            while (execute(shadow.getChild(), ctxt)) {
+            while (execute<TracePolicy>(shadow.getChild(), ctxt)) {
                 incIterationNumber();
+                TRACE(progress.set_iteration(getIterationNumber()));
+                promoteHotQueries(shadow);
             }
             resetIterationNumber();
             return true;
         ESAC(Loop)
 
         CASE(Exit)
-            return !execute(shadow.getChild(), ctxt);
+            return !execute<TracePolicy>(shadow.getChild(), ctxt);
         ESAC(Exit)
 
         CASE(LogRelationTimer)
             Logger logger(cur.getMessage(), getIterationNumber(),
                     std::bind(&RelationWrapper::size, shadow.getRelation()));
-            return execute(shadow.getChild(), ctxt);
+            return execute<TracePolicy>(shadow.getChild(), ctxt);
         ESAC(LogRelationTimer)
 
         CASE(LogTimer)
             Logger logger(cur.getMessage(), getIterationNumber());
-            return execute(shadow.getChild(), ctxt);
+            return execute<TracePolicy>(shadow.getChild(), ctxt);
         ESAC(LogTimer)
 
         CASE(DebugInfo)
-            std::string message = cur.getMessage();
-            SignalHandler::instance()->setMsg(message.c_str());
-            std::replace(message.begin(), message.end(), '\n', ' ');
-            (*analyzer) << "DEBUG" << message << std::endl;
-            (*analyzer).parse();
-            return execute(shadow.getChild(), ctxt);
+            UNTRACED_SUBTREE
+            SignalHandler::instance()->setMsg(cur.getMessage().c_str());
+            TRACE(emit(TraceOp::Debug, shadow.getRuleId()));
+            return execute<TracePolicy>(shadow.getChild(), ctxt);
         ESAC(DebugInfo)
 
 #define CLEAR(Structure, Arity, ...)                              \
     CASE(Clear, Structure, Arity)                                 \
         auto& rel = *static_cast<RelType*>(shadow.getRelation()); \
-        (*analyzer) << "CLEAR" << rel.getName() << std::endl;     \
-        (*analyzer).parse();                                      \
+        TRACE(emit(TraceOp::Clear, rel.traceId));                 \
         rel.__purge();                                            \
         return true;                                              \
     ESAC(Clear)
@@ -1202,7 +1377,18 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 #undef CLEAR
 
         CASE(Call)
-            execute(subroutine[shadow.getSubroutineId()].get(), ctxt);
+            // Strata are the subroutines "stratum_<i>" called from main; returning from one ends the stratum.
+            [[maybe_unused]] uint32_t stratum = NO_ID;
+            if constexpr (TracePolicy::enabled) {
+                if (cur.getName().rfind("stratum_", 0) == 0) {
+                    stratum = static_cast<uint32_t>(std::stoul(cur.getName().substr(8)));
+                    analyzer->progress.enter_stratum(stratum);
+                }
+            }
+            execute<TracePolicy>(subroutine[shadow.getSubroutineId()].get(), ctxt);
+            if constexpr (TracePolicy::enabled) {
+                if (stratum != NO_ID) analyzer->emit(TraceOp::Stratum, stratum);
+            }
             return true;
         ESAC(Call)
 
@@ -1214,14 +1400,14 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
         ESAC(LogSize)
 
         CASE(IO)
+            UNTRACED_SUBTREE
             const auto& directive = cur.getDirectives();
             const std::string& op = cur.get("operation");
             auto& rel = *shadow.getRelation();
 
             if (op == "input") {
                 try {
-                    (*analyzer) << "INSERT_TARGET" << rel.getName() << std::endl;
-                    analyzer->parse();
+                    TRACE(begin_input(rel.traceId));
                     std::cout << "starting input from file...." << std::endl;
                     IOSystem::getInstance()
                             .getReader(directive, getSymbolTable(), getRecordTable())
@@ -1229,11 +1415,11 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                 } catch (std::exception& e) {
                     std::cerr << "Error loading data: " << e.what() << "\n";
                 }
+                TRACE(end_input());
                 return true;
             } else if (op == "output" || op == "printsize") {
                 try {
-                    (*analyzer) << "OUTPUT" << rel.getName() << std::endl;
-                    analyzer->parse();
+                    TRACE(emit(TraceOp::Output, rel.traceId));
                     IOSystem::getInstance()
                             .getWriter(directive, getSymbolTable(), getRecordTable())
                             ->writeAll(rel);
@@ -1249,12 +1435,13 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
         ESAC(IO)
 
         CASE(Query)
+            UNTRACED_SUBTREE
             ViewContext* viewContext = shadow.getViewContext();
 
             // Execute view-free operations in outer filter if any.
             auto& viewFreeOps = viewContext->getOuterFilterViewFreeOps();
             for (auto& op : viewFreeOps) {
-                if (!execute(op.get(), ctxt)) {
+                if (!execute<TracePolicy>(op.get(), ctxt)) {
                     return true;
                 }
             }
@@ -1263,16 +1450,12 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
             auto& viewsForOuter = viewContext->getViewInfoForFilter();
             for (auto& info : viewsForOuter) {
                 ctxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
-                (*analyzer) << "INFO_ORDER" << info[2]
-                            << (*getRelationHandle(info[0])).getIndexOrder(info[1]).toStdString()
-                            << std::endl;
-                (*analyzer).parse();
             }
 
             // Execute outer filter operation.
             auto& viewOps = viewContext->getOuterFilterViewOps();
             for (auto& op : viewOps) {
-                if (!execute(op.get(), ctxt)) {
+                if (!execute<TracePolicy>(op.get(), ctxt)) {
                     return true;
                 }
             }
@@ -1284,12 +1467,21 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
                 auto& viewsForNested = viewContext->getViewInfoForNested();
                 for (auto& info : viewsForNested) {
                     ctxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
-                    (*analyzer) << "INFO_ORDER" << info[2]
-                                << (*getRelationHandle(info[0])).getIndexOrder(0).toStdString() << std::endl;
-                    (*analyzer).parse();
                 }
             }
-            execute(shadow.getChild(), ctxt);
+            if constexpr (!TracePolicy::enabled) {
+                if (shadow.getClosure()) {
+                    shadow.getClosure()(ctxt);
+                    return true;
+                }
+                if (adaptiveDispatch) {
+                    const auto start = std::chrono::steady_clock::now();
+                    execute<TracePolicy>(shadow.getChild(), ctxt);
+                    shadow.addElapsed(std::chrono::steady_clock::now() - start);
+                    return true;
+                }
+            }
+            execute<TracePolicy>(shadow.getChild(), ctxt);
             return true;
         ESAC(Query)
 
@@ -1311,9 +1503,10 @@ RamDomain Engine::execute(const Node* node, Context& ctxt) {
 
 #undef EVAL_CHILD
 #undef DEBUG
+#undef UNTRACED_SUBTREE
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalExistenceCheck(const ExistenceCheck& shadow, Context& ctxt) {
     constexpr std::size_t Arity = Rel::Arity;
     std::size_t viewPos = shadow.getViewId();
@@ -1333,15 +1526,12 @@ RamDomain Engine::evalExistenceCheck(const ExistenceCheck& shadow, Context& ctxt
         }
         /* Generic */
         for (const auto& expr : superInfo.exprFirst) {
-            tuple[expr.first] = execute(expr.second.get(), ctxt);
+            tuple[expr.first] = execute<TracePolicy>(expr.second.get(), ctxt);
         }
         bool ans = Rel::castView(ctxt.getView(viewPos))->contains(tuple);
         if (ans) {
-            (*analyzer) << "EXIST_TARGET" << shadow.getRelationName() << std::endl;
-            analyzer->parse();
-            (*analyzer) << "SCAN_INDEX" << shadow.getViewId() << modified_souffle::tupleToString(tuple)
-                        << std::endl;
-            analyzer->parse();
+            TRACE(emit(TraceOp::ExistTarget, shadow.getRelationId()));
+            TRACE(emit(TraceOp::ScanIndex, 0, ctxt.getViewOrder(viewPos), tuple.data(), Arity));
         }
         return ans;
     }
@@ -1359,14 +1549,14 @@ RamDomain Engine::evalExistenceCheck(const ExistenceCheck& shadow, Context& ctxt
     }
     /* Generic */
     for (const auto& expr : superInfo.exprFirst) {
-        low[expr.first] = execute(expr.second.get(), ctxt);
+        low[expr.first] = execute<TracePolicy>(expr.second.get(), ctxt);
         high[expr.first] = low[expr.first];
     }
 
     return Rel::castView(ctxt.getView(viewPos))->contains(low, high);
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalProvenanceExistenceCheck(const ProvenanceExistenceCheck& shadow, Context& ctxt) {
     // construct the pattern tuple
     constexpr std::size_t Arity = Rel::Arity;
@@ -1387,7 +1577,7 @@ RamDomain Engine::evalProvenanceExistenceCheck(const ProvenanceExistenceCheck& s
     for (const auto& expr : superInfo.exprFirst) {
         assert(expr.second.get() != nullptr &&
                 "ProvenanceExistenceCheck should always be specified for payload");
-        low[expr.first] = execute(expr.second.get(), ctxt);
+        low[expr.first] = execute<TracePolicy>(expr.second.get(), ctxt);
         high[expr.first] = low[expr.first];
     }
 
@@ -1408,34 +1598,81 @@ RamDomain Engine::evalProvenanceExistenceCheck(const ProvenanceExistenceCheck& s
     }
 
     // check whether the height is less than the current height
-    return (*equalRange.begin())[Arity - 1] <= execute(shadow.getChild(), ctxt);
+    return (*equalRange.begin())[Arity - 1] <= execute<TracePolicy>(shadow.getChild(), ctxt);
 }
 
-template <typename Rel>
+template <typename TracePolicy, std::size_t Arity, typename Iter>
+void Engine::evalBlocks(const Scan& shadow, std::size_t tupleId, const Iter& range, Context& ctxt) {
+    constexpr std::size_t capacity =
+            Arity == 0 ? BLOCK_SIZE : std::min(BLOCK_SIZE, BLOCK_BYTES / (Arity * sizeof(RamDomain)));
+    // Tuples are copied: an iterator may hand out the same buffer for every tuple.
+    std::array<souffle::Tuple<RamDomain, Arity>, capacity> block;
+    // Positions in the block of the tuples that passed every filter so far.
+    std::array<uint32_t, capacity> live;
+    std::size_t size = 0;
+
+    auto flush = [&]() {
+        std::size_t count = size;
+        for (std::size_t i = 0; i < count; ++i) {
+            live[i] = static_cast<uint32_t>(i);
+        }
+        for (const Node* condition : shadow.getBlockFilters()) {
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                ctxt[tupleId] = block[live[i]].data();
+                if (execute<TracePolicy>(condition, ctxt)) {
+                    live[kept++] = live[i];
+                }
+            }
+            count = kept;
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            ctxt[tupleId] = block[live[i]].data();
+            execute<TracePolicy>(shadow.getBlockInsert(), ctxt);
+        }
+        size = 0;
+    };
+
+    for (const auto& tuple : range) {
+        std::copy_n(tuple.data(), Arity, block[size].data());
+        if (++size == capacity) {
+            flush();
+        }
+    }
+    flush();
+}
+
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalScan(const Rel& rel, const ram::Scan& cur, const Scan& shadow, Context& ctxt) {
+    // Tuples are traced as stored in the main index; the analyzer decodes them by order id.
+    if constexpr (!TracePolicy::enabled) {
+        if (shadow.getBlockInsert() != nullptr) {
+            evalBlocks<TracePolicy, Rel::Arity>(shadow, cur.getTupleId(), rel.scan(), ctxt);
+            return true;
+        }
+    }
+    const uint32_t order = TracePolicy::enabled ? rel.traceOrders[0] : 0;
     for (const auto& tuple : rel.scan()) {
-        (*analyzer) << "SCAN_ORDER" << rel.getIndexOrder(0).toStdString() << std::endl;
-        (*analyzer).parse();
         ctxt[cur.getTupleId()] = tuple.data();
-        (*analyzer) << "SCAN_EVAL" << modified_souffle::tupleToString(tuple) << std::endl;
-        (*analyzer).parse();
-        if (!execute(shadow.getNestedOperation(), ctxt)) {
+        TRACE(emit(TraceOp::ScanEval, 0, order, tuple.data(), Rel::Arity));
+        if (!execute<TracePolicy>(shadow.getNestedOperation(), ctxt)) {
             break;
         }
     }
-    (*analyzer) << "END_SCAN"
-                << "_" << std::endl;
-    (*analyzer).parse();
+    TRACE(emit(TraceOp::EndScan));
     return true;
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalParallelScan(
         const Rel& rel, const ram::ParallelScan& cur, const ParallelScan& shadow, Context& ctxt) {
     auto viewContext = shadow.getViewContext();
 
     auto pStream = rel.partitionScan(numOfThreads);
+    const uint32_t order = TracePolicy::enabled ? rel.traceOrders[0] : 0;
 
+    // Every partition is traced into its own lane; lanes are replayed in partition order afterwards.
+    TRACE(begin_lanes(pStream.size()));
     PARALLEL_START
         Context newCtxt(ctxt);
         auto viewInfo = viewContext->getViewInfoForNested();
@@ -1443,18 +1680,29 @@ RamDomain Engine::evalParallelScan(
             newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
         }
         pfor(auto it = pStream.begin(); it < pStream.end(); it++) {
+            TRACE(enter_lane(it - pStream.begin()));
+            if constexpr (!TracePolicy::enabled) {
+                if (shadow.getBlockInsert() != nullptr) {
+                    evalBlocks<TracePolicy, Rel::Arity>(shadow, cur.getTupleId(), *it, newCtxt);
+                    continue;
+                }
+            }
             for (const auto& tuple : *it) {
                 newCtxt[cur.getTupleId()] = tuple.data();
-                if (!execute(shadow.getNestedOperation(), newCtxt)) {
+                TRACE(emit(TraceOp::ScanEval, 0, order, tuple.data(), Rel::Arity));
+                if (!execute<TracePolicy>(shadow.getNestedOperation(), newCtxt)) {
                     break;
                 }
             }
         }
+        TRACE(leave_lane());
     PARALLEL_END
+    TRACE(merge_lanes());
+    TRACE(emit(TraceOp::EndScan));
     return true;
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalIndexScan(const ram::IndexScan& cur, const IndexScan& shadow, Context& ctxt) {
     constexpr std::size_t Arity = Rel::Arity;
     // create pattern tuple for range query
@@ -1465,22 +1713,26 @@ RamDomain Engine::evalIndexScan(const ram::IndexScan& cur, const IndexScan& shad
 
     std::size_t viewId = shadow.getViewId();
     auto view = Rel::castView(ctxt.getView(viewId));
+    if constexpr (!TracePolicy::enabled) {
+        if (shadow.getBlockInsert() != nullptr) {
+            evalBlocks<TracePolicy, Arity>(shadow, cur.getTupleId(), view->range(low, high), ctxt);
+            return true;
+        }
+    }
+    const uint32_t order = TracePolicy::enabled ? ctxt.getViewOrder(viewId) : 0;
     // conduct range query
     for (const auto& tuple : view->range(low, high)) {
         ctxt[cur.getTupleId()] = tuple.data();
-        (*analyzer) << "SCAN_INDEX" << viewId << modified_souffle::tupleToString(tuple) << std::endl;
-        (*analyzer).parse();
-        if (!execute(shadow.getNestedOperation(), ctxt)) {
+        TRACE(emit(TraceOp::ScanIndex, 0, order, tuple.data(), Arity));
+        if (!execute<TracePolicy>(shadow.getNestedOperation(), ctxt)) {
             break;
         }
     }
-    (*analyzer) << "END_SCAN"
-                << "_" << std::endl;
-    (*analyzer).parse();
+    TRACE(emit(TraceOp::EndScan));
     return true;
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalParallelIndexScan(
         const Rel& rel, const ram::ParallelIndexScan& cur, const ParallelIndexScan& shadow, Context& ctxt) {
     auto viewContext = shadow.getViewContext();
@@ -1494,6 +1746,10 @@ RamDomain Engine::evalParallelIndexScan(
 
     std::size_t indexPos = shadow.getViewId();
     auto pStream = rel.partitionRange(indexPos, low, high, numOfThreads);
+    // The partitions come straight from the index, so the tuples are traced in that index's order.
+    const uint32_t order = TracePolicy::enabled ? rel.traceOrders[indexPos] : 0;
+
+    TRACE(begin_lanes(pStream.size()));
     PARALLEL_START
         Context newCtxt(ctxt);
         auto viewInfo = viewContext->getViewInfoForNested();
@@ -1501,57 +1757,72 @@ RamDomain Engine::evalParallelIndexScan(
             newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
         }
         pfor(auto it = pStream.begin(); it < pStream.end(); it++) {
+            TRACE(enter_lane(it - pStream.begin()));
+            if constexpr (!TracePolicy::enabled) {
+                if (shadow.getBlockInsert() != nullptr) {
+                    evalBlocks<TracePolicy, Rel::Arity>(shadow, cur.getTupleId(), *it, newCtxt);
+                    continue;
+                }
+            }
             for (const auto& tuple : *it) {
                 newCtxt[cur.getTupleId()] = tuple.data();
-                if (!execute(shadow.getNestedOperation(), newCtxt)) {
+                TRACE(emit(TraceOp::ScanEval, 0, order, tuple.data(), Arity));
+                if (!execute<TracePolicy>(shadow.getNestedOperation(), newCtxt)) {
                     break;
                 }
             }
         }
+        TRACE(leave_lane());
     PARALLEL_END
+    TRACE(merge_lanes());
+    TRACE(emit(TraceOp::EndScan));
     return true;
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalIfExists(
         const Rel& rel, const ram::IfExists& cur, const IfExists& shadow, Context& ctxt) {
     // use simple iterator
     for (const auto& tuple : rel.scan()) {
         ctxt[cur.getTupleId()] = tuple.data();
-        if (execute(shadow.getCondition(), ctxt)) {
-            execute(shadow.getNestedOperation(), ctxt);
+        if (execute<TracePolicy>(shadow.getCondition(), ctxt)) {
+            execute<TracePolicy>(shadow.getNestedOperation(), ctxt);
             break;
         }
     }
     return true;
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalParallelIfExists(
         const Rel& rel, const ram::ParallelIfExists& cur, const ParallelIfExists& shadow, Context& ctxt) {
     auto viewContext = shadow.getViewContext();
 
     auto pStream = rel.partitionScan(numOfThreads);
     auto viewInfo = viewContext->getViewInfoForNested();
+    TRACE(begin_lanes(pStream.size()));
     PARALLEL_START
         Context newCtxt(ctxt);
         for (const auto& info : viewInfo) {
             newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
         }
         pfor(auto it = pStream.begin(); it < pStream.end(); it++) {
+            TRACE(enter_lane(it - pStream.begin()));
             for (const auto& tuple : *it) {
                 newCtxt[cur.getTupleId()] = tuple.data();
-                if (execute(shadow.getCondition(), newCtxt)) {
-                    execute(shadow.getNestedOperation(), newCtxt);
+                if (execute<TracePolicy>(shadow.getCondition(), newCtxt)) {
+                    execute<TracePolicy>(shadow.getNestedOperation(), newCtxt);
                     break;
                 }
             }
         }
+        TRACE(leave_lane());
     PARALLEL_END
+    TRACE(merge_lanes());
     return true;
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalIndexIfExists(
         const ram::IndexIfExists& cur, const IndexIfExists& shadow, Context& ctxt) {
     constexpr std::size_t Arity = Rel::Arity;
@@ -1565,15 +1836,15 @@ RamDomain Engine::evalIndexIfExists(
 
     for (const auto& tuple : view->range(low, high)) {
         ctxt[cur.getTupleId()] = tuple.data();
-        if (execute(shadow.getCondition(), ctxt)) {
-            execute(shadow.getNestedOperation(), ctxt);
+        if (execute<TracePolicy>(shadow.getCondition(), ctxt)) {
+            execute<TracePolicy>(shadow.getNestedOperation(), ctxt);
             break;
         }
     }
     return true;
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalParallelIndexIfExists(const Rel& rel, const ram::ParallelIndexIfExists& cur,
         const ParallelIndexIfExists& shadow, Context& ctxt) {
     auto viewContext = shadow.getViewContext();
@@ -1590,37 +1861,31 @@ RamDomain Engine::evalParallelIndexIfExists(const Rel& rel, const ram::ParallelI
     std::size_t indexPos = shadow.getViewId();
     auto pStream = rel.partitionRange(indexPos, low, high, numOfThreads);
 
+    TRACE(begin_lanes(pStream.size()));
     PARALLEL_START
         Context newCtxt(ctxt);
         for (const auto& info : viewInfo) {
             newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
         }
         pfor(auto it = pStream.begin(); it < pStream.end(); it++) {
+            TRACE(enter_lane(it - pStream.begin()));
             for (const auto& tuple : *it) {
                 newCtxt[cur.getTupleId()] = tuple.data();
-                if (execute(shadow.getCondition(), newCtxt)) {
-                    execute(shadow.getNestedOperation(), newCtxt);
+                if (execute<TracePolicy>(shadow.getCondition(), newCtxt)) {
+                    execute<TracePolicy>(shadow.getNestedOperation(), newCtxt);
                     break;
                 }
             }
         }
+        TRACE(leave_lane());
     PARALLEL_END
+    TRACE(merge_lanes());
 
     return true;
 }
 
-template <typename Aggregate, typename Iter>
-RamDomain Engine::evalAggregate(const Aggregate& aggregate, const Node& filter, const Node* expression,
-        const Node& nestedOperation, const Iter& ranges, Context& ctxt) {
-    bool shouldRunNested = false;
-
-    // initialize result
-    RamDomain res = 0;
-
-    // Use for calculating mean.
-    std::pair<RamFloat, RamFloat> accumulateMean;
-
-    switch (aggregate.getFunction()) {
+Engine::AggregateAccumulator::AggregateAccumulator(AggregateOp op) {
+    switch (op) {
         case AggregateOp::MIN: res = ramBitCast(MAX_RAM_SIGNED); break;
         case AggregateOp::UMIN: res = ramBitCast(MAX_RAM_UNSIGNED); break;
         case AggregateOp::FMIN: res = ramBitCast(MAX_RAM_FLOAT); break;
@@ -1631,36 +1896,75 @@ RamDomain Engine::evalAggregate(const Aggregate& aggregate, const Node& filter,
 
         case AggregateOp::SUM:
             res = ramBitCast(static_cast<RamSigned>(0));
-            shouldRunNested = true;
+            runNested = true;
             break;
         case AggregateOp::USUM:
             res = ramBitCast(static_cast<RamUnsigned>(0));
-            shouldRunNested = true;
+            runNested = true;
             break;
         case AggregateOp::FSUM:
             res = ramBitCast(static_cast<RamFloat>(0));
-            shouldRunNested = true;
+            runNested = true;
             break;
 
-        case AggregateOp::MEAN:
+        case AggregateOp::MEAN: res = 0; break;
+
+        case AggregateOp::COUNT:
             res = 0;
-            accumulateMean = {0, 0};
+            runNested = true;
+            break;
+    }
+}
+
+void Engine::AggregateAccumulator::combine(AggregateOp op, const AggregateAccumulator& other) {
+    runNested = runNested || other.runNested;
+    switch (op) {
+        case AggregateOp::MIN: res = std::min(res, other.res); break;
+        case AggregateOp::FMIN:
+            res = ramBitCast(std::min(ramBitCast<RamFloat>(res), ramBitCast<RamFloat>(other.res)));
+            break;
+        case AggregateOp::UMIN:
+            res = ramBitCast(std::min(ramBitCast<RamUnsigned>(res), ramBitCast<RamUnsigned>(other.res)));
+            break;
+
+        case AggregateOp::MAX: res = std::max(res, other.res); break;
+        case AggregateOp::FMAX:
+            res = ramBitCast(std::max(ramBitCast<RamFloat>(res), ramBitCast<RamFloat>(other.res)));
+            break;
+        case AggregateOp::UMAX:
+            res = ramBitCast(std::max(ramBitCast<RamUnsigned>(res), ramBitCast<RamUnsigned>(other.res)));
             break;
 
+        // Partial sums and counts are combined with the same operation as the tuples, so
+        // integer results do not depend on how the relation was partitioned.
         case AggregateOp::COUNT:
-            res = 0;
-            shouldRunNested = true;
+        case AggregateOp::SUM: res += other.res; break;
+        case AggregateOp::FSUM:
+            res = ramBitCast(ramBitCast<RamFloat>(res) + ramBitCast<RamFloat>(other.res));
+            break;
+        case AggregateOp::USUM:
+            res = ramBitCast(ramBitCast<RamUnsigned>(res) + ramBitCast<RamUnsigned>(other.res));
+            break;
+
+        case AggregateOp::MEAN:
+            mean.first += other.mean.first;
+            mean.second += other.mean.second;
             break;
     }
+}
 
+template <typename TracePolicy, typename Aggregate, typename Iter>
+void Engine::accumulateAggregate(const Aggregate& aggregate, const Node& filter, const Node* expression,
+        const Iter& ranges, AggregateAccumulator& acc, Context& ctxt) {
+    RamDomain& res = acc.res;
     for (const auto& tuple : ranges) {
         ctxt[aggregate.getTupleId()] = tuple.data();
 
-        if (!execute(&filter, ctxt)) {
+        if (!execute<TracePolicy>(&filter, ctxt)) {
             continue;
         }
 
-        shouldRunNested = true;
+        acc.runNested = true;
 
         // count is a special case.
         if (aggregate.getFunction() == AggregateOp::COUNT) {
@@ -1670,7 +1974,7 @@ RamDomain Engine::evalAggregate(const Aggregate& aggregate, const Node& filter,
 
         // eval target expression
         assert(expression);  // only case where this is null is `COUNT`
-        RamDomain val = execute(expression, ctxt);
+        RamDomain val = execute<TracePolicy>(expression, ctxt);
 
         switch (aggregate.getFunction()) {
             case AggregateOp::MIN: res = std::min(res, val); break;
@@ -1698,16 +2002,21 @@ RamDomain Engine::evalAggregate(const Aggregate& aggregate, const Node& filter,
                 break;
 
             case AggregateOp::MEAN:
-                accumulateMean.first += ramBitCast<RamFloat>(val);
-                accumulateMean.second++;
+                acc.mean.first += ramBitCast<RamFloat>(val);
+                acc.mean.second++;
                 break;
 
             case AggregateOp::COUNT: fatal("This should never be executed");
         }
     }
+}
 
-    if (aggregate.getFunction() == AggregateOp::MEAN && accumulateMean.second != 0) {
-        res = ramBitCast(accumulateMean.first / accumulateMean.second);
+template <typename TracePolicy, typename Aggregate>
+RamDomain Engine::finishAggregate(const Aggregate& aggregate, const Node& nestedOperation,
+        const AggregateAccumulator& acc, Context& ctxt) {
+    RamDomain res = acc.res;
+    if (aggregate.getFunction() == AggregateOp::MEAN && acc.mean.second != 0) {
+        res = ramBitCast(acc.mean.first / acc.mean.second);
     }
 
     // write result to environment
@@ -1715,38 +2024,66 @@ RamDomain Engine::evalAggregate(const Aggregate& aggregate, const Node& filter,
     tuple[0] = res;
     ctxt[aggregate.getTupleId()] = tuple.data();
 
-    if (!shouldRunNested) {
+    if (!acc.runNested) {
         return true;
     } else {
-        return execute(&nestedOperation, ctxt);
+        return execute<TracePolicy>(&nestedOperation, ctxt);
     }
 }
-template <typename Rel>
-RamDomain Engine::evalParallelAggregate(
-        const Rel& rel, const ram::ParallelAggregate& cur, const ParallelAggregate& shadow, Context& ctxt) {
-    // TODO (rdowavic): make parallel
-    auto viewContext = shadow.getViewContext();
 
-    Context newCtxt(ctxt);
-    auto viewInfo = viewContext->getViewInfoForNested();
-    for (const auto& info : viewInfo) {
-        newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
-    }
-    return evalAggregate(
-            cur, *shadow.getCondition(), shadow.getExpr(), *shadow.getNestedOperation(), rel.scan(), newCtxt);
+template <typename TracePolicy, typename Aggregate, typename Iter>
+RamDomain Engine::evalAggregate(const Aggregate& aggregate, const Node& filter, const Node* expression,
+        const Node& nestedOperation, const Iter& ranges, Context& ctxt) {
+    AggregateAccumulator acc(aggregate.getFunction());
+    accumulateAggregate<TracePolicy>(aggregate, filter, expression, ranges, acc, ctxt);
+    return finishAggregate<TracePolicy>(aggregate, nestedOperation, acc, ctxt);
 }
 
-template <typename Rel>
-RamDomain Engine::evalParallelIndexAggregate(
-        const ram::ParallelIndexAggregate& cur, const ParallelIndexAggregate& shadow, Context& ctxt) {
-    // TODO (rdowavic): make parallel
-    auto viewContext = shadow.getViewContext();
+template <typename TracePolicy, typename Aggregate, typename Shadow, typename Partitions>
+RamDomain Engine::evalPartitionedAggregate(
+        const Aggregate& aggregate, const Shadow& shadow, const Partitions& partitions, Context& ctxt) {
+    auto viewInfo = shadow.getViewContext()->getViewInfoForNested();
+    std::vector<AggregateAccumulator> partials(partitions.size(), AggregateAccumulator(aggregate.getFunction()));
+
+    // Every partition is reduced on its own and traced into its own lane.
+    TRACE(begin_lanes(partitions.size()));
+    PARALLEL_START
+        Context newCtxt(ctxt);
+        for (const auto& info : viewInfo) {
+            newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
+        }
+        pfor(auto it = partitions.begin(); it < partitions.end(); it++) {
+            TRACE(enter_lane(it - partitions.begin()));
+            accumulateAggregate<TracePolicy>(aggregate, *shadow.getCondition(), shadow.getExpr(), *it,
+                    partials[it - partitions.begin()], newCtxt);
+        }
+        TRACE(leave_lane());
+    PARALLEL_END
+    TRACE(merge_lanes());
+
+    // Combining in partition order rather than completion order keeps the result deterministic.
+    AggregateAccumulator acc(aggregate.getFunction());
+    for (const auto& partial : partials) {
+        acc.combine(aggregate.getFunction(), partial);
+    }
 
     Context newCtxt(ctxt);
-    auto viewInfo = viewContext->getViewInfoForNested();
     for (const auto& info : viewInfo) {
         newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
     }
+    return finishAggregate<TracePolicy>(aggregate, *shadow.getNestedOperation(), acc, newCtxt);
+}
+
+template <typename TracePolicy, typename Rel>
+RamDomain Engine::evalParallelAggregate(
+        const Rel& rel, const ram::ParallelAggregate& cur, const ParallelAggregate& shadow, Context& ctxt) {
+    auto pStream = rel.partitionScan(numOfThreads);
+    return evalPartitionedAggregate<TracePolicy>(cur, shadow, pStream, ctxt);
+}
+
+template <typename TracePolicy, typename Rel>
+RamDomain Engine::evalParallelIndexAggregate(const Rel& rel, const ram::ParallelIndexAggregate& cur,
+        const ParallelIndexAggregate& shadow, Context& ctxt) {
     // init temporary tuple for this level
     constexpr std::size_t Arity = Rel::Arity;
     const auto& superInfo = shadow.getSuperInst();
@@ -1755,14 +2092,12 @@ RamDomain Engine::evalParallelIndexAggregate(
     souffle::Tuple<RamDomain, Arity> high;
     CAL_SEARCH_BOUND(superInfo, low, high);
 
-    std::size_t viewId = shadow.getViewId();
-    auto view = Rel::castView(newCtxt.getView(viewId));
-
-    return evalAggregate(cur, *shadow.getCondition(), shadow.getExpr(), *shadow.getNestedOperation(),
-            view->range(low, high), newCtxt);
+    std::size_t indexPos = shadow.getViewId();
+    auto pStream = rel.partitionRange(indexPos, low, high, numOfThreads);
+    return evalPartitionedAggregate<TracePolicy>(cur, shadow, pStream, ctxt);
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalIndexAggregate(
         const ram::IndexAggregate& cur, const IndexAggregate& shadow, Context& ctxt) {
     // init temporary tuple for this level
@@ -1775,11 +2110,11 @@ RamDomain Engine::evalIndexAggregate(
     std::size_t viewId = shadow.getViewId();
     auto view = Rel::castView(ctxt.getView(viewId));
 
-    return evalAggregate(cur, *shadow.getCondition(), shadow.getExpr(), *shadow.getNestedOperation(),
-            view->range(low, high), ctxt);
+    return evalAggregate<TracePolicy>(cur, *shadow.getCondition(), shadow.getExpr(),
+            *shadow.getNestedOperation(), view->range(low, high), ctxt);
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalInsert(Rel& rel, const Insert& shadow, Context& ctxt) {
     constexpr std::size_t Arity = Rel::Arity;
     const auto& superInfo = shadow.getSuperInst();
@@ -1792,19 +2127,28 @@ RamDomain Engine::evalInsert(Rel& rel, const Insert& shadow, Context& ctxt) {
     }
     /* Generic */
     for (const auto& expr : superInfo.exprFirst) {
-        tuple[expr.first] = execute(expr.second.get(), ctxt);
+        tuple[expr.first] = execute<TracePolicy>(expr.second.get(), ctxt);
     }
-    (*analyzer) << "INSERT tuple:" << modified_souffle::tupleToString(tuple) << std::endl;
-    (*analyzer).parse();
-
     // insert in target relation
+    if constexpr (TracePolicy::enabled) {
+        if (traceNewTuples) {
+            // The tuple is dropped before it reaches the analyzer if it already was in the relation
+            if (rel.insert(tuple)) {
+                analyzer->emit(TraceOp::Insert, 0, 0, tuple.data(), Arity);
+            } else {
+                analyzer->emit(TraceOp::Redundant);
+            }
+            return true;
+        }
+        analyzer->emit(TraceOp::Insert, 0, 0, tuple.data(), Arity);
+    }
     rel.insert(tuple);
     return true;
 }
 
-template <typename Rel>
+template <typename TracePolicy, typename Rel>
 RamDomain Engine::evalGuardedInsert(Rel& rel, const GuardedInsert& shadow, Context& ctxt) {
-    if (!execute(shadow.getCondition(), ctxt)) {
+    if (!execute<TracePolicy>(shadow.getCondition(), ctxt)) {
         return true;
     }
 
@@ -1819,16 +2163,273 @@ RamDomain Engine::evalGuardedInsert(Rel& rel, const GuardedInsert& shadow, Conte
     }
     /* Generic */
     for (const auto& expr : superInfo.exprFirst) {
-        tuple[expr.first] = execute(expr.second.get(), ctxt);
-        (*analyzer) << tuple[expr.first] << "=" << getSymbolTable().decode(tuple[expr.first]) << std::endl;
-        (*analyzer).parse();
+        tuple[expr.first] = execute<TracePolicy>(expr.second.get(), ctxt);
     }
-    (*analyzer) << "INSERT eval guarded tuple:" << modified_souffle::tupleToString(tuple) << std::endl;
-    (*analyzer).parse();
-
     // insert in target relation
+    if constexpr (TracePolicy::enabled) {
+        if (traceNewTuples) {
+            // The tuple is dropped before it reaches the analyzer if it already was in the relation
+            if (rel.insert(tuple)) {
+                analyzer->emit(TraceOp::Insert, 0, 0, tuple.data(), Arity);
+            } else {
+                analyzer->emit(TraceOp::Redundant);
+            }
+            return true;
+        }
+        analyzer->emit(TraceOp::Insert, 0, 0, tuple.data(), Arity);
+    }
     rel.insert(tuple);
     return true;
 }
 
+Closure Engine::interpreted(const Node* node) {
+    return [this, node](Context& ctxt) -> RamDomain { return execute<NoTrace>(node, ctxt); };
+}
+
+void Engine::promoteHotQueries(const Loop& loop) {
+    for (Query* query : loop.getQueries()) {
+        if (!query->getClosure() && query->getElapsed() >= hotQueryThreshold) {
+            query->setClosure(lower(query->getChild()));
+        }
+    }
+}
+
+Closure Engine::lower(const Node* node) {
+#define LOWER(Kind, Structure, Arity)        \
+    case (I_##Kind##_##Structure##_##Arity): \
+        return lower##Kind<Relation<Arity, interpreter::Structure>>(*static_cast<const Kind*>(node));
+#define LOWER_RELATIONAL(Structure, Arity, ...)  \
+    LOWER(Scan, Structure, Arity)                \
+    LOWER(ParallelScan, Structure, Arity)        \
+    LOWER(IndexScan, Structure, Arity)           \
+    LOWER(ParallelIndexScan, Structure, Arity)   \
+    LOWER(ExistenceCheck, Structure, Arity)      \
+    LOWER(Insert, Structure, Arity)
+
+    switch (node->getType()) {
+        case I_NumericConstant: {
+            const RamDomain constant = static_cast<const ram::NumericConstant*>(node->getShadow())->getConstant();
+            return [constant](Context&) -> RamDomain { return constant; };
+        }
+        case I_TupleElement: {
+            const auto& shadow = *static_cast<const TupleElement*>(node);
+            const std::size_t tupleId = shadow.getTupleId();
+            const std::size_t element = shadow.getElement();
+            return [tupleId, element](Context& ctxt) -> RamDomain { return ctxt[tupleId][element]; };
+        }
+        case I_True: return [](Context&) -> RamDomain { return true; };
+        case I_False: return [](Context&) -> RamDomain { return false; };
+        case I_Conjunction: {
+            const auto& shadow = *static_cast<const Conjunction*>(node);
+            Closure lhs = lower(shadow.getLhs());
+            Closure rhs = lower(shadow.getRhs());
+            return [lhs, rhs](Context& ctxt) -> RamDomain { return lhs(ctxt) && rhs(ctxt); };
+        }
+        case I_Negation: {
+            Closure child = lower(static_cast<const Negation*>(node)->getChild());
+            return [child](Context& ctxt) -> RamDomain { return !child(ctxt); };
+        }
+        case I_Constraint: return lowerConstraint(*static_cast<const Constraint*>(node));
+        case I_Filter: {
+            const auto& shadow = *static_cast<const Filter*>(node);
+            Closure condition = lower(shadow.getCondition());
+            Closure nested = lower(shadow.getNestedOperation());
+            return [condition, nested](Context& ctxt) -> RamDomain {
+                return condition(ctxt) ? nested(ctxt) : true;
+            };
+        }
+        FOR_EACH(LOWER_RELATIONAL)
+        default: break;
+    }
+    return interpreted(node);
+
+#undef LOWER_RELATIONAL
+#undef LOWER
+}
+
+Closure Engine::lowerConstraint(const Constraint& shadow) {
+    const auto& cur = *static_cast<const ram::Constraint*>(shadow.getShadow());
+    // clang-format off
+#define LOWER_COMPARE(ty, Compare)                                                \
+    return [lhs = lower(shadow.getLhs()), rhs = lower(shadow.getRhs())](         \
+            Context& ctxt) -> RamDomain {                                         \
+        return Compare<ty>()(ramBitCast<ty>(lhs(ctxt)), ramBitCast<ty>(rhs(ctxt))); \
+    }
+#define LOWER_EQ_NE(opCode, Compare)                                         \
+    case BinaryConstraintOp::   opCode: LOWER_COMPARE(RamDomain  , Compare); \
+    case BinaryConstraintOp::F##opCode: LOWER_COMPARE(RamFloat   , Compare);
+#define LOWER_ORDER(opCode, Compare)                                         \
+    case BinaryConstraintOp::   opCode: LOWER_COMPARE(RamSigned  , Compare); \
+    case BinaryConstraintOp::U##opCode: LOWER_COMPARE(RamUnsigned, Compare); \
+    case BinaryConstraintOp::F##opCode: LOWER_COMPARE(RamFloat   , Compare);
+    // clang-format on
+
+    switch (cur.getOperator()) {
+        LOWER_EQ_NE(EQ, std::equal_to)
+        LOWER_EQ_NE(NE, std::not_equal_to)
+
+        LOWER_ORDER(LT, std::less)
+        LOWER_ORDER(LE, std::less_equal)
+        LOWER_ORDER(GT, std::greater)
+        LOWER_ORDER(GE, std::greater_equal)
+
+        // String comparisons and pattern matching decode symbols; they stay on the switch.
+        default: return interpreted(&shadow);
+    }
+
+#undef LOWER_ORDER
+#undef LOWER_EQ_NE
+#undef LOWER_COMPARE
+}
+
+template <typename Rel>
+Closure Engine::lowerScan(const Scan& shadow) {
+    // Block pipelines already take the filters and the insert off the per-tuple path.
+    if (shadow.getBlockInsert() != nullptr) {
+        return interpreted(&shadow);
+    }
+    const std::size_t tupleId = static_cast<const ram::TupleOperation*>(shadow.getShadow())->getTupleId();
+    Closure nested = lower(shadow.getNestedOperation());
+    return [&shadow, tupleId, nested](Context& ctxt) -> RamDomain {
+        // The relation is looked up on every run, a swap exchanges the storage behind the handle.
+        const auto& rel = *static_cast<const Rel*>(shadow.getRelation());
+        for (const auto& tuple : rel.scan()) {
+            ctxt[tupleId] = tuple.data();
+            if (!nested(ctxt)) {
+                break;
+            }
+        }
+        return true;
+    };
+}
+
+template <typename Rel>
+Closure Engine::lowerParallelScan(const ParallelScan& shadow) {
+    if (shadow.getBlockInsert() != nullptr) {
+        return interpreted(&shadow);
+    }
+    const std::size_t tupleId = static_cast<const ram::TupleOperation*>(shadow.getShadow())->getTupleId();
+    Closure nested = lower(shadow.getNestedOperation());
+    return [this, &shadow, tupleId, nested](Context& ctxt) -> RamDomain {
+        const auto& rel = *static_cast<const Rel*>(shadow.getRelation());
+        auto pStream = rel.partitionScan(numOfThreads);
+        PARALLEL_START
+            Context newCtxt(ctxt);
+            for (const auto& info : shadow.getViewContext()->getViewInfoForNested()) {
+                newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
+            }
+            pfor(auto it = pStream.begin(); it < pStream.end(); it++) {
+                for (const auto& tuple : *it) {
+                    newCtxt[tupleId] = tuple.data();
+                    if (!nested(newCtxt)) {
+                        break;
+                    }
+                }
+            }
+        PARALLEL_END
+        return true;
+    };
+}
+
+template <typename Rel>
+Closure Engine::lowerIndexScan(const IndexScan& shadow) {
+    if (shadow.getBlockInsert() != nullptr) {
+        return interpreted(&shadow);
+    }
+    auto lowering = [this](const Node* node) { return lower(node); };
+    const auto& superInfo = shadow.getSuperInst();
+    LoweredPattern low(superInfo.first, superInfo.tupleFirst, superInfo.exprFirst, lowering);
+    LoweredPattern high(superInfo.second, superInfo.tupleSecond, superInfo.exprSecond, lowering);
+    const std::size_t tupleId = static_cast<const ram::TupleOperation*>(shadow.getShadow())->getTupleId();
+    const std::size_t viewId = shadow.getViewId();
+    Closure nested = lower(shadow.getNestedOperation());
+    return [low, high, tupleId, viewId, nested](Context& ctxt) -> RamDomain {
+        souffle::Tuple<RamDomain, Rel::Arity> from;
+        souffle::Tuple<RamDomain, Rel::Arity> to;
+        low.fill(from, ctxt);
+        high.fill(to, ctxt);
+        for (const auto& tuple : Rel::castView(ctxt.getView(viewId))->range(from, to)) {
+            ctxt[tupleId] = tuple.data();
+            if (!nested(ctxt)) {
+                break;
+            }
+        }
+        return true;
+    };
+}
+
+template <typename Rel>
+Closure Engine::lowerParallelIndexScan(const ParallelIndexScan& shadow) {
+    if (shadow.getBlockInsert() != nullptr) {
+        return interpreted(&shadow);
+    }
+    auto lowering = [this](const Node* node) { return lower(node); };
+    const auto& superInfo = shadow.getSuperInst();
+    LoweredPattern low(superInfo.first, superInfo.tupleFirst, superInfo.exprFirst, lowering);
+    LoweredPattern high(superInfo.second, superInfo.tupleSecond, superInfo.exprSecond, lowering);
+    const std::size_t tupleId = static_cast<const ram::TupleOperation*>(shadow.getShadow())->getTupleId();
+    Closure nested = lower(shadow.getNestedOperation());
+    return [this, &shadow, low, high, tupleId, nested](Context& ctxt) -> RamDomain {
+        souffle::Tuple<RamDomain, Rel::Arity> from;
+        souffle::Tuple<RamDomain, Rel::Arity> to;
+        low.fill(from, ctxt);
+        high.fill(to, ctxt);
+        const auto& rel = *static_cast<const Rel*>(shadow.getRelation());
+        auto pStream = rel.partitionRange(shadow.getViewId(), from, to, numOfThreads);
+        PARALLEL_START
+            Context newCtxt(ctxt);
+            for (const auto& info : shadow.getViewContext()->getViewInfoForNested()) {
+                newCtxt.createView(*getRelationHandle(info[0]), info[1], info[2]);
+            }
+            pfor(auto it = pStream.begin(); it < pStream.end(); it++) {
+                for (const auto& tuple : *it) {
+                    newCtxt[tupleId] = tuple.data();
+                    if (!nested(newCtxt)) {
+                        break;
+                    }
+                }
+            }
+        PARALLEL_END
+        return true;
+    };
+}
+
+template <typename Rel>
+Closure Engine::lowerExistenceCheck(const ExistenceCheck& shadow) {
+    const auto& superInfo = shadow.getSuperInst();
+    LoweredPattern pattern(superInfo.first, superInfo.tupleFirst, superInfo.exprFirst,
+            [this](const Node* node) { return lower(node); });
+    const std::size_t viewId = shadow.getViewId();
+    if (shadow.isTotalSearch()) {
+        return [pattern, viewId](Context& ctxt) -> RamDomain {
+            souffle::Tuple<RamDomain, Rel::Arity> tuple;
+            pattern.fill(tuple, ctxt);
+            return Rel::castView(ctxt.getView(viewId))->contains(tuple);
+        };
+    }
+    // Unbound columns range over the bounds of the second pattern, bound ones are equal in both.
+    const auto& upper = superInfo.second;
+    return [pattern, &upper, viewId](Context& ctxt) -> RamDomain {
+        souffle::Tuple<RamDomain, Rel::Arity> low;
+        souffle::Tuple<RamDomain, Rel::Arity> high;
+        pattern.fill(low, ctxt);
+        std::copy_n(upper.begin(), Rel::Arity, high.begin());
+        pattern.copyBound(low, high);
+        return Rel::castView(ctxt.getView(viewId))->contains(low, high);
+    };
+}
+
+template <typename Rel>
+Closure Engine::lowerInsert(const Insert& shadow) {
+    const auto& superInfo = shadow.getSuperInst();
+    LoweredPattern pattern(superInfo.first, superInfo.tupleFirst, superInfo.exprFirst,
+            [this](const Node* node) { return lower(node); });
+    return [&shadow, pattern](Context& ctxt) -> RamDomain {
+        souffle::Tuple<RamDomain, Rel::Arity> tuple;
+        pattern.fill(tuple, ctxt);
+        static_cast<Rel*>(shadow.getRelation())->insert(tuple);
+        return true;
+    };
+}
+
 }  // namespace souffle::interpreter
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "AggregateOp.h"
 #include "Global.h"
 #include "interpreter/Context.h"
 #include "interpreter/Generator.h"
@@ -30,11 +31,13 @@
 #include "souffle/SymbolTable.h"
 #include "souffle/utility/ContainerUtil.h"
 #include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <deque>
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #ifdef _OPENMP
 #include <omp.h>
@@ -55,6 +58,8 @@ class Engine {
 
 public:
     Engine(ram::TranslationUnit& tUnit, const std::string& analyzer_output_path, bool is_debug = false);
+    /** @brief Release the trace analyzer created by the constructor */
+    ~Engine();
 
     /** @brief Execute the main program */
     void executeMain();
@@ -63,6 +68,12 @@ public:
             const std::string& name, const std::vector<RamDomain>& args, std::vector<RamDomain>& ret);
 
 private:
+    /**
+     * @brief Run the strata called from main on a StratumScheduler, so that strata that
+     * do not share relations run concurrently. Only used untraced with several threads;
+     * returns false, without running anything, if main is not a sequence of calls.
+     */
+    bool executeStrata();
     /** @brief Generate intermediate representation from RAM */
     void generateIR();
     /** @brief Remove a relation from the environment */
@@ -79,7 +90,10 @@ private:
     RecordTable& getRecordTable();
     /** @brief Return the ram::TranslationUnit */
     ram::TranslationUnit& getTranslationUnit();
-    /** @brief Execute the program */
+    /** @brief Execute the program, traced if tracing is enabled */
+    RamDomain execute(const Node*, Context&);
+    /** @brief Execute the program under the given trace policy */
+    template <typename TracePolicy>
     RamDomain execute(const Node*, Context&);
     /** @brief Return method handler */
     void* getMethodHandle(const std::string& method);
@@ -99,66 +113,150 @@ private:
     void createRelation(const ram::Relation& id, const std::size_t idx);
 
     // -- Defines template for specialized interpreter operation -- */
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalExistenceCheck(const ExistenceCheck& shadow, Context& ctxt);
 
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalProvenanceExistenceCheck(const ProvenanceExistenceCheck& shadow, Context& ctxt);
 
-    template <typename Rel>
+    /**
+     * @brief Run a scan → filter → insert pipeline (see Scan::setBlockPipeline) a block of
+     * tuples at a time. Only used untraced: the analyzer expects the events of each tuple
+     * to follow its ScanEval.
+     */
+    template <typename TracePolicy, std::size_t Arity, typename Iter>
+    void evalBlocks(const Scan& shadow, std::size_t tupleId, const Iter& range, Context& ctxt);
+
+    template <typename TracePolicy, typename Rel>
     RamDomain evalScan(const Rel& rel, const ram::Scan& cur, const Scan& shadow, Context& ctxt);
 
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalParallelScan(
             const Rel& rel, const ram::ParallelScan& cur, const ParallelScan& shadow, Context& ctxt);
 
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalIndexScan(const ram::IndexScan& cur, const IndexScan& shadow, Context& ctxt);
 
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalParallelIndexScan(const Rel& rel, const ram::ParallelIndexScan& cur,
             const ParallelIndexScan& shadow, Context& ctxt);
 
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalIfExists(const Rel& rel, const ram::IfExists& cur, const IfExists& shadow, Context& ctxt);
 
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalParallelIfExists(
             const Rel& rel, const ram::ParallelIfExists& cur, const ParallelIfExists& shadow, Context& ctxt);
 
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalIndexIfExists(const ram::IndexIfExists& cur, const IndexIfExists& shadow, Context& ctxt);
 
-    template <typename Rel>
+    template <typename TracePolicy, typename Rel>
     RamDomain evalParallelIndexIfExists(const Rel& rel, const ram::ParallelIndexIfExists& cur,
             const ParallelIndexIfExists& shadow, Context& ctxt);
 
-    template <typename Aggregate, typename Iter>
+    /**
+     * @brief Partial result of an aggregate. Parallel aggregates reduce every partition
+     * into its own accumulator and combine them in partition order.
+     */
+    struct AggregateAccumulator {
+        explicit AggregateAccumulator(AggregateOp op);
+        /** @brief Fold the result of a later partition into this one */
+        void combine(AggregateOp op, const AggregateAccumulator& other);
+
+        RamDomain res = 0;
+        /** Sum and count of a mean */
+        std::pair<RamFloat, RamFloat> mean{0, 0};
+        /** If the nested operation runs; min, max and mean need a tuple passing the filter */
+        bool runNested = false;
+    };
+
+    template <typename TracePolicy, typename Aggregate, typename Iter>
+    void accumulateAggregate(const Aggregate& aggregate, const Node& filter, const Node* expression,
+            const Iter& ranges, AggregateAccumulator& acc, Context& ctxt);
+
+    template <typename TracePolicy, typename Aggregate>
+    RamDomain finishAggregate(const Aggregate& aggregate, const Node& nestedOperation,
+            const AggregateAccumulator& acc, Context& ctxt);
+
+    template <typename TracePolicy, typename Aggregate, typename Iter>
     RamDomain evalAggregate(const Aggregate& aggregate, const Node& filter, const Node* expression,
             const Node& nestedOperation, const Iter& ranges, Context& ctxt);
 
-    template <typename Rel>
+    /** @brief Reduce the partitions in parallel, then run the nested operation once on the result */
+    template <typename TracePolicy, typename Aggregate, typename Shadow, typename Partitions>
+    RamDomain evalPartitionedAggregate(
+            const Aggregate& aggregate, const Shadow& shadow, const Partitions& partitions, Context& ctxt);
+
+    template <typename TracePolicy, typename Rel>
     RamDomain evalParallelAggregate(const Rel& rel, const ram::ParallelAggregate& cur,
             const ParallelAggregate& shadow, Context& ctxt);
 
+    template <typename TracePolicy, typename Rel>
+    RamDomain evalParallelIndexAggregate(const Rel& rel, const ram::ParallelIndexAggregate& cur,
+            const ParallelIndexAggregate& shadow, Context& ctxt);
+
+    template <typename TracePolicy, typename Rel>
+    RamDomain evalIndexAggregate(const ram::IndexAggregate& cur, const IndexAggregate& shadow, Context& ctxt);
+
+    template <typename TracePolicy, typename Rel>
+    RamDomain evalGuardedInsert(Rel& rel, const GuardedInsert& shadow, Context& ctxt);
+
+    template <typename TracePolicy, typename Rel>
+    RamDomain evalInsert(Rel& rel, const Insert& shadow, Context& ctxt);
+
+    /**
+     * @brief Lower the nested operation of a query into closures for untraced runs.
+     * Scans, index scans, filters, inserts, existence checks and numeric constraints are
+     * bound to the relation structure and arity of their node type and call the closures
+     * of their children directly, so that neither the switch nor the node casts are on the
+     * inner loop. Any other node is lowered to a closure running the switch dispatcher.
+     */
+    Closure lower(const Node* node);
+    /** @brief Closure running the node on the untraced switch dispatcher */
+    Closure interpreted(const Node* node);
+    /**
+     * @brief Lower the queries of the loop that have taken at least hotQueryThreshold on the
+     * switch dispatcher. Called between two iterations, so that a query keeps its
+     * implementation for a whole iteration and only the thread running the loop swaps it.
+     */
+    void promoteHotQueries(const Loop& loop);
+
+    Closure lowerConstraint(const Constraint& shadow);
+
     template <typename Rel>
-    RamDomain evalParallelIndexAggregate(
-            const ram::ParallelIndexAggregate& cur, const ParallelIndexAggregate& shadow, Context& ctxt);
+    Closure lowerScan(const Scan& shadow);
 
     template <typename Rel>
-    RamDomain evalIndexAggregate(const ram::IndexAggregate& cur, const IndexAggregate& shadow, Context& ctxt);
+    Closure lowerParallelScan(const ParallelScan& shadow);
 
     template <typename Rel>
-    RamDomain evalGuardedInsert(Rel& rel, const GuardedInsert& shadow, Context& ctxt);
+    Closure lowerIndexScan(const IndexScan& shadow);
 
     template <typename Rel>
-    RamDomain evalInsert(Rel& rel, const Insert& shadow, Context& ctxt);
+    Closure lowerParallelIndexScan(const ParallelIndexScan& shadow);
+
+    template <typename Rel>
+    Closure lowerExistenceCheck(const ExistenceCheck& shadow);
+
+    template <typename Rel>
+    Closure lowerInsert(const Insert& shadow);
 
     /** If profile is enable in this program */
     const bool profileEnabled;
     const bool frequencyCounterEnabled;
     /** If running a provenance program */
     const bool isProvenance;
+    /** If untraced queries run their lowered closures, see --interpreter-dispatch */
+    const bool closureDispatch;
+    /**
+     * If untraced queries of loops are lowered only once they are hot, see --interpreter-dispatch.
+     * Hotness is the time a query has run rather than the rule frequency counters: those are only
+     * kept when profiling, and profiled runs never lower queries.
+     */
+    const bool adaptiveDispatch;
+    /** Time a query of a loop runs on the switch dispatcher before it is lowered */
+    const std::chrono::milliseconds hotQueryThreshold;
     /** subroutines */
     VecOwn<Node> subroutine;
     /** main program */
@@ -167,8 +265,8 @@ private:
     std::size_t numOfThreads;
     /** Profile counter */
     std::atomic<RamDomain> counter{0};
-    /** Loop iteration counter */
-    std::size_t iteration = 0;
+    /** Loop iteration counter; atomic since strata may run concurrently */
+    std::atomic<std::size_t> iteration{0};
     /** Profile for rule frequencies */
     std::map<std::string, std::deque<std::atomic<std::size_t>>> frequencies;
     /** Profile for relation reads */
@@ -185,6 +283,10 @@ private:
     VecOwn<RelationHandle> relations;
     /** Symbol table */
     SymbolTable symbolTable;
+    /** If the execution is reported to the trace analyzer */
+    const bool traceEnabled;
+    /** If only inserts that add a new tuple are reported, see TraceDedup::Tuple */
+    bool traceNewTuples = false;
 };
 
 }  // namespace souffle::interpreter
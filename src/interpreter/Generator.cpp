@@ -22,11 +22,22 @@ using NodePtr = Own<Node>;
 using NodePtrVec = std::vector<NodePtr>;
 using RelationHandle = Own<RelationWrapper>;
 
-NodeGenerator::NodeGenerator(Engine& engine) : engine(engine) {
+NodeGenerator::NodeGenerator(Engine& engine)
+        : traceFilter(Global::config().get("trace-filter")), engine(engine) {
     visit(engine.tUnit.getProgram(), [&](const ram::Relation& relation) {
         assert(relationMap.find(relation.getName()) == relationMap.end() && "double-naming of relations");
         relationMap[relation.getName()] = &relation;
     });
+    // The inputs, outputs and merges of a relation are traced if any of its rules is.
+    if (!traceFilter.empty()) {
+        visit(engine.tUnit.getProgram(), [&](const ram::DebugInfo& dbg) {
+            std::string message = dbg.getMessage();
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            if (traceFilter.match_rule(message)) {
+                traceFilter.include_relation(modified_souffle::TraceFilter::rule_head(message));
+            }
+        });
+    }
 }
 
 NodePtr NodeGenerator::generateTree(const ram::Node& root) {
@@ -153,7 +164,7 @@ NodePtr NodeGenerator::visit_(type_identity<ram::ExistenceCheck>, const ram::Exi
     const auto& ramRelation = lookup(exists.getRelation());
     NodeType type = constructNodeType("ExistenceCheck", ramRelation);
     return mk<ExistenceCheck>(type, &exists, isTotal, encodeView(&exists), std::move(superOp),
-            ramRelation.isTemp(), ramRelation.getName());
+            ramRelation.isTemp(), ramRelation.getName(), encodeRelation(exists.getRelation()));
 }
 
 NodePtr NodeGenerator::visit_(
@@ -184,7 +195,9 @@ NodePtr NodeGenerator::visit_(type_identity<ram::Scan>, const ram::Scan& scan) {
     std::size_t relId = encodeRelation(scan.getRelation());
     auto rel = getRelationHandle(relId);
     NodeType type = constructNodeType("Scan", lookup(scan.getRelation()));
-    return mk<Scan>(type, &scan, rel, visit_(type_identity<ram::TupleOperation>(), scan));
+    auto res = mk<Scan>(type, &scan, rel, visit_(type_identity<ram::TupleOperation>(), scan));
+    setBlockPipeline(*res);
+    return res;
 }
 
 NodePtr NodeGenerator::visit_(type_identity<ram::ParallelScan>, const ram::ParallelScan& pScan) {
@@ -194,15 +207,20 @@ NodePtr NodeGenerator::visit_(type_identity<ram::ParallelScan>, const ram::Paral
     NodeType type = constructNodeType("ParallelScan", lookup(pScan.getRelation()));
     auto res = mk<ParallelScan>(type, &pScan, rel, visit_(type_identity<ram::TupleOperation>(), pScan));
     res->setViewContext(parentQueryViewContext);
+    setBlockPipeline(*res);
     return res;
 }
 
 NodePtr NodeGenerator::visit_(type_identity<ram::IndexScan>, const ram::IndexScan& iScan) {
     orderingContext.addTupleWithIndexOrder(iScan.getTupleId(), iScan);
     SuperInstruction indexOperation = getIndexSuperInstInfo(iScan);
+    std::size_t relId = encodeRelation(iScan.getRelation());
+    auto rel = getRelationHandle(relId);
     NodeType type = constructNodeType("IndexScan", lookup(iScan.getRelation()));
-    return mk<IndexScan>(type, &iScan, nullptr, visit_(type_identity<ram::TupleOperation>(), iScan),
+    auto res = mk<IndexScan>(type, &iScan, rel, visit_(type_identity<ram::TupleOperation>(), iScan),
             encodeView(&iScan), std::move(indexOperation));
+    setBlockPipeline(*res);
+    return res;
 }
 
 NodePtr NodeGenerator::visit_(type_identity<ram::ParallelIndexScan>, const ram::ParallelIndexScan& piscan) {
@@ -214,6 +232,7 @@ NodePtr NodeGenerator::visit_(type_identity<ram::ParallelIndexScan>, const ram::
     auto res = mk<ParallelIndexScan>(type, &piscan, rel, visit_(type_identity<ram::TupleOperation>(), piscan),
             encodeIndexPos(piscan), std::move(indexOperation));
     res->setViewContext(parentQueryViewContext);
+    setBlockPipeline(*res);
     return res;
 }
 
@@ -324,7 +343,7 @@ NodePtr NodeGenerator::visit_(
     auto rel = getRelationHandle(relId);
     NodeType type = constructNodeType("ParallelIndexAggregate", lookup(piAggregate.getRelation()));
     auto res = mk<ParallelIndexAggregate>(type, &piAggregate, rel, std::move(expr), std::move(cond),
-            std::move(nested), encodeView(&piAggregate), std::move(indexOperation));
+            std::move(nested), encodeIndexPos(piAggregate), std::move(indexOperation));
     res->setViewContext(parentQueryViewContext);
     return res;
 }
@@ -380,7 +399,13 @@ NodePtr NodeGenerator::visit_(type_identity<ram::Parallel>, const ram::Parallel&
 }
 
 NodePtr NodeGenerator::visit_(type_identity<ram::Loop>, const ram::Loop& loop) {
-    return mk<Loop>(I_Loop, &loop, dispatch(loop.getBody()));
+    std::vector<Query*> queries;
+    std::vector<Query*>* outer = std::exchange(loopQueries, &queries);
+    auto body = dispatch(loop.getBody());
+    loopQueries = outer;
+    auto res = mk<Loop>(I_Loop, &loop, std::move(body));
+    res->setQueries(std::move(queries));
+    return res;
 }
 
 NodePtr NodeGenerator::visit_(type_identity<ram::Exit>, const ram::Exit& exit) {
@@ -409,7 +434,19 @@ NodePtr NodeGenerator::visit_(type_identity<ram::LogTimer>, const ram::LogTimer&
 }
 
 NodePtr NodeGenerator::visit_(type_identity<ram::DebugInfo>, const ram::DebugInfo& dbg) {
-    return mk<DebugInfo>(I_DebugInfo, &dbg, dispatch(dbg.getStatement()));
+    // Rules are registered up front so that the analyzer's rule table is never written while
+    // trace events are being consumed.
+    std::string message = dbg.getMessage();
+    std::replace(message.begin(), message.end(), '\n', ' ');
+    bool traced = traceFilter.match_rule(message);
+    std::size_t ruleId = 0;
+    if (modified_souffle::analyzer != nullptr && traced) {
+        ruleId = modified_souffle::analyzer->register_rule(message);
+    }
+    withinRule = true;
+    auto child = dispatch(dbg.getStatement());
+    withinRule = false;
+    return mk<DebugInfo>(I_DebugInfo, &dbg, std::move(child), ruleId, traced);
 }
 
 NodePtr NodeGenerator::visit_(type_identity<ram::Clear>, const ram::Clear& clear) {
@@ -428,7 +465,7 @@ NodePtr NodeGenerator::visit_(type_identity<ram::LogSize>, const ram::LogSize& s
 NodePtr NodeGenerator::visit_(type_identity<ram::IO>, const ram::IO& io) {
     std::size_t relId = encodeRelation(io.getRelation());
     auto rel = getRelationHandle(relId);
-    return mk<IO>(I_IO, &io, rel);
+    return mk<IO>(I_IO, &io, rel, traceFilter.match_relation(io.getRelation()));
 }
 
 NodePtr NodeGenerator::visit_(type_identity<ram::Query>, const ram::Query& query) {
@@ -472,8 +509,23 @@ NodePtr NodeGenerator::visit_(type_identity<ram::Query>, const ram::Query& query
 
     visit(*next, [&](const ram::AbstractParallel&) { viewContext->isParallel = true; });
 
-    auto res = mk<Query>(I_Query, &query, dispatch(*next));
+    // Queries outside of rules merge new knowledge into a relation; follow the filter of the target.
+    bool traced = withinRule;
+    visit(query, [&](const ram::Insert& insert) {
+        traced = traced || traceFilter.match_relation(insert.getRelation());
+    });
+
+    auto res = mk<Query>(I_Query, &query, dispatch(*next), traced);
     res->setViewContext(parentQueryViewContext);
+    // Traced queries always run on the switch dispatcher. Adaptive dispatch leaves the queries of
+    // loops to the loop, which lowers them once they are hot; all others run once and are lowered now.
+    if (!(engine.traceEnabled && traced)) {
+        if (engine.adaptiveDispatch && loopQueries != nullptr) {
+            loopQueries->push_back(res.get());
+        } else if (engine.closureDispatch || engine.adaptiveDispatch) {
+            res->setClosure(engine.lower(res->getChild()));
+        }
+    }
     return res;
 }
 
@@ -722,6 +774,41 @@ SuperInstruction NodeGenerator::getInsertSuperInstInfo(const ram::Insert& exist)
     return superOp;
 }
 
+void NodeGenerator::setBlockPipeline(Scan& scan) {
+    // Provenance inserts compare against the heights already stored, so they stay tuple-at-a-time.
+    if (engine.isProvenance) {
+        return;
+    }
+    std::vector<const Node*> filters;
+    const Node* node = scan.getNestedOperation();
+    while (node->getType() == I_Filter) {
+        const auto* filter = static_cast<const Filter*>(node);
+        filters.push_back(filter->getCondition());
+        node = filter->getNestedOperation();
+    }
+    const auto* insert = as<ram::Insert>(node->getShadow());
+    if (insert == nullptr || isA<ram::GuardedInsert>(insert)) {
+        return;
+    }
+    // Survivors are only inserted once the whole block has been filtered, so a condition
+    // must not observe the relation being inserted into.
+    bool readsTarget = false;
+    for (const Node* condition : filters) {
+        visit(*condition->getShadow(), [&](const ram::Node& ramNode) {
+            if (const auto* exists = as<ram::AbstractExistenceCheck>(ramNode)) {
+                readsTarget |= exists->getRelation() == insert->getRelation();
+            } else if (const auto* empty = as<ram::EmptinessCheck>(ramNode)) {
+                readsTarget |= empty->getRelation() == insert->getRelation();
+            } else if (const auto* size = as<ram::RelationSize>(ramNode)) {
+                readsTarget |= size->getRelation() == insert->getRelation();
+            }
+        });
+    }
+    if (!readsTarget) {
+        scan.setBlockPipeline(std::move(filters), node);
+    }
+}
+
 // -- Definition of OrderingContext --
 
 NodeGenerator::OrderingContext::OrderingContext(NodeGenerator& generator) : generator(generator) {}
@@ -87,6 +87,7 @@
 #include "ram/analysis/Index.h"
 #include "ram/utility/Utils.h"
 #include "ram/utility/Visitor.h"
+#include "souffle/Modify.h"
 #include "souffle/RamTypes.h"
 #include "souffle/utility/ContainerUtil.h"
 #include "souffle/utility/MiscUtil.h"
@@ -336,6 +337,12 @@ private:
      */
     SuperInstruction getInsertSuperInstInfo(const ram::Insert& exist);
 
+    /**
+     * @brief Let the scan evaluate blocks of tuples if its nested operation is a chain of
+     * filters ending in an insert that none of the filters reads.
+     */
+    void setBlockPipeline(Scan& scan);
+
     /** Environment encoding, store a mapping from ram::Node to its operation index id. */
     std::unordered_map<const ram::Node*, std::size_t> indexTable;
     /** Points to the current viewContext during the generation.
@@ -354,6 +361,12 @@ private:
     std::unordered_map<std::string, const ram::Relation*> relationMap;
     /** ordering context */
     OrderingContext orderingContext = OrderingContext(*this);
+    /** Relations and rules selected for tracing */
+    modified_souffle::TraceFilter traceFilter;
+    /** Whether the statements being generated are part of a rule (i.e. below a DebugInfo) */
+    bool withinRule = false;
+    /** Queries of the innermost loop being generated, nullptr outside of loops */
+    std::vector<Query*>* loopQueries = nullptr;
     /** Reference to the engine instance */
     Engine& engine;
 };
@@ -1,25 +1,15 @@
 #include "souffle/Modify.h"
+#include "souffle/RecordTable.h"
+#include "souffle/TraceStream.h"
+#include "souffle/utility/StringUtil.h"
 #include "fstream"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
 #include "thread"
 #include <iomanip>
 #define PROCESS(_) std::cout << "Modified Souffle: " << _ << "\r" << std::flush;
-enum class opType {
-    debug,
-    insert_target,
-    insert,
-    swap,
-    clear,
-    scan_eval,
-    scan_index,
-    scan_order,
-    info_order,
-    scan_target,
-    end_scan,
-    output,
-    other,
-    exist_target,
-};
-
 int countSubstringOccurrences(const std::string& str, const std::string& sub) {
     int count = 0;
     size_t pos = 0;
@@ -30,397 +20,973 @@ int countSubstringOccurrences(const std::string& str, const std::string& sub) {
     return count;
 }
 
-void displayRunningTime(std::atomic<bool>& running) {
-    using namespace std::chrono;
-    struct tm {
-        uint16_t sec;
-        uint16_t min;
-        tm() : sec(0), min(0) {}
-        tm& operator++() {
-            sec++;
-            if (sec >= 60) {
-                sec -= 60;
-                min++;
+namespace modified_souffle {
+TupleDataAnalyzer* analyzer = nullptr;
+
+#ifdef _OPENMP
+constexpr bool concurrentSymbolTable = true;
+#else
+constexpr bool concurrentSymbolTable = false;
+#endif
+
+void TupleDataAnalyzer::register_relation(
+        std::size_t relId, const std::string& name, const std::vector<std::string>& types) {
+    if (relId >= relation_names.size()) {
+        relation_names.resize(relId + 1);
+        relation_types.resize(relId + 1);
+        relation_flags.resize(relId + 1, 0);
+    }
+    relation_names[relId] = name;
+    relation_types[relId] = types;
+}
+
+void TupleDataAnalyzer::register_record(const std::string& type, const std::vector<std::string>& fields) {
+    decoder.register_record(type, fields);
+}
+
+void ValueDecoder::register_record(const std::string& type, const std::vector<std::string>& fields) {
+    records[type] = fields;
+}
+
+const std::string& ValueDecoder::symbol(souffle::RamDomain index) {
+    const auto i = static_cast<std::size_t>(index);
+    if (i >= symbols.size()) symbols.resize(i + 1, nullptr);
+    // 符号表中的字符串地址不变，只在第一次出现时访问符号表
+    if (symbols[i] == nullptr) symbols[i] = &symbolTable->decode(index);
+    return *symbols[i];
+}
+
+void ValueDecoder::append(std::string& out, souffle::RamDomain value, const std::string& type) {
+    switch (type.empty() ? 's' : type[0]) {
+        case 's': out += symbol(value); return;
+        case 'u': out += std::to_string(souffle::ramBitCast<souffle::RamUnsigned>(value)); return;
+        case 'f': {
+            std::ostringstream os;
+            os << souffle::ramBitCast<souffle::RamFloat>(value);
+            out += os.str();
+            return;
+        }
+        case 'r': {
+            if (!expands_record(type)) break;
+            if (value == 0) {
+                out += "nil";
+                return;
+            }
+            const std::vector<std::string>& fields = records.at(type);
+            const souffle::RamDomain* data = recordTable->unpack(value, fields.size());
+            out += "[";
+            for (std::size_t i = 0; i < fields.size(); ++i) {
+                if (i != 0) out += ", ";
+                append(out, data[i], fields[i]);
             }
-            return *this;
+            out += "]";
+            return;
         }
-        void display() {
-            printf("%0*d:%0*d", 2, min, 2, sec);
+        default: break;
+    }
+    out += std::to_string(value);
+}
+
+uint32_t TupleDataAnalyzer::register_rule(const std::string& rule) {
+    auto it = rule_index.find(rule);
+    if (it != rule_index.end()) return it->second;
+    auto id = static_cast<uint32_t>(rule_list.size());
+    rule_index[rule] = id;
+    rule_list.push_back(rule);
+    rule_depth.push_back(1 + countSubstringOccurrences(rule, "), "));
+    return id;
+}
+
+uint32_t TupleDataAnalyzer::register_order(const std::vector<uint32_t>& order) {
+    assert(order.size() <= MAX_TRACE_ARITY && "order超出事件容量");
+    auto it = order_index.find(order);
+    if (it != order_index.end()) return it->second;
+    auto id = static_cast<uint32_t>(orders.size());
+    order_index[order] = id;
+    orders.push_back(order);
+    return id;
+}
+
+/** 当前线程正在写入的lane，不在并行扫描中时为nullptr */
+thread_local TraceLane* current_lane = nullptr;
+
+TraceEvent& TupleDataAnalyzer::acquire() {
+    if (current_lane != nullptr) return current_lane->emplace_back();
+    return ring != nullptr ? ring->claim() : pending;
+}
+
+void TupleDataAnalyzer::submit() {
+    if (current_lane != nullptr) return;
+    if (ring != nullptr)
+        ring->publish();
+    else
+        consume(pending);
+}
+
+void TupleDataAnalyzer::emit(TraceOp op, std::size_t relId, std::size_t viewId) {
+    TraceEvent& event = acquire();
+    event.op = op;
+    event.relId = static_cast<uint32_t>(relId);
+    event.viewId = static_cast<uint32_t>(viewId);
+    event.arity = 0;
+    submit();
+}
+
+void TupleDataAnalyzer::emit(TraceOp op, std::size_t relId, std::size_t viewId,
+        const souffle::RamDomain* data, std::size_t arity) {
+    assert(arity <= MAX_TRACE_ARITY && "tuple超出事件容量");
+    TraceEvent& event = acquire();
+    event.op = op;
+    event.relId = static_cast<uint32_t>(relId);
+    event.viewId = static_cast<uint32_t>(viewId);
+    event.arity = static_cast<uint32_t>(arity);
+    std::copy_n(data, arity, event.data);
+    submit();
+}
+
+void TupleDataAnalyzer::begin_lanes(std::size_t count) {
+    assert(current_lane == nullptr && "并行扫描不能嵌套");
+    if (lanes.size() < count) lanes.resize(count);
+}
+
+void TupleDataAnalyzer::enter_lane(std::size_t index) {
+    current_lane = &lanes[index];
+}
+
+void TupleDataAnalyzer::leave_lane() {
+    current_lane = nullptr;
+}
+
+void TupleDataAnalyzer::merge_lanes() {
+    for (auto& lane : lanes) {
+        for (const auto& event : lane) {
+            acquire() = event;
+            submit();
         }
-    };
-    tm curr_time;
-    while (running) {
-        printf("\r\033[k");
-        curr_time.display();
-        ++curr_time;
-        std::this_thread::sleep_for(milliseconds(1000));
-    }
-}
-
-std::vector<size_t> stringToTuple(const std::string& str) {
-    assert((str[0] == '[' || str[0] == '(') && (str[str.size() - 1] == ']' || str[str.size() - 1] == ')'));
-    std::stringstream ss(str.substr(1, str.size() - 1));
-    std::string temp;
-    std::vector<size_t> tuple;
-    while (std::getline(ss, temp, ',')) {
-        try {
-            size_t number = std::stoi(temp);
-            tuple.push_back(number);
-        } catch (const std::exception& e) {
-            std::cerr << "tuple格式错误.";
-            std::cerr << e.what();
-        }
-    }
-    return tuple;
-}
-
-opType getOperationType(const std::string& operation) {
-    if (operation == "DEBUG")
-        return opType::debug;
-    else if (operation == "INSERT_TARGET")
-        return opType::insert_target;
-    else if (operation == "INSERT")
-        return opType::insert;
-    else if (operation == "SWAP")
-        return opType::swap;
-    else if (operation == "CLEAR")
-        return opType::clear;
-    else if (operation == "SCAN_EVAL")
-        return opType::scan_eval;
-    else if (operation == "SCAN_INDEX")
-        return opType::scan_index;
-    else if (operation == "SCAN_ORDER")
-        return opType::scan_order;
-    else if (operation == "INFO_ORDER")
-        return opType::info_order;
-    else if (operation == "SCAN_TARGET")
-        return opType::scan_target;
-    else if (operation == "END_SCAN")
-        return opType::end_scan;
-    else if (operation == "OUTPUT")
-        return opType::output;
-    else if (operation == "EXIST_TARGET")
-        return opType::exist_target;
+        // 避免一次很大的扫描长期占用内存
+        if (lane.capacity() > TRACE_RING_CAPACITY)
+            TraceLane().swap(lane);
+        else
+            lane.clear();
+    }
+}
+
+void TupleDataAnalyzer::drain() {
+    std::size_t idle = 0;
+    while (true) {
+        const TraceEvent* event = ring->peek();
+        if (event != nullptr) {
+            consume(*event);
+            ring->pop();
+            idle = 0;
+            continue;
+        }
+        // 先检查队列再检查标志，保证退出前已处理完所有事件
+        if (!consuming.load(std::memory_order_acquire) && ring->empty()) break;
+        if (++idle < 1024)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+void TupleDataAnalyzer::stop_consumer() {
+    if (consumer == nullptr) return;
+    // drain()在标志清除后仍会处理完队列中剩余的事件
+    consuming = false;
+    consumer->join();
+    delete consumer;
+    consumer = nullptr;
+    delete ring;
+    ring = nullptr;
+}
+
+void TupleDataAnalyzer::flush() {
+    stop_consumer();
+    if (graph != nullptr) {
+        // 最后一条规则的推导还没有被后续事件提交
+        commit_set();
+        write_graph();
+    } else
+        os->flush();
+    // 溢出的推导只在提交时读回，运行结束后不再需要
+    set.close_spill();
+    progress.finish(rule_list);
+}
+
+void TupleDataAnalyzer::check_memory() {
+    if (set.memory_usage() <= memory_budget) return;
+    if (graph != nullptr) {
+        // proof graph中的推导不再按规则分组，直接加入即可释放内存
+        record_graph();
+        set.clear();
+    } else
+        progress.add_bytes(set.spill(output_path.empty() ? "souffle-trace.spill" : output_path + ".spill"));
+}
+
+bool TupleDataAnalyzer::first_derivation(uint32_t tuple) {
+    if (dedup != TraceDedup::Rule) return true;
+    if (curr_rule >= rule_derived.size()) rule_derived.resize(rule_list.size());
+    const uint64_t key = (static_cast<uint64_t>(base_relation(curr_insertSet)) << 32) | tuple;
+    return rule_derived[curr_rule].insert(key).second;
+}
+
+void TupleDataAnalyzer::set_expected_output(const std::string& dir, std::ostream& report) {
+    delete spectrum;
+    spectrum = new LiveSpectrum(dir);
+    spectrum_os = &report;
+}
+
+void TupleDataAnalyzer::score(uint32_t tuple) {
+    const uint32_t base = base_relation(curr_insertSet);
+    premise_keys.clear();
+    const Premise* scanned = scan_manager->read_tuples();
+    for (std::size_t i = 0; i < scan_manager->tuple_count(); ++i) {
+        if (scanned[i].relId == NO_ID) continue;
+        premise_keys.push_back((static_cast<uint64_t>(base_relation(scanned[i].relId)) << 32) | scanned[i].tupleId);
+    }
+    const uint32_t rules = spectrum->derive(
+            (static_cast<uint64_t>(base) << 32) | tuple, curr_rule, premise_keys.data(), premise_keys.size());
+    if (rules == NO_ID || !spectrum->expects(base, relation_names[base])) return;
+    // 与csv输出的行相同，直接按文本比较，不需要为预期输出中的值编码符号
+    std::string text;
+    const std::vector<std::string>& types = relation_types[base];
+    for (std::size_t i = 0; i < set.tuples.arity(tuple); ++i) {
+        if (i != 0) text += '\t';
+        decoder.append(text, set.tuples.data(tuple)[i], i < types.size() ? types[i] : std::string());
+    }
+    spectrum->judge(base, text, rules);
+}
+
+void TupleDataAnalyzer::commit_set() {
+    if (set.counter == 0) return;
+    if (graph != nullptr)
+        record_graph();
     else
-        return opType::other;
+        progress.add_bytes(set.show(*os, relation_names, relation_types, decoder));
+    set.clear();
 }
 
-namespace modified_souffle {
-TupleDataAnalyzer* analyzer = nullptr;
+uint32_t TupleDataAnalyzer::base_relation(uint32_t relId) {
+    if (relId >= base_relations.size()) base_relations.resize(relation_names.size(), NO_ID);
+    uint32_t& base = base_relations[relId];
+    if (base != NO_ID) return base;
+    base = relId;
+    const std::string& name = relation_names[relId];
+    for (const std::string prefix : {"@delta_", "@new_"}) {
+        if (name.compare(0, prefix.size(), prefix) != 0) continue;
+        auto it = std::find(relation_names.begin(), relation_names.end(), name.substr(prefix.size()));
+        if (it != relation_names.end()) base = static_cast<uint32_t>(it - relation_names.begin());
+        break;
+    }
+    return base;
+}
 
-bool TupleDataAnalyzer::parse() {
-    std::string line;
-    if (!std::getline(tuple_data, line)) return false;
-    // (*os) << "###" << line << std::endl;
-    if (is_debug) PROCESS(line)
-    size_t split_pos = line.find(' ');
-    std::string operation = line.substr(0, split_pos);
-    std::string data(line.begin() + split_pos + 1, line.end() - 1);
-    opType type = getOperationType(operation);
-    switch (type) {
-        case opType::debug: {
-            if (set.counter != 0) {
-                set.show(*os);
-                set.clear();
+uint32_t TupleDataAnalyzer::graph_tuple(uint32_t relId, uint32_t tupleId) {
+    const uint32_t base = base_relation(relId);
+    auto res = graph_tuples.emplace((static_cast<uint64_t>(base) << 32) | tupleId, 0);
+    if (res.second) {
+        res.first->second = graph->add_tuple(
+                base, set.tuples.offset(tupleId), static_cast<uint32_t>(set.tuples.arity(tupleId)));
+    }
+    return res.first->second;
+}
+
+void TupleDataAnalyzer::record_graph() {
+    std::vector<uint32_t> premises;
+    for (const Derivation& derivation : set.derivations) {
+        const uint32_t tuple = graph_tuple(derivation.relId, derivation.tupleId);
+        // 没有来源的tuple只作为proof graph中的叶子
+        if (derivation.ruleId == NO_ID) continue;
+        premises.clear();
+        for (uint32_t i = 0; i < derivation.premiseCount; ++i) {
+            const Premise& premise = set.premises[derivation.premiseBegin + i];
+            premises.push_back(graph_tuple(premise.relId, premise.tupleId));
+        }
+        graph->add_derivation(tuple, derivation.ruleId, premises.data(), derivation.premiseCount);
+    }
+}
+
+void TupleDataAnalyzer::write_graph() {
+    // 集合、规则与符号在运行中仍会增加，每次写出时重新给出
+    graph->clear_tables();
+    // 能展开的记录在写出时渲染为额外的符号，proof graph中只需区分符号与各种数字
+    std::vector<std::string> kinds(relation_names.size());
+    bool has_records = false;
+    for (uint32_t relId = 0; relId < relation_names.size(); ++relId) {
+        for (const std::string& type : relation_types[relId]) {
+            const bool record = decoder.expands_record(type);
+            has_records |= record;
+            kinds[relId] += record ? static_cast<char>(proof_graph::SYMBOL) : proof_graph::value_kind(type);
+        }
+        graph->add_relation(relation_names[relId], relation_flags[relId], kinds[relId]);
+    }
+    for (const std::string& rule : rule_list) {
+        const std::string head = TraceFilter::rule_head(rule);
+        auto it = std::find(relation_names.begin(), relation_names.end(), head);
+        graph->add_rule(rule, it != relation_names.end() ? static_cast<uint32_t>(it - relation_names.begin())
+                                                         : proof_graph::NONE);
+    }
+    std::vector<const std::string*> symbols;
+    for (const auto& symbol : *symbolTable) {
+        if (static_cast<std::size_t>(symbol.second) >= symbols.size()) symbols.resize(symbol.second + 1);
+        symbols[symbol.second] = &symbol.first;
+    }
+    for (const std::string* symbol : symbols) {
+        if (symbol != nullptr)
+            graph->add_symbol(symbol->data(), symbol->size());
+        else
+            graph->add_symbol("", 0);
+    }
+    std::ofstream file(output_path, std::ios::binary | std::ios::trunc);
+    if (!has_records) {
+        const auto& values = set.tuples.all_values();
+        graph->write(file, values.data(), values.size());
+        progress.add_bytes(static_cast<uint64_t>(file.tellp()));
+        return;
+    }
+    // 含记录的tuple复制一份，其中的记录换成渲染后的符号，同一tuple在其他集合中的值不受影响
+    std::vector<souffle::RamDomain> values = set.tuples.all_values();
+    std::map<std::string, souffle::RamDomain> rendered;
+    std::string text;
+    for (const auto& entry : graph_tuples) {
+        const auto relId = static_cast<uint32_t>(entry.first >> 32);
+        const auto tupleId = static_cast<uint32_t>(entry.first);
+        const std::vector<std::string>& types = relation_types[relId];
+        if (std::none_of(types.begin(), types.end(),
+                    [&](const std::string& type) { return decoder.expands_record(type); })) {
+            continue;
+        }
+        const std::size_t offset = values.size();
+        for (std::size_t i = 0; i < set.tuples.arity(tupleId); ++i) {
+            souffle::RamDomain value = set.tuples.data(tupleId)[i];
+            if (i < types.size() && decoder.expands_record(types[i])) {
+                text.clear();
+                decoder.append(text, value, types[i]);
+                auto res = rendered.emplace(text, static_cast<souffle::RamDomain>(symbols.size() + rendered.size()));
+                if (res.second) graph->add_symbol(text.data(), text.size());
+                value = res.first->second;
             }
+            values.push_back(value);
+        }
+        graph->move_tuple(entry.second, offset);
+    }
+    graph->write(file, values.data(), values.size());
+    progress.add_bytes(static_cast<uint64_t>(file.tellp()));
+}
+
+void TupleDataAnalyzer::consume(const TraceEvent& event) {
+    if (is_debug) PROCESS(render(event))
+    progress.tick(rule_list);
+    switch (event.op) {
+        case TraceOp::Debug: {
+            commit_set();
             delete scan_manager;
-            delete order_manager;
             scan_manager = nullptr;
-            order_manager = nullptr;
+            curr_rule = event.relId;
+            progress.enter_rule(curr_rule);
+            const std::string& data = rule_list[event.relId];
             is_relation = data.find(":-") != std::string::npos;
             if (is_relation) {
-                scan_manager = new TupleScanManager(1 + countSubstringOccurrences(data, "), "));
-                order_manager = new InfoOrderManager();
-                (*os) << "apply rules:" << data << std::endl;
-            } else
-                (*os) << "read input:" << data << std::endl;
-            os->flush();
+                scan_manager = new TupleScanManager(rule_depth[event.relId]);
+            }
+            if (os != nullptr) {
+                const char* header = is_relation ? "apply rules:" : "read input:";
+                (*os) << header << data << "\n";
+                progress.add_bytes(std::strlen(header) + data.size() + 1);
+            }
             break;
         }
-        case opType::insert_target: {
-            curr_insertSet = data;
+        case TraceOp::InsertTarget: {
+            curr_insertSet = event.relId;
             break;
         }
-        case opType::insert: {
-            if (curr_insertSet.empty() || is_skip_loop) break;
-            size_t op_pos = data.find(':');
-            std::string tuple = data.substr(op_pos + 2);
+        case TraceOp::Insert:
+        case TraceOp::Redundant: {
+            if (curr_insertSet == NO_ID || is_skip_loop) break;
+            const bool record = event.op == TraceOp::Insert;
+            if (record) progress.add_tuple();
             if (is_relation) {
-                std::string detail = scan_manager->read_tuple();
-                if (detail == "_") {
-                    if (curr_insertSet[0] != '@') {
+                if (!scan_manager->is_complete()) {
+                    if (relation_names[curr_insertSet][0] != '@') {
                         set.merge_set(curr_scanSet, curr_insertSet);
                         is_skip_loop = true;
                     } else
                         break;
-                } else
-                    set.insert_tuple(curr_insertSet, decodeTupleWithAssignedData(tuple), detail);
-            } else
-                set.insert_tuple(curr_insertSet, decodeTupleWithAssignedData(tuple), "");
-            scan_manager->back_to_normal_scan();
+                } else if (record) {
+                    const uint32_t tuple = set.tuples.intern(event.data, event.arity);
+                    if (first_derivation(tuple)) {
+                        set.insert_tuple(curr_insertSet, tuple, curr_rule, scan_manager->read_tuples(),
+                                scan_manager->tuple_count());
+                        if (spectrum != nullptr) score(tuple);
+                    }
+                }
+                scan_manager->back_to_normal_scan();
+            } else if (record)
+                set.insert_tuple(curr_insertSet, set.tuples.intern(event.data, event.arity));
+            check_memory();
             break;
         }
-        case opType::swap: {
-            size_t op_pos = data.find(' ');
-            std::string set1 = data.substr(0, op_pos);
-            std::string set2 = data.substr(op_pos + 1);
-            if (set1[0] == '@' && set2[0] == '@')
-                break;
-            else {
-                // (*os) << "发生了意料外的交换：" << set1 << ' ' << set2 << std::endl;
-            }
+        case TraceOp::InputTuple: {
+            assert(curr_insertSet != NO_ID);
+            progress.add_tuple();
+            set.insert_tuple(curr_insertSet, set.tuples.intern(event.data, event.arity));
+            check_memory();
             break;
         }
-        case opType::clear: {
-            if (data.empty() || data[0] == '@')
-                break;
-            else {
-                // (*os) << "发生了意料外的清除：" << data << std::endl;
-            }
-            break;
-        }
-        case opType::scan_order: {
-            curr_order.clear();
-            curr_order = stringToTuple(data);
-            break;
-        }
-        case opType::scan_eval: {
-            std::vector<size_t> tuple = stringToTuple(data);
-            decodeTupleByOrder(tuple, curr_order);
-            scan_manager->scan_tuple(decodeTupleWithAssignedData(tuple));
+        case TraceOp::Swap:
+        case TraceOp::Clear: {
+            // 只有@开头的临时集合会被交换或清除，不影响输出
             break;
         }
-        case opType::info_order: {
-            size_t op_pos = data.find(' ');
-            std::string sub1 = data.substr(0, op_pos);
-            std::string sub2 = data.substr(op_pos + 1);
-            size_t viewId = stoi(sub1);
-            std::vector<size_t> order = stringToTuple(sub2);
-            order_manager->add_order(viewId, order);
+        case TraceOp::ScanEval: {
+            if (scan_manager == nullptr) break;
+            scan_manager->scan_tuple(internByOrder(event, orders[event.viewId]));
             break;
         }
-        case opType::scan_target: {
-            scan_manager->enter_loop(0);
-            curr_scanSet = data;
+        case TraceOp::ScanTarget: {
+            if (scan_manager == nullptr) break;
+            scan_manager->enter_loop(0, event.relId);
+            curr_scanSet = event.relId;
             break;
         }
-        case opType::exist_target: {
-            scan_manager->enter_loop(1);
-            curr_scanSet = data;
+        case TraceOp::ExistTarget: {
+            if (scan_manager == nullptr) break;
+            scan_manager->enter_loop(1, event.relId);
+            curr_scanSet = event.relId;
             break;
         }
-        case opType::end_scan: {
+        case TraceOp::EndScan: {
+            if (scan_manager == nullptr) break;
             scan_manager->exit_loop();
             is_skip_loop = false;
             break;
         }
-        case opType::scan_index: {
-            size_t op_pos = data.find(' ');
-            size_t viewId = stoi(data.substr(0, op_pos));
-            std::string tuple_str = data.substr(op_pos + 1);
-            std::vector<size_t> tuple = stringToTuple(tuple_str);
-            decodeTupleByOrder(tuple, order_manager->get_order(viewId));
-            scan_manager->scan_tuple(decodeTupleWithAssignedData(tuple));
+        case TraceOp::ScanIndex: {
+            if (scan_manager == nullptr) break;
+            scan_manager->scan_tuple(internByOrder(event, orders[event.viewId]));
             break;
         }
-        case opType::output: {
-            (*os) << "output set:" << data << std::endl;
-            os->flush();
-            if (set.counter != 0) {
-                set.show(*os);
-                set.clear();
+        case TraceOp::Output: {
+            relation_flags[event.relId] |= proof_graph::OUTPUT;
+            if (os != nullptr) {
+                (*os) << "output set:" << relation_names[event.relId] << "\n";
+                progress.add_bytes(std::strlen("output set:") + relation_names[event.relId].size() + 1);
             }
+            commit_set();
+            break;
+        }
+        case TraceOp::Stratum: {
+            if (spectrum != nullptr) spectrum->report(*spectrum_os, event.relId, rule_list);
             break;
         }
-        default: break;
     }
-    return true;
 }
 
-std::string TupleDataAnalyzer::decodeTupleWithAssignedData(const std::string tuple) {
-    std::stringstream ss(tuple.substr(1, tuple.size() - 1));
-    std::string token;
-    std::string ans = "(";
-    while (std::getline(ss, token, ',')) {
-        try {
-            size_t number = std::stoi(token);
-            token = symbolTable->decode(number);
-            ans = ans + token + ",";
-        } catch (const std::exception& e) {
-            std::cerr << "将赋值应用在tuple上时发生错误.";
-            std::cerr << e.what();
+std::string TupleDataAnalyzer::render(const TraceEvent& event) const {
+    auto tuple = [&]() {
+        std::string s = "(";
+        for (uint32_t i = 0; i < event.arity; ++i) {
+            if (i != 0) s += ",";
+            s += std::to_string(event.data[i]);
         }
+        return s + ")";
+    };
+    auto name = [&](uint32_t relId) {
+        return relId < relation_names.size() ? relation_names[relId] : std::to_string(relId);
+    };
+    switch (event.op) {
+        case TraceOp::Debug: return "DEBUG " + rule_list[event.relId] + " ";
+        case TraceOp::InsertTarget: return "INSERT_TARGET " + name(event.relId) + " ";
+        case TraceOp::Insert: return "INSERT tuple: " + tuple() + " ";
+        case TraceOp::InputTuple: return "INPUT tuple: " + tuple() + " ";
+        case TraceOp::Swap: return "SWAP " + name(event.relId) + " " + name(event.viewId) + " ";
+        case TraceOp::Clear: return "CLEAR " + name(event.relId) + " ";
+        case TraceOp::ScanTarget: return "SCAN_TARGET " + name(event.relId) + " ";
+        case TraceOp::ExistTarget: return "EXIST_TARGET " + name(event.relId) + " ";
+        case TraceOp::ScanEval: return "SCAN_EVAL " + std::to_string(event.viewId) + " " + tuple() + " ";
+        case TraceOp::ScanIndex: return "SCAN_INDEX " + std::to_string(event.viewId) + " " + tuple() + " ";
+        case TraceOp::EndScan: return "END_SCAN _ ";
+        case TraceOp::Output: return "OUTPUT " + name(event.relId) + " ";
+        case TraceOp::Stratum: return "STRATUM " + std::to_string(event.relId) + " ";
+        case TraceOp::Redundant: return "REDUNDANT _ ";
     }
-    *(ans.end() - 1) = ')';
-    return ans;
+    return "";
 }
 
-TupleDataAnalyzer& modified_souffle::TupleDataAnalyzer::operator<<(const std::string& s) {
-    tuple_data << s << ' ';
-    return *this;
+TupleDataAnalyzer::~TupleDataAnalyzer() {
+    // 正常情况下flush()已结束分析线程
+    stop_consumer();
+    if (os != nullptr) os->flush();
+    delete graph;
+    delete spectrum;
 }
 
-TupleDataAnalyzer& modified_souffle::TupleDataAnalyzer::operator<<(const int& s) {
-    tuple_data << s << ' ';
-    return *this;
+uint32_t TupleDataAnalyzer::internByOrder(const TraceEvent& event, const std::vector<uint32_t>& order) {
+    assert(event.arity == order.size());
+    souffle::RamDomain tuple[MAX_TRACE_ARITY];
+    for (size_t i = 0; i < event.arity; ++i) {
+        tuple[order[i]] = event.data[i];
+    }
+    return set.tuples.intern(tuple, event.arity);
 }
 
-TupleDataAnalyzer& modified_souffle::TupleDataAnalyzer::operator<<(
-        std::ostream& (*manipulator)(std::ostream&)) {
-    tuple_data << manipulator;
-    return *this;
+TupleDataAnalyzer::TupleDataAnalyzer(const std::string& output_path, souffle::SymbolTable* symbolTable,
+        bool is_debug, TraceFormat format)
+        : output_path(output_path), decoder(symbolTable) {
+    this->symbolTable = symbolTable;
+    if (output_path.empty())
+        this->os = &std::cout;
+    else if (format == TraceFormat::Graph)
+        this->graph = new proof_graph::ProofGraphWriter();
+    else {
+        // 文本按大块写出，只在flush()时刷新
+        auto* file = new std::ofstream();
+        output_buffer.resize(TRACE_BUFFER_SIZE);
+        file->rdbuf()->pubsetbuf(output_buffer.data(), static_cast<std::streamsize>(output_buffer.size()));
+        file->open(output_path);
+        this->os = file;
+    }
+    this->is_debug = is_debug;
+    // debug模式逐个打印事件，不再输出进度
+    if (!is_debug) progress.set_interval(DEFAULT_PROGRESS_INTERVAL);
+    // debug模式需要按执行顺序即时打印事件，单核时另开线程也没有收益，这两种情况下同步解读；
+    // 分析线程会与引擎同时访问符号表，只有OpenMP下的符号表支持并发访问
+    if (!is_debug && concurrentSymbolTable && std::thread::hardware_concurrency() > 1) {
+        this->ring = new TraceRing(TRACE_RING_CAPACITY);
+        this->consumer = new std::thread(&TupleDataAnalyzer::drain, this);
+    }
 }
 
-TupleDataAnalyzer::~TupleDataAnalyzer() {
-    while (parse())
-        ;
-    os->flush();
-    running = false;
-    printf("closing...");
-    if (worker != nullptr) worker->join();
+void TupleDataAnalyzer::insert_from_file(std::size_t size, const souffle::RamDomain* data) {
+    emit(TraceOp::InputTuple, 0, 0, data, size);
 }
 
-void TupleDataAnalyzer::decodeTupleByOrder(std::vector<size_t>& tuple, std::vector<size_t>& order) {
-    assert(tuple.size() == order.size() && tuple.size() != 0);
-    std::vector<size_t> temp;
-    temp.resize(tuple.size());
-    for (size_t i = 0; i < tuple.size(); ++i) {
-        temp[order[i]] = tuple[i];
-    }
-    std::swap(temp, tuple);
+void TupleDataAnalyzer::begin_input(std::size_t relId) {
+    relation_flags[relId] |= proof_graph::INPUT;
+    emit(TraceOp::InsertTarget, relId);
+    input_traced = true;
 }
 
-std::string TupleDataAnalyzer::decodeTupleWithAssignedData(std::vector<size_t>& tuple) {
-    std::string ans = "(";
-    for (unsigned long i : tuple) {
-        ans = ans + symbolTable->decode(i) + ",";
-    }
-    *(ans.end() - 1) = ')';
-    return ans;
+void TupleDataAnalyzer::end_input() {
+    input_traced = false;
 }
 
-TupleDataAnalyzer::TupleDataAnalyzer(
-        const std::string& output_path, souffle::SymbolTable* symbolTable, bool is_debug) {
-    this->symbolTable = symbolTable;
-    if (output_path.empty())
-        this->os = &std::cout;
-    else
-        this->os = new std::ofstream(output_path);
-    this->is_debug = is_debug;
+void TraceProgress::render(
+        const std::vector<std::string>& rule_list, std::chrono::steady_clock::time_point now) {
+    using namespace std::chrono;
+    const auto elapsed = duration_cast<seconds>(now - start).count();
+    const uint64_t count = tuples.load(std::memory_order_relaxed);
+    const double window = duration<double>(now - last).count();
+    const double rate = window > 0 ? (count - last_tuples) / window : 0;
+    last = now;
+    last_tuples = count;
+    std::ostringstream line;
+    line << "\r\033[K" << std::setfill('0') << std::setw(2) << elapsed / 60 << ":" << std::setw(2) << elapsed % 60
+         << std::setfill(' ');
+    const uint32_t s = stratum.load(std::memory_order_relaxed);
+    if (s != NO_ID) line << " stratum " << s;
+    line << " iteration " << iteration.load(std::memory_order_relaxed);
+    const uint32_t r = rule.load(std::memory_order_relaxed);
+    if (r != NO_ID && r < rule_list.size()) line << " rule " << TraceFilter::rule_head(rule_list[r]);
+    line << std::fixed << std::setprecision(0) << " " << rate << " tuples/s " << std::setprecision(1)
+         << bytes.load(std::memory_order_relaxed) / double(1 << 20) << " MiB trace";
+    std::cerr << line.str() << std::flush;
+    rendered = true;
+}
 
-    if (!is_debug) {
-        this->worker = new std::thread(displayRunningTime, std::ref(running));
-    }
+void TraceProgress::finish(const std::vector<std::string>& rule_list) {
+    if (!rendered) return;
+    render(rule_list, std::chrono::steady_clock::now());
+    std::cerr << std::endl;
+    // 之后的进度另起一行
+    rendered = false;
 }
 
-void TupleDataAnalyzer::insert_from_file(int size, const int* data) {
-    assert(!curr_insertSet.empty());
-    std::vector<size_t> tuple;
-    for (int i = 0; i < size; ++i) {
-        tuple.push_back(data[i]);
+bool LiveSpectrum::expects(uint32_t relId, const std::string& name) {
+    if (relId >= expected_state.size()) {
+        expected_state.resize(relId + 1, 0);
+        expected.resize(relId + 1);
+    }
+    if (expected_state[relId] == 0) {
+        std::ifstream file(dir + "/" + name + ".csv");
+        expected_state[relId] = file ? 2 : 1;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            expected[relId].insert(line);
+        }
     }
-    set.insert_tuple(curr_insertSet, decodeTupleWithAssignedData(tuple), "");
+    return expected_state[relId] == 2;
 }
 
-void set_data::insert_tuple(
-        const std::string& target_set, const std::string& tuple, const std::string& detail) {
-    auto it = set_index.find(target_set);
-    if (it != set_index.end()) {
-        size_t index = it->second;
-        try {
-            set[index].push_back(tuple);
-            if (!detail.empty()) detail_data[index].push_back(detail);
-        } catch (const std::bad_alloc& e) {
-            throw std::runtime_error("push_back操作无效。原因：std::bad_alloc");
-        }
+uint32_t LiveSpectrum::derive(uint64_t key, uint32_t rule, const uint64_t* premises, std::size_t premise_count) {
+    auto res = tuple_rules.emplace(key, NO_ID);
+    if (!res.second) return NO_ID;
+    std::vector<uint32_t> rules{rule};
+    for (std::size_t i = 0; i < premise_count; ++i) {
+        auto it = tuple_rules.find(premises[i]);
+        // 从文件读入的tuple不在其中
+        if (it == tuple_rules.end()) continue;
+        const std::vector<uint32_t>& inherited = rule_sets[it->second];
+        rules.insert(rules.end(), inherited.begin(), inherited.end());
+    }
+    std::sort(rules.begin(), rules.end());
+    rules.erase(std::unique(rules.begin(), rules.end()), rules.end());
+    auto index = rule_set_index.emplace(rules, static_cast<uint32_t>(rule_sets.size()));
+    if (index.second) rule_sets.push_back(std::move(rules));
+    res.first->second = index.first->second;
+    return index.first->second;
+}
 
-    } else {
-        set_index[target_set] = counter;
-        if (counter >= set.size()) {
-            set.resize(2 * counter + 1);
-            detail_data.resize(2 * counter + 1);
+void LiveSpectrum::judge(uint32_t relId, const std::string& text, uint32_t rules) {
+    const bool pass = expected[relId].count(text) != 0;
+    (pass ? p : f)++;
+    std::vector<std::size_t>& count = pass ? pr : fr;
+    for (uint32_t rule : rule_sets[rules]) {
+        if (rule >= pr.size()) {
+            pr.resize(rule + 1, 0);
+            fr.resize(rule + 1, 0);
         }
-        set[counter].push_back(tuple);
-        if (!detail.empty()) detail_data[counter].push_back(detail);
-        counter++;
+        count[rule]++;
     }
 }
 
-void set_data::show(std::ostream& os) {
-    for (auto& i : set_index) {
-        if (i.first[0] == '@') continue;
-        os << i.first << ":" << std::endl;
-        for (size_t j = 0; j < set[i.second].size(); ++j) {
-            os << "+" << set[i.second][j] << " ";
-            if (!detail_data[i.second].empty()) os << detail_data[i.second][j] << " ";
-            os << std::endl;
-            os << std::flush;
+void LiveSpectrum::report(std::ostream& os, uint32_t stratum, const std::vector<std::string>& rule_list) const {
+    std::vector<uint32_t> rules;
+    for (uint32_t rule = 0; rule < pr.size(); ++rule) {
+        if (pr[rule] + fr[rule] != 0) rules.push_back(rule);
+    }
+    auto ochiai = [&](uint32_t rule) { return suspiciousness(Formula::Ochiai, pr[rule], fr[rule], p, f); };
+    std::stable_sort(rules.begin(), rules.end(), [&](uint32_t a, uint32_t b) { return ochiai(a) > ochiai(b); });
+    os << "stratum " << stratum << ":\tP = " << p << "\tF = " << f << "\n";
+    for (uint32_t rule : rules) {
+        os << rule_list[rule] << "\t Pr = " << pr[rule] << "\t Fr = " << fr[rule];
+        for (Formula formula : FORMULAS) {
+            os << "\t " << formulaName(formula) << " = " << suspiciousness(formula, pr[rule], fr[rule], p, f);
         }
-        os << std::endl;
+        os << "\n";
     }
-    os << std::endl;
     os << std::flush;
 }
 
-void set_data::clear() {
-    set_index.clear();
-    for (auto& i : set) {
-        i.clear();
+TraceFilter::TraceFilter(const std::string& spec) {
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(' '));
+        item.erase(item.find_last_not_of(' ') + 1);
+        if (item.empty()) continue;
+        // 集合名中不会出现':'，出现时按"文件:行号"解读
+        std::size_t colon = item.rfind(':');
+        if (colon != std::string::npos) {
+            locations.push_back({item.substr(0, colon), std::stoi(item.substr(colon + 1))});
+        } else
+            relations.insert(item);
     }
-    for (auto& i : detail_data) {
-        i.clear();
+}
+
+std::string TraceFilter::rule_head(const std::string& rule) {
+    std::string head = rule.substr(0, rule.find('('));
+    head.erase(0, head.find_first_not_of(' '));
+    head.erase(head.find_last_not_of(' ') + 1);
+    return head;
+}
+
+bool TraceFilter::match_rule(const std::string& rule) const {
+    if (empty() || relations.count(rule_head(rule)) != 0) return true;
+    // 位置形如"in file /path/t.dl [3:1-5:20]"
+    std::size_t file_pos = rule.rfind("in file ");
+    if (file_pos == std::string::npos) return false;
+    file_pos += 8;
+    std::size_t bracket = rule.find(" [", file_pos);
+    if (bracket == std::string::npos) return false;
+    const std::string file = rule.substr(file_pos, bracket - file_pos);
+    int first_line = 0;
+    int last_line = 0;
+    if (sscanf(rule.c_str() + bracket, " [%d:%*d-%d:%*d]", &first_line, &last_line) != 2) return false;
+    for (const auto& location : locations) {
+        bool same_file = file.size() >= location.file.size() &&
+                         file.compare(file.size() - location.file.size(), location.file.size(),
+                                 location.file) == 0;
+        if (same_file && first_line <= location.line && location.line <= last_line) return true;
     }
-    set.clear();
-    detail_data.clear();
-    counter = 0;
+    return false;
 }
 
-void set_data::merge_set(const std::string& source_set, const std::string& target_set) {
-    auto it_src = set_index.find(source_set);
-    assert(it_src != set_index.end());
-    auto it_dst = set_index.find(target_set);
-    if (it_dst == set_index.end()) {
-        set_index[target_set] = counter;
-        if (counter >= set.size()) {
-            set.resize(2 * counter + 1);
-            detail_data.resize(2 * counter + 1);
+bool TraceFilter::match_relation(const std::string& name) const {
+    if (empty()) return true;
+    std::string base = name;
+    for (const std::string prefix : {"@delta_", "@new_"}) {
+        if (name.compare(0, prefix.size(), prefix) == 0) {
+            base = name.substr(prefix.size());
+            break;
         }
+    }
+    return relations.count(base) != 0 || included.count(base) != 0;
+}
+
+void TraceFilter::include_relation(const std::string& name) {
+    included.insert(name);
+}
+
+uint32_t TupleStore::intern(const souffle::RamDomain* data, std::size_t arity) {
+    // 先暂存到末尾作为候选，已存在时撤销
+    auto id = static_cast<uint32_t>(size());
+    values.insert(values.end(), data, data + arity);
+    offsets.push_back(values.size());
+    auto res = index.insert(id);
+    if (!res.second) {
+        values.resize(offsets[id]);
+        offsets.pop_back();
+        return *res.first;
+    }
+    return id;
+}
+
+std::size_t TupleStore::Hash::operator()(uint32_t id) const {
+    std::size_t seed = store->arity(id);
+    const souffle::RamDomain* data = store->data(id);
+    for (std::size_t i = 0; i < store->arity(id); ++i) {
+        seed ^= std::hash<souffle::RamDomain>()(data[i]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+}
+
+bool TupleStore::Equal::operator()(uint32_t a, uint32_t b) const {
+    return store->arity(a) == store->arity(b) &&
+           std::equal(store->data(a), store->data(a) + store->arity(a), store->data(b));
+}
+
+std::vector<uint32_t>& set_data::get_set(uint32_t relId) {
+    if (relId >= set.size()) {
+        set.resize(relId + 1);
+        in_use.resize(relId + 1, false);
+    }
+    if (!in_use[relId]) {
+        in_use[relId] = true;
+        used_sets.push_back(relId);
         counter++;
-        it_dst = set_index.find(target_set);
     }
-    for (size_t i = 0; i < set[it_src->second].size(); ++i) {
-        set[it_dst->second].push_back(set[it_src->second][i]);
-        detail_data[it_dst->second].push_back(detail_data[it_src->second][i]);
+    return set[relId];
+}
+
+void set_data::insert_tuple(uint32_t target_set, uint32_t tuple, uint32_t rule, const Premise* premise,
+        std::size_t premise_count) {
+    auto begin = static_cast<uint32_t>(premises.size());
+    premises.insert(premises.end(), premise, premise + premise_count);
+    get_set(target_set).push_back(static_cast<uint32_t>(derivations.size()));
+    indexed++;
+    derivations.push_back({target_set, tuple, rule, begin, static_cast<uint32_t>(premise_count)});
+}
+
+std::size_t set_data::show(std::ostream& os, const std::vector<std::string>& relation_names,
+        const std::vector<std::vector<std::string>>& relation_types, ValueDecoder& decoder) const {
+    static const std::string untyped;
+    // 每行先拼在line中再整体写出，不在行尾刷新
+    std::string line;
+    std::size_t written = 0;
+    auto decode = [&](uint32_t relId, uint32_t tuple) {
+        const std::vector<std::string>& types = relation_types[relId];
+        line += "(";
+        for (std::size_t i = 0; i < tuples.arity(tuple); ++i) {
+            if (i != 0) line += ",";
+            decoder.append(line, tuples.data(tuple)[i], i < types.size() ? types[i] : untyped);
+        }
+        line += ")";
+    };
+    auto write = [&](uint32_t relId, const Derivation& derivation, const Premise* premise) {
+        line = "+";
+        decode(relId, derivation.tupleId);
+        line += " ";
+        if (derivation.ruleId != NO_ID) {
+            line += " from:[";
+            for (uint32_t i = 0; i < derivation.premiseCount; ++i) {
+                if (i != 0) line += ",";
+                decode(premise[i].relId, premise[i].tupleId);
+            }
+            line += "] ";
+        }
+        line += "\n";
+        os.write(line.data(), static_cast<std::streamsize>(line.size()));
+        written += line.size();
+    };
+    std::vector<uint32_t> order = used_sets;
+    std::sort(order.begin(), order.end(),
+            [&](uint32_t a, uint32_t b) { return relation_names[a] < relation_names[b]; });
+    std::vector<char> chunk;
+    for (uint32_t relId : order) {
+        const std::string& name = relation_names[relId];
+        if (name[0] == '@') continue;
+        os << name << ":\n";
+        written += name.size() + 3;
+        if (relId < spilled.size()) {
+            for (const SpillChunk& spill : spilled[relId]) {
+                chunk.resize(spill.size);
+                spill_file->seekg(static_cast<std::streamoff>(spill.offset));
+                spill_file->read(chunk.data(), static_cast<std::streamsize>(spill.size));
+                // 每条推导之后紧跟它的来源
+                for (std::size_t pos = 0; pos < chunk.size();) {
+                    Derivation derivation;
+                    std::memcpy(&derivation, chunk.data() + pos, sizeof(Derivation));
+                    pos += sizeof(Derivation);
+                    write(relId, derivation, reinterpret_cast<const Premise*>(chunk.data() + pos));
+                    pos += derivation.premiseCount * sizeof(Premise);
+                }
+            }
+        }
+        for (uint32_t index : set[relId]) {
+            const Derivation& derivation = derivations[index];
+            write(relId, derivation, premises.data() + derivation.premiseBegin);
+        }
+        os << "\n";
     }
+    os << "\n";
+    return written + 1;
 }
 
-std::string TupleScanManager::read_tuple() {
-    if (curr_loop_index == max_loop_depth) {
-        std::string s = " from:[";
-        for (size_t i = 1; i < scan_result.size(); ++i) {
-            s = s + scan_result[i] + ",";
+std::size_t set_data::spill(const std::string& path) {
+    if (spill_file == nullptr) {
+        spill_path = path;
+        spill_file = new std::fstream(
+                spill_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!*spill_file) {
+            std::cerr << "无法创建溢出文件" << spill_path << std::endl;
+            throw std::runtime_error("spill file unavailable.");
         }
-        *(s.end() - 1) = ']';
-        return s;
-    } else
-        return "_";
+    }
+    if (spilled.size() < set.size()) spilled.resize(set.size());
+    std::vector<char> buffer;
+    buffer.reserve(TRACE_BUFFER_SIZE);
+    spill_file->seekp(static_cast<std::streamoff>(spill_end));
+    const uint64_t begin = spill_end;
+    auto flush = [&]() {
+        spill_file->write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        spill_end += buffer.size();
+        buffer.clear();
+    };
+    for (uint32_t relId : used_sets) {
+        if (set[relId].empty()) continue;
+        SpillChunk chunk{spill_end + buffer.size(), 0};
+        for (uint32_t index : set[relId]) {
+            const Derivation& derivation = derivations[index];
+            const char* record = reinterpret_cast<const char*>(&derivation);
+            const char* source = reinterpret_cast<const char*>(premises.data() + derivation.premiseBegin);
+            buffer.insert(buffer.end(), record, record + sizeof(Derivation));
+            buffer.insert(buffer.end(), source, source + derivation.premiseCount * sizeof(Premise));
+            chunk.size += sizeof(Derivation) + derivation.premiseCount * sizeof(Premise);
+            if (buffer.size() >= TRACE_BUFFER_SIZE) flush();
+        }
+        spilled[relId].push_back(chunk);
+        set[relId].clear();
+    }
+    flush();
+    spill_file->flush();
+    derivations.clear();
+    premises.clear();
+    indexed = 0;
+    return spill_end - begin;
 }
 
-void TupleScanManager::scan_tuple(const std::string& tuple) {
-    scan_result[curr_loop_index] = tuple;
+void set_data::clear() {
+    for (uint32_t relId : used_sets) {
+        set[relId].clear();
+        if (relId < spilled.size()) spilled[relId].clear();
+        in_use[relId] = false;
+    }
+    used_sets.clear();
+    derivations.clear();
+    premises.clear();
+    indexed = 0;
+    spill_end = 0;
+    counter = 0;
 }
 
-void InfoOrderManager::add_order(size_t viewId, std::vector<size_t>& order) {
-    order_map[viewId] = order;
+void set_data::close_spill() {
+    if (spill_file == nullptr) return;
+    delete spill_file;
+    spill_file = nullptr;
+    std::remove(spill_path.c_str());
+    for (auto& chunks : spilled) chunks.clear();
+    spill_end = 0;
 }
 
-std::vector<size_t>& InfoOrderManager::get_order(size_t viewId) {
-    auto it = order_map.find(viewId);
-    if (it != order_map.end()) {
-        return it->second;
-    } else {
-        std::cerr << "在使用view id寻找order时发生错误." << std::endl;
-        throw std::runtime_error("view id invalid.");
+set_data::~set_data() {
+    close_spill();
+}
+
+void set_data::merge_set(uint32_t source_set, uint32_t target_set) {
+    if (source_set >= set.size()) return;
+    if (source_set < spilled.size() && !spilled[source_set].empty()) {
+        // 源集合已有推导溢出，先让两个集合在内存中的部分也溢出，再按顺序接上源集合的各段
+        get_set(target_set);
+        spill(spill_path);
+        const std::vector<SpillChunk> source = spilled[source_set];
+        auto& target = spilled[target_set];
+        target.insert(target.end(), source.begin(), source.end());
+        return;
+    }
+    const std::vector<uint32_t> source = set[source_set];
+    auto& target = get_set(target_set);
+    // 合并后推导仍指向原有的记录，只复制下标
+    target.insert(target.end(), source.begin(), source.end());
+    indexed += source.size();
+}
+
+bool replay_trace_stream(const std::string& stream_path, const std::string& output_path, TraceFormat format) {
+    trace_stream::TraceStreamReader reader;
+    if (!reader.open(stream_path)) return false;
+    // 按编号依次登记符号，使符号的值与原程序中一致，缺失的编号用不会出现的占位符填充
+    std::sort(reader.symbols.begin(), reader.symbols.end());
+    souffle::SymbolTable symbolTable;
+    uint32_t next = 0;
+    for (const auto& symbol : reader.symbols) {
+        for (; next < symbol.first; ++next) {
+            symbolTable.encode("\x01" + std::to_string(next));
+        }
+        symbolTable.encode(symbol.second);
+        next = symbol.first + 1;
+    }
+
+    TupleDataAnalyzer replay(output_path, &symbolTable, false, format);
+    std::vector<std::string> relations;
+    std::vector<uint32_t> rules;
+    // 编译后的程序中tuple按原始顺序存放，扫描到的tuple都使用恒等的order
+    std::vector<uint32_t> identity(MAX_TRACE_ARITY + 1);
+    std::vector<uint32_t> order;
+    for (std::size_t arity = 0; arity <= MAX_TRACE_ARITY; ++arity) {
+        identity[arity] = replay.register_order(order);
+        order.push_back(static_cast<uint32_t>(arity));
+    }
+    uint8_t tag = 0;
+    TraceEvent event{};
+    std::string text;
+    while (reader.next(tag, event, text)) {
+        switch (tag) {
+            case trace_stream::RELATION:
+                if (event.relId >= relations.size()) relations.resize(event.relId + 1);
+                relations[event.relId] = text;
+                replay.register_relation(event.relId, text);
+                break;
+            case trace_stream::TYPES:
+                // 记录表没有写入事件流，记录按编号输出
+                replay.register_relation(event.relId, relations[event.relId], souffle::splitString(text, ','));
+                break;
+            case trace_stream::RULE: rules.push_back(replay.register_rule(text)); break;
+            case trace_stream::INPUT: replay.begin_input(event.relId); break;
+            default:
+                if (event.op == TraceOp::Debug) {
+                    replay.emit(TraceOp::Debug, rules[event.relId]);
+                    break;
+                }
+                if (event.op == TraceOp::ScanEval || event.op == TraceOp::ScanIndex) event.viewId = identity[event.arity];
+                if (event.arity == 0)
+                    replay.emit(event.op, event.relId, event.viewId);
+                else
+                    replay.emit(event.op, event.relId, event.viewId, event.data, event.arity);
+        }
     }
+    replay.flush();
+    return tag == trace_stream::END;
 }
 }  // namespace modified_souffle
@@ -30,7 +30,9 @@
 #include "souffle/utility/MiscUtil.h"
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -43,9 +45,13 @@ class Node;
 }
 
 namespace interpreter {
+class Context;
 class ViewContext;
 struct RelationWrapper;
 
+/** An operation lowered into a closure over its pre-bound operands, see Engine::lower */
+using Closure = std::function<RamDomain(Context&)>;
+
 // clang-format off
 
 /* This macro defines all the interpreterNode token. 
@@ -318,6 +324,24 @@ protected:
     std::shared_ptr<ViewContext> viewContext = nullptr;
 };
 
+/**
+ * @class TracedOperation
+ * @brief  statement whose execution can be excluded from tracing by the trace filter.
+ *        E.g. DebugInfo, IO, Query
+ */
+class TracedOperation {
+public:
+    TracedOperation(bool traced) : traced(traced) {}
+
+    /** @brief whether the statement is reported to the trace analyzer */
+    inline bool isTraced() const {
+        return traced;
+    }
+
+protected:
+    const bool traced;
+};
+
 /**
  * @class ViewOperation
  * @brief  operation that utilizes the index view from underlying relation should inherit from this
@@ -545,9 +569,10 @@ public:
 class ExistenceCheck : public Node, public SuperOperation, public ViewOperation {
 public:
     ExistenceCheck(enum NodeType ty, const ram::Node* sdw, bool totalSearch, std::size_t viewId,
-            SuperInstruction superInst, bool tempRelation, std::string relationName)
+            SuperInstruction superInst, bool tempRelation, std::string relationName, std::size_t relationId)
             : Node(ty, sdw), SuperOperation(std::move(superInst)), ViewOperation(viewId),
-              totalSearch(totalSearch), tempRelation(tempRelation), relationName(std::move(relationName)) {}
+              totalSearch(totalSearch), tempRelation(tempRelation), relationName(std::move(relationName)),
+              relationId(relationId) {}
 
     bool isTotalSearch() const {
         return totalSearch;
@@ -561,10 +586,15 @@ public:
         return relationName;
     }
 
+    std::size_t getRelationId() const {
+        return relationId;
+    }
+
 private:
     const bool totalSearch;
     const bool tempRelation;
     const std::string relationName;
+    const std::size_t relationId;
 };
 
 /**
@@ -599,6 +629,30 @@ class Scan : public Node, public NestedOperation, public RelationalOperation {
 public:
     Scan(enum NodeType ty, const ram::Node* sdw, RelationHandle* relHandle, Own<Node> nested)
             : Node(ty, sdw), NestedOperation(std::move(nested)), RelationalOperation(relHandle) {}
+
+    /**
+     * @brief Mark the nested operation as a chain of filters ending in an insert.
+     * Such a scan binds a block of tuples, evaluates each condition over the whole
+     * block and inserts the survivors, instead of dispatching per tuple.
+     */
+    void setBlockPipeline(std::vector<const Node*> filters, const Node* insert) {
+        blockFilters = std::move(filters);
+        blockInsert = insert;
+    }
+
+    /** @brief Conditions of the filters between the scan and the insert */
+    const std::vector<const Node*>& getBlockFilters() const {
+        return blockFilters;
+    }
+
+    /** @brief Insert ending the pipeline, nullptr if the scan is evaluated tuple by tuple */
+    const Node* getBlockInsert() const {
+        return blockInsert;
+    }
+
+private:
+    std::vector<const Node*> blockFilters;
+    const Node* blockInsert = nullptr;
 };
 
 /**
@@ -786,11 +840,27 @@ class Parallel : public CompoundNode {
     using CompoundNode::CompoundNode;
 };
 
+class Query;
+
 /**
  * @class Loop
  */
 class Loop : public UnaryNode {
+public:
     using UnaryNode::UnaryNode;
+
+    /** @brief Set the queries of the body that are lowered into closures once they are hot */
+    void setQueries(std::vector<Query*> hot) {
+        queries = std::move(hot);
+    }
+
+    /** @brief Queries of the body that are lowered into closures once they are hot */
+    const std::vector<Query*>& getQueries() const {
+        return queries;
+    }
+
+private:
+    std::vector<Query*> queries;
 };
 
 /**
@@ -819,8 +889,18 @@ class LogTimer : public UnaryNode {
 /**
  * @class DebugInfo
  */
-class DebugInfo : public UnaryNode {
-    using UnaryNode::UnaryNode;
+class DebugInfo : public UnaryNode, public TracedOperation {
+public:
+    DebugInfo(enum NodeType ty, const ram::Node* sdw, Own<Node> child, std::size_t ruleId, bool traced)
+            : UnaryNode(ty, sdw, std::move(child)), TracedOperation(traced), ruleId(ruleId) {}
+
+    /** Id of the rule as registered with the trace analyzer */
+    std::size_t getRuleId() const {
+        return ruleId;
+    }
+
+private:
+    const std::size_t ruleId;
 };
 
 /**
@@ -860,17 +940,44 @@ public:
 /**
  * @class IO
  */
-class IO : public Node, public RelationalOperation {
+class IO : public Node, public RelationalOperation, public TracedOperation {
 public:
-    IO(enum NodeType ty, const ram::Node* sdw, RelationHandle* handle)
-            : Node(ty, sdw), RelationalOperation(handle) {}
+    IO(enum NodeType ty, const ram::Node* sdw, RelationHandle* handle, bool traced)
+            : Node(ty, sdw), RelationalOperation(handle), TracedOperation(traced) {}
 };
 
 /**
  * @class Query
  */
-class Query : public UnaryNode, public AbstractParallel {
-    using UnaryNode::UnaryNode;
+class Query : public UnaryNode, public AbstractParallel, public TracedOperation {
+public:
+    Query(enum NodeType ty, const ram::Node* sdw, Own<Node> child, bool traced)
+            : UnaryNode(ty, sdw, std::move(child)), TracedOperation(traced) {}
+
+    /** @brief Set the nested operation lowered into a closure; it replaces the child when untraced */
+    void setClosure(Closure lowered) {
+        closure = std::move(lowered);
+    }
+
+    /** @brief Lowered nested operation, empty if the child is run by the switch dispatcher */
+    const Closure& getClosure() const {
+        return closure;
+    }
+
+    /** @brief Add the time of one run of the child on the switch dispatcher */
+    void addElapsed(std::chrono::steady_clock::duration time) const {
+        elapsed += time;
+    }
+
+    /** @brief Time the child has taken on the switch dispatcher so far */
+    std::chrono::steady_clock::duration getElapsed() const {
+        return elapsed;
+    }
+
+private:
+    Closure closure;
+    /** Only the thread running the enclosing loop runs the query, so no atomic is needed */
+    mutable std::chrono::steady_clock::duration elapsed{0};
 };
 
 /**
@@ -134,6 +134,11 @@ public:
      */
     virtual Order getIndexOrder(std::size_t) const = 0;
 
+    /**
+     * Return the number of indexes.
+     */
+    virtual std::size_t getIndexCount() const = 0;
+
     /**
      * Obtains a view on an index of this relation, facilitating hint-supported accesses.
      *
@@ -145,6 +150,12 @@ public:
 
     arity_type arity;
     arity_type auxiliaryArity;
+
+    /** Id of the RAM relation this wrapper is reported as to the trace analyzer */
+    std::size_t traceId = 0;
+
+    /** Analyzer order id of each index, registered once when the relation is created */
+    std::vector<uint32_t> traceOrders;
 };
 
 /**
@@ -232,6 +243,10 @@ public:
         return indexes[idx]->getOrder();
     }
 
+    std::size_t getIndexCount() const override {
+        return indexes.size();
+    }
+
     class iterator_base : public RelationWrapper::iterator_base {
         iterator iter;
         Order order;
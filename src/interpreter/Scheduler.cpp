@@ -0,0 +1,248 @@
+/*
+ * Souffle - A Datalog Compiler
+ * Copyright (c) 2021, The Souffle Developers. All rights reserved.
+ * Licensed under the Universal Permissive License v 1.0 as shown at:
+ * - https://opensource.org/licenses/UPL
+ * - <souffle root>/licenses/SOUFFLE-UPL.txt
+ */
+
+/************************************************************************
+ *
+ * @file Scheduler.cpp
+ *
+ * Defines the StratumScheduler.
+ ***********************************************************************/
+
+#include "interpreter/Scheduler.h"
+#include "ram/AbstractExistenceCheck.h"
+#include "ram/AutoIncrement.h"
+#include "ram/BinRelationStatement.h"
+#include "ram/EmptinessCheck.h"
+#include "ram/IO.h"
+#include "ram/Insert.h"
+#include "ram/Node.h"
+#include "ram/RelationOperation.h"
+#include "ram/RelationSize.h"
+#include "ram/RelationStatement.h"
+#include "ram/UserDefinedOperator.h"
+#include "ram/utility/Visitor.h"
+#include "souffle/utility/MiscUtil.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace souffle::interpreter {
+
+namespace {
+// Shared state other than relations; the names cannot clash with relation names.
+const std::string CONSOLE = "#console";
+const std::string COUNTER = "#counter";
+const std::string FUNCTORS = "#functors";
+
+/** Relations and other shared state a stratum reads and writes */
+struct Access {
+    std::set<std::string> reads;
+    std::set<std::string> writes;
+};
+
+Access accessOf(const ram::Statement& stratum) {
+    Access access;
+    visit(stratum, [&](const ram::Node& node) {
+        if (const auto* operation = as<ram::RelationOperation>(node)) {
+            access.reads.insert(operation->getRelation());
+        } else if (const auto* exists = as<ram::AbstractExistenceCheck>(node)) {
+            access.reads.insert(exists->getRelation());
+        } else if (const auto* empty = as<ram::EmptinessCheck>(node)) {
+            access.reads.insert(empty->getRelation());
+        } else if (const auto* size = as<ram::RelationSize>(node)) {
+            access.reads.insert(size->getRelation());
+        } else if (const auto* insert = as<ram::Insert>(node)) {
+            access.writes.insert(insert->getRelation());
+        } else if (const auto* io = as<ram::IO>(node)) {
+            const auto& directives = io->getDirectives();
+            auto directive = [&](const std::string& key) {
+                auto it = directives.find(key);
+                return it == directives.end() ? std::string() : it->second;
+            };
+            const std::string operation = directive("operation");
+            if (operation == "input") {
+                // Loading errors are reported on the console.
+                access.writes.insert(io->getRelation());
+                access.writes.insert(CONSOLE);
+            } else {
+                access.reads.insert(io->getRelation());
+                if (operation == "printsize" || directive("IO") == "stdout") {
+                    access.writes.insert(CONSOLE);
+                }
+            }
+        } else if (const auto* statement = as<ram::RelationStatement>(node)) {
+            // Clear, LogSize and LogRelationTimer; treated as writes to stay on the safe side
+            access.writes.insert(statement->getRelation());
+        } else if (const auto* statement = as<ram::BinRelationStatement>(node)) {
+            access.writes.insert(statement->getFirstRelation());
+            access.writes.insert(statement->getSecondRelation());
+        } else if (isA<ram::AutoIncrement>(node)) {
+            access.writes.insert(COUNTER);
+        } else if (const auto* functor = as<ram::UserDefinedOperator>(node)) {
+            if (functor->isStateful()) {
+                access.writes.insert(FUNCTORS);
+            }
+        }
+    });
+    return access;
+}
+
+/** Deque of ready strata owned by one worker */
+struct WorkQueue {
+    std::mutex lock;
+    std::deque<std::size_t> ready;
+};
+}  // namespace
+
+StratumScheduler::StratumScheduler(const std::vector<const ram::Statement*>& strata)
+        : dependencies(strata.size()), successors(strata.size()) {
+    // For every relation the last stratum writing it and the strata reading it since.
+    std::map<std::string, std::size_t> lastWriter;
+    std::map<std::string, std::vector<std::size_t>> readers;
+    for (std::size_t i = 0; i < strata.size(); ++i) {
+        const Access access = accessOf(*strata[i]);
+        auto& waitFor = dependencies[i];
+        for (const auto& relation : access.reads) {
+            auto writer = lastWriter.find(relation);
+            if (writer != lastWriter.end()) {
+                waitFor.push_back(writer->second);
+            }
+        }
+        for (const auto& relation : access.writes) {
+            auto writer = lastWriter.find(relation);
+            if (writer != lastWriter.end()) {
+                waitFor.push_back(writer->second);
+            }
+            auto& since = readers[relation];
+            waitFor.insert(waitFor.end(), since.begin(), since.end());
+        }
+        std::sort(waitFor.begin(), waitFor.end());
+        waitFor.erase(std::unique(waitFor.begin(), waitFor.end()), waitFor.end());
+        waitFor.erase(std::remove(waitFor.begin(), waitFor.end(), i), waitFor.end());
+        for (std::size_t earlier : waitFor) {
+            successors[earlier].push_back(i);
+        }
+
+        for (const auto& relation : access.reads) {
+            readers[relation].push_back(i);
+        }
+        for (const auto& relation : access.writes) {
+            lastWriter[relation] = i;
+            readers[relation].clear();
+        }
+    }
+}
+
+void StratumScheduler::run(
+        std::size_t threads, const std::function<void(std::size_t, std::size_t)>& task) const {
+    const std::size_t count = dependencies.size();
+    if (count == 0) {
+        return;
+    }
+    threads = std::max<std::size_t>(threads, 1);
+    const std::size_t workers = std::min(threads, count);
+    std::unique_ptr<WorkQueue[]> queues(new WorkQueue[workers]);
+
+    // Guarded by idleLock: unfinished dependencies per stratum, strata sitting in a
+    // deque and strata not finished yet.
+    std::mutex idleLock;
+    std::condition_variable idle;
+    std::vector<std::size_t> waiting(count);
+    std::size_t queued = 0;
+    std::size_t remaining = count;
+    std::atomic<std::size_t> running{0};
+
+    for (std::size_t i = 0; i < count; ++i) {
+        waiting[i] = dependencies[i].size();
+        if (waiting[i] == 0) {
+            queues[queued++ % workers].ready.push_back(i);
+        }
+    }
+
+    // Pop the newest stratum of the own deque or steal the oldest one of another.
+    auto take = [&](std::size_t self, std::size_t& stratum) {
+        for (std::size_t k = 0; k < workers; ++k) {
+            auto& queue = queues[(self + k) % workers];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.ready.empty()) {
+                continue;
+            }
+            if (k == 0) {
+                stratum = queue.ready.back();
+                queue.ready.pop_back();
+            } else {
+                stratum = queue.ready.front();
+                queue.ready.pop_front();
+            }
+            return true;
+        }
+        return false;
+    };
+
+    auto work = [&](std::size_t self) {
+        std::size_t stratum = 0;
+        std::vector<std::size_t> released;
+        while (true) {
+            if (!take(self, stratum)) {
+                std::unique_lock<std::mutex> guard(idleLock);
+                if (remaining == 0) {
+                    return;
+                }
+                // A stratum counted in queued may not be in its deque yet; retry then.
+                if (queued == 0) {
+                    idle.wait(guard);
+                }
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> guard(idleLock);
+                --queued;
+            }
+
+            const std::size_t share = std::max<std::size_t>(1, threads / (running.fetch_add(1) + 1));
+            task(stratum, share);
+            running.fetch_sub(1);
+
+            released.clear();
+            {
+                std::lock_guard<std::mutex> guard(idleLock);
+                --remaining;
+                for (std::size_t next : successors[stratum]) {
+                    if (--waiting[next] == 0) {
+                        released.push_back(next);
+                    }
+                }
+                queued += released.size();
+            }
+            if (!released.empty()) {
+                std::lock_guard<std::mutex> guard(queues[self].lock);
+                // The earliest released stratum is popped first.
+                queues[self].ready.insert(queues[self].ready.end(), released.rbegin(), released.rend());
+            }
+            idle.notify_all();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (std::size_t i = 1; i < workers; ++i) {
+        pool.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+}  // namespace souffle::interpreter
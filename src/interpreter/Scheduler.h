@@ -0,0 +1,66 @@
+/*
+ * Souffle - A Datalog Compiler
+ * Copyright (c) 2021, The Souffle Developers. All rights reserved.
+ * Licensed under the Universal Permissive License v 1.0 as shown at:
+ * - https://opensource.org/licenses/UPL
+ * - <souffle root>/licenses/SOUFFLE-UPL.txt
+ */
+
+/************************************************************************
+ *
+ * @file Scheduler.h
+ *
+ * Declares the StratumScheduler, which runs the strata of the main program
+ * concurrently as far as the relations they read and write allow.
+ ***********************************************************************/
+
+#pragma once
+
+#include "ram/Statement.h"
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace souffle::interpreter {
+
+/**
+ * @class StratumScheduler
+ * @brief Runs strata on a pool of worker threads, each one as soon as every earlier
+ * stratum it conflicts with has finished.
+ *
+ * Every worker owns a deque of ready strata. A worker pushes the strata that its
+ * last stratum released onto its own deque and pops the newest one, so that it
+ * continues on the relations it just computed; idle workers steal the oldest
+ * stratum from another deque.
+ */
+class StratumScheduler {
+public:
+    /**
+     * @brief Derive the dependencies of the strata, given in program order.
+     *
+     * A stratum waits for an earlier one if either of them writes a relation that the
+     * other one reads or writes. This covers the edges of the SCC graph as well as the
+     * clearing of expired relations at the end of a stratum. Strata that print to the
+     * console, draw from the auto-increment counter or call stateful functors keep
+     * their relative order.
+     */
+    explicit StratumScheduler(const std::vector<const ram::Statement*>& strata);
+
+    /** @brief Earlier strata that the given stratum waits for, in ascending order */
+    const std::vector<std::size_t>& getDependencies(std::size_t stratum) const {
+        return dependencies[stratum];
+    }
+
+    /**
+     * @brief Run every stratum on at most `threads` workers.
+     * @param task called with a stratum and the number of threads its parallel
+     *        operations may use, i.e. `threads` divided among the running strata
+     */
+    void run(std::size_t threads, const std::function<void(std::size_t, std::size_t)>& task) const;
+
+private:
+    std::vector<std::vector<std::size_t>> dependencies;
+    std::vector<std::vector<std::size_t>> successors;
+};
+
+}  // namespace souffle::interpreter
@@ -0,0 +1,125 @@
+/*
+ * Souffle - A Datalog Compiler
+ * Copyright (c) 2021, The Souffle Developers. All rights reserved
+ * Licensed under the Universal Permissive License v 1.0 as shown at:
+ * - https://opensource.org/licenses/UPL
+ * - <souffle root>/licenses/SOUFFLE-UPL.txt
+ */
+
+/************************************************************************
+ *
+ * @file stratum_scheduler_test.cpp
+ *
+ * Tests the dependencies and the execution order of the StratumScheduler
+ *
+ ***********************************************************************/
+
+#include "tests/test.h"
+
+#include "interpreter/Scheduler.h"
+#include "ram/Clear.h"
+#include "ram/IO.h"
+#include "ram/Insert.h"
+#include "ram/Query.h"
+#include "ram/Scan.h"
+#include "ram/Sequence.h"
+#include "ram/TupleElement.h"
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace souffle::interpreter::test {
+
+namespace {
+/** A query copying relation `from` into relation `to` */
+Own<ram::Statement> copy(const std::string& from, const std::string& to) {
+    VecOwn<ram::Expression> values;
+    values.push_back(mk<ram::TupleElement>(0, 0));
+    return mk<ram::Query>(mk<ram::Scan>(from, 0, mk<ram::Insert>(to, std::move(values))));
+}
+
+Own<ram::Statement> load(const std::string& relation) {
+    return mk<ram::IO>(relation, std::map<std::string, std::string>{{"operation", "input"}});
+}
+
+Own<ram::Statement> store(const std::string& relation) {
+    return mk<ram::IO>(relation, std::map<std::string, std::string>{{"operation", "output"}});
+}
+
+std::vector<const ram::Statement*> pointers(const VecOwn<ram::Statement>& strata) {
+    std::vector<const ram::Statement*> result;
+    for (const auto& stratum : strata) {
+        result.push_back(stratum.get());
+    }
+    return result;
+}
+}  // namespace
+
+TEST(StratumScheduler, Dependencies) {
+    VecOwn<ram::Statement> strata;
+    strata.push_back(load("a"));                                   // 0
+    strata.push_back(load("b"));                                   // 1: console after 0
+    strata.push_back(copy("a", "c"));                              // 2: reads a
+    strata.push_back(copy("b", "d"));                              // 3: reads b
+    strata.push_back(mk<ram::Sequence>(copy("c", "e"), store("e"),  // 4: reads c, clears c
+            mk<ram::Clear>("c")));
+    strata.push_back(copy("d", "f"));                              // 5: reads d only
+
+    StratumScheduler scheduler(pointers(strata));
+    EXPECT_TRUE(scheduler.getDependencies(0).empty());
+    EXPECT_TRUE(scheduler.getDependencies(1) == std::vector<std::size_t>({0}));
+    EXPECT_TRUE(scheduler.getDependencies(2) == std::vector<std::size_t>({0}));
+    EXPECT_TRUE(scheduler.getDependencies(3) == std::vector<std::size_t>({1}));
+    EXPECT_TRUE(scheduler.getDependencies(4) == std::vector<std::size_t>({2}));
+    EXPECT_TRUE(scheduler.getDependencies(5) == std::vector<std::size_t>({3}));
+}
+
+TEST(StratumScheduler, ClearWaitsForReaders) {
+    VecOwn<ram::Statement> strata;
+    strata.push_back(copy("a", "b"));
+    strata.push_back(copy("a", "c"));
+    strata.push_back(mk<ram::Clear>("a"));
+
+    StratumScheduler scheduler(pointers(strata));
+    EXPECT_TRUE(scheduler.getDependencies(1).empty());
+    EXPECT_TRUE(scheduler.getDependencies(2) == std::vector<std::size_t>({0, 1}));
+}
+
+TEST(StratumScheduler, RunsAfterDependencies) {
+    // A wide graph: 64 independent chains of 4 strata each.
+    VecOwn<ram::Statement> strata;
+    for (std::size_t step = 0; step < 4; ++step) {
+        for (std::size_t chain = 0; chain < 64; ++chain) {
+            const std::string name = "r" + std::to_string(chain) + "_";
+            strata.push_back(copy(name + std::to_string(step), name + std::to_string(step + 1)));
+        }
+    }
+    StratumScheduler scheduler(pointers(strata));
+
+    for (std::size_t threads : {1, 3, 8}) {
+        std::vector<std::atomic<bool>> done(strata.size());
+        std::atomic<std::size_t> count{0};
+        std::atomic<bool> ordered{true};
+        std::atomic<bool> shared{true};
+        scheduler.run(threads, [&](std::size_t stratum, std::size_t share) {
+            for (std::size_t dependency : scheduler.getDependencies(stratum)) {
+                if (!done[dependency]) {
+                    ordered = false;
+                }
+            }
+            if (share < 1 || share > threads) {
+                shared = false;
+            }
+            done[stratum] = true;
+            ++count;
+        });
+        EXPECT_EQ(strata.size(), count.load());
+        EXPECT_TRUE(ordered.load());
+        EXPECT_TRUE(shared.load());
+    }
+}
+
+}  // namespace souffle::interpreter::test
@@ -0,0 +1,644 @@
+/*
+ * Souffle - A Datalog Compiler
+ * Copyright (c) 2021, The Souffle Developers. All rights reserved
+ * Licensed under the Universal Permissive License v 1.0 as shown at:
+ * - https://opensource.org/licenses/UPL
+ * - <souffle root>/licenses/SOUFFLE-UPL.txt
+ */
+
+/************************************************************************
+ *
+ * @file trace_analyzer_test.cpp
+ *
+ * Tests the event transport between the engine and the trace analyzer.
+ *
+ ***********************************************************************/
+
+#include "tests/test.h"
+
+#include "souffle/Modify.h"
+#include "souffle/ProofGraph.h"
+#include "souffle/RamTypes.h"
+#include "souffle/RecordTable.h"
+#include "souffle/SymbolTable.h"
+#include "souffle/TraceStream.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace souffle::interpreter::test {
+
+using ::modified_souffle::DEFAULT_TRACE_MEMORY;
+using ::modified_souffle::TraceEvent;
+using ::modified_souffle::TraceFilter;
+using ::modified_souffle::TraceFormat;
+using ::modified_souffle::TupleDataAnalyzer;
+using ::modified_souffle::TraceOp;
+using ::modified_souffle::TraceRing;
+
+TEST(TraceRing, Capacity) {
+    EXPECT_EQ(2, TraceRing(1).capacity());
+    EXPECT_EQ(8, TraceRing(5).capacity());
+    EXPECT_EQ(16, TraceRing(16).capacity());
+}
+
+TEST(TraceRing, SingleThreaded) {
+    TraceRing ring(4);
+    EXPECT_TRUE(ring.empty());
+    EXPECT_TRUE(ring.peek() == nullptr);
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        TraceEvent& event = ring.claim();
+        event.op = TraceOp::Insert;
+        event.relId = i;
+        ring.publish();
+    }
+    EXPECT_FALSE(ring.empty());
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        const TraceEvent* event = ring.peek();
+        ASSERT_TRUE(event != nullptr);
+        EXPECT_EQ(i, event->relId);
+        ring.pop();
+    }
+    EXPECT_TRUE(ring.empty());
+    EXPECT_TRUE(ring.peek() == nullptr);
+}
+
+TEST(TraceRing, ProducerConsumer) {
+    // a small ring forces the producer to wait for the consumer
+    constexpr uint32_t N = 100000;
+    TraceRing ring(8);
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < N; ++i) {
+            TraceEvent& event = ring.claim();
+            event.op = TraceOp::ScanEval;
+            event.relId = i;
+            event.arity = 1;
+            event.data[0] = static_cast<RamDomain>(i);
+            ring.publish();
+        }
+    });
+
+    uint32_t expected = 0;
+    bool ordered = true;
+    while (expected < N) {
+        const TraceEvent* event = ring.peek();
+        if (event == nullptr) continue;
+        ordered = ordered && event->relId == expected && event->data[0] == static_cast<RamDomain>(expected);
+        ring.pop();
+        ++expected;
+    }
+    producer.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(TraceFilter, Empty) {
+    TraceFilter filter("");
+    EXPECT_TRUE(filter.empty());
+    EXPECT_TRUE(filter.match_rule("path(x,y) :- edge(x,y). in file t.dl [3:1-3:20]"));
+    EXPECT_TRUE(filter.match_relation("@delta_path"));
+}
+
+TEST(TraceFilter, Selection) {
+    TraceFilter filter("edge, dir/t.dl:5");
+    EXPECT_FALSE(filter.empty());
+
+    EXPECT_EQ("path", TraceFilter::rule_head("path(x,y) :- edge(x,y). in file t.dl [3:1-3:20]"));
+    EXPECT_TRUE(filter.match_rule("edge(1,2). in file /src/dir/t.dl [1:1-1:10]"));
+    EXPECT_FALSE(filter.match_rule("path(x,y) :- edge(x,y). in file /src/dir/t.dl [3:1-3:20]"));
+    EXPECT_TRUE(filter.match_rule("path(x,z) :-    path(x,y),    edge(y,z). in file /src/dir/t.dl [4:1-6:10]"));
+    EXPECT_FALSE(filter.match_rule("path(x,z) :-    path(x,y),    edge(y,z). in file /src/u.dl [4:1-6:10]"));
+
+    EXPECT_TRUE(filter.match_relation("edge"));
+    EXPECT_FALSE(filter.match_relation("path"));
+    filter.include_relation("path");
+    EXPECT_TRUE(filter.match_relation("path"));
+    EXPECT_TRUE(filter.match_relation("@new_path"));
+    EXPECT_TRUE(filter.match_relation("@delta_path"));
+    // included relations do not select further rules
+    EXPECT_FALSE(filter.match_rule("path(x,y) :- edge(x,y). in file /src/dir/t.dl [3:1-3:20]"));
+}
+
+namespace {
+
+/** Trace path(x,z) :- edge(x,y), path(y,z) over the given partitions of edge, then return the output. */
+std::string tracePartitions(const std::string& file, bool parallel, std::size_t budget = DEFAULT_TRACE_MEMORY) {
+    SymbolTable symbolTable;
+    for (int i = 0; i < 8; ++i) {
+        symbolTable.encode("n" + std::to_string(i));
+    }
+    const std::vector<std::vector<RamDomain>> partitions = {{0, 1, 1, 2}, {2, 3, 3, 4}, {4, 5}};
+    {
+        TupleDataAnalyzer analyzer(file, &symbolTable);
+        analyzer.set_memory_budget(budget);
+        analyzer.register_relation(0, "edge");
+        analyzer.register_relation(1, "path");
+        auto rule = analyzer.register_rule("path(x,z) :- edge(x,y), path(y,z). in file t.dl [2:1-2:40]");
+        auto order = analyzer.register_order({0, 1});
+
+        analyzer.emit(TraceOp::Debug, rule);
+        analyzer.emit(TraceOp::ScanTarget, 0);
+        auto tracePartition = [&](const std::vector<RamDomain>& edges) {
+            for (std::size_t i = 0; i < edges.size(); i += 2) {
+                analyzer.emit(TraceOp::ScanEval, 0, order, &edges[i], 2);
+                analyzer.emit(TraceOp::ScanTarget, 1);
+                RamDomain path[2] = {edges[i + 1], edges[i + 1]};
+                analyzer.emit(TraceOp::ScanEval, 0, order, path, 2);
+                analyzer.emit(TraceOp::InsertTarget, 1);
+                RamDomain result[2] = {edges[i], edges[i + 1]};
+                analyzer.emit(TraceOp::Insert, 0, 0, result, 2);
+                analyzer.emit(TraceOp::EndScan);
+            }
+        };
+        if (parallel) {
+            // partitions finish in reverse order on separate threads
+            analyzer.begin_lanes(partitions.size());
+            for (std::size_t p = partitions.size(); p-- > 0;) {
+                std::thread worker([&, p]() {
+                    analyzer.enter_lane(p);
+                    tracePartition(partitions[p]);
+                    analyzer.leave_lane();
+                });
+                worker.join();
+            }
+            analyzer.merge_lanes();
+        } else {
+            for (const auto& edges : partitions) {
+                tracePartition(edges);
+            }
+        }
+        analyzer.emit(TraceOp::EndScan);
+        analyzer.emit(TraceOp::Output, 1);
+        analyzer.flush();
+    }
+    std::ifstream in(file);
+    std::stringstream content;
+    content << in.rdbuf();
+    in.close();
+    std::remove(file.c_str());
+    return content.str();
+}
+
+}  // namespace
+
+TEST(TraceLane, MergeMatchesSerial) {
+    const std::string serial = tracePartitions("trace_lane_serial.out", false);
+    const std::string parallel = tracePartitions("trace_lane_parallel.out", true);
+    EXPECT_FALSE(serial.empty());
+    EXPECT_EQ(serial, parallel);
+}
+
+TEST(TraceLane, SpillMatchesMemory) {
+    const std::string memory = tracePartitions("trace_spill_memory.out", false);
+    // every insertion exceeds the budget and goes to its own segment of the spill file
+    const std::string spilled = tracePartitions("trace_spill_disk.out", true, 1);
+    EXPECT_FALSE(memory.empty());
+    EXPECT_EQ(memory, spilled);
+    EXPECT_FALSE(std::ifstream("trace_spill_disk.out.spill").good());
+}
+
+TEST(TraceLane, SpillRemovedByFlush) {
+    const std::string file = "trace_spill_flush.out";
+    SymbolTable symbolTable;
+    TupleDataAnalyzer analyzer(file, &symbolTable);
+    analyzer.set_memory_budget(1);
+    analyzer.register_relation(0, "path");
+    // every input tuple exceeds the budget and is spilled
+    analyzer.emit(TraceOp::InsertTarget, 0);
+    for (RamDomain i = 0; i < 4; ++i) {
+        RamDomain tuple[2] = {i, i + 1};
+        analyzer.insert_from_file(2, tuple);
+    }
+    // removed by flush() already, not only when the analyzer is destroyed
+    analyzer.flush();
+    EXPECT_FALSE(std::ifstream(file + ".spill").good());
+    std::remove(file.c_str());
+}
+
+TEST(TraceStream, ReplayMatchesAnalyzer) {
+    const std::string stream = "trace_stream.bin";
+    const std::string replayed = "trace_stream_replay.out";
+    SymbolTable symbolTable;
+    for (int i = 0; i < 8; ++i) {
+        symbolTable.encode("n" + std::to_string(i));
+    }
+    {
+        // the events a compiled program emits for the rule of tracePartitions, with parallel lanes
+        ::modified_souffle::trace_stream::TraceStreamWriter writer;
+        ASSERT_TRUE(writer.open(stream, {"edge", "path"},
+                {"path(x,z) :- edge(x,y), path(y,z). in file t.dl [2:1-2:40]"}));
+        const std::vector<std::vector<RamDomain>> partitions = {{0, 1, 1, 2}, {2, 3, 3, 4}, {4, 5}};
+        writer.emit(TraceOp::Debug, 0);
+        writer.emit(TraceOp::ScanTarget, 0);
+        writer.begin_lanes(partitions.size());
+        for (std::size_t p = partitions.size(); p-- > 0;) {
+            std::thread worker([&, p]() {
+                writer.enter_lane(p);
+                const auto& edges = partitions[p];
+                for (std::size_t i = 0; i < edges.size(); i += 2) {
+                    writer.emit(TraceOp::ScanEval, 0, &edges[i], 2);
+                    writer.emit(TraceOp::ScanTarget, 1);
+                    RamDomain path[2] = {edges[i + 1], edges[i + 1]};
+                    writer.emit(TraceOp::ScanEval, 0, path, 2);
+                    RamDomain result[2] = {edges[i], edges[i + 1]};
+                    writer.insert(1, result, 2);
+                    writer.emit(TraceOp::EndScan);
+                }
+                writer.leave_lane();
+            });
+            worker.join();
+        }
+        writer.merge_lanes();
+        writer.emit(TraceOp::EndScan);
+        writer.emit(TraceOp::Output, 1);
+        writer.close(symbolTable);
+    }
+    ASSERT_TRUE(::modified_souffle::trace_stream::is_trace_stream(stream));
+    ASSERT_TRUE(::modified_souffle::replay_trace_stream(stream, replayed, TraceFormat::Text));
+    std::remove(stream.c_str());
+
+    std::ifstream in(replayed);
+    std::stringstream content;
+    content << in.rdbuf();
+    in.close();
+    std::remove(replayed.c_str());
+    EXPECT_FALSE(content.str().empty());
+    EXPECT_EQ(tracePartitions("trace_stream_direct.out", false), content.str());
+}
+
+TEST(ProofGraph, WrittenByAnalyzer) {
+    namespace pg = ::modified_souffle::proof_graph;
+    const std::string file = "trace_proof_graph.pg";
+    SymbolTable symbolTable({"a", "b", "c"});
+    {
+        TupleDataAnalyzer analyzer(file, &symbolTable, false, TraceFormat::Graph);
+        analyzer.register_relation(0, "edge");
+        analyzer.register_relation(1, "path");
+        analyzer.register_relation(2, "@new_path");
+        auto input = analyzer.register_rule("edge(x,y). in file t.dl [1:1-1:10]");
+        auto rule = analyzer.register_rule("path(x,y) :- edge(x,y). in file t.dl [2:1-2:30]");
+
+        analyzer.emit(TraceOp::Debug, input);
+        analyzer.begin_input(0);
+        RamDomain edges[2][2] = {{0, 1}, {1, 2}};
+        for (auto& edge : edges) {
+            analyzer.insert_from_file(2, edge);
+        }
+        analyzer.end_input();
+        auto order = analyzer.register_order({0, 1});
+
+        analyzer.emit(TraceOp::Debug, rule);
+        analyzer.emit(TraceOp::ScanTarget, 0);
+        for (int repeat = 0; repeat < 2; ++repeat) {
+            for (auto& edge : edges) {
+                analyzer.emit(TraceOp::ScanEval, 0, order, edge, 2);
+                analyzer.emit(TraceOp::InsertTarget, 2);
+                analyzer.emit(TraceOp::Insert, 0, 0, edge, 2);
+            }
+        }
+        analyzer.emit(TraceOp::EndScan);
+        analyzer.emit(TraceOp::Output, 1);
+        analyzer.flush();
+    }
+
+    pg::ProofGraph graph;
+    ASSERT_TRUE(pg::ProofGraph::is_proof_graph(file));
+    ASSERT_TRUE(graph.open(file));
+    EXPECT_EQ(3, graph.relation_count());
+    EXPECT_EQ("path", graph.relation_name(1));
+    EXPECT_EQ(pg::INPUT, graph.relation(0).flags);
+    EXPECT_EQ(pg::OUTPUT, graph.relation(1).flags);
+    EXPECT_EQ(2, graph.relation(1).arity);
+    ASSERT_TRUE(2 == graph.rule_count());
+    EXPECT_EQ(1, graph.rule(1).head);
+    EXPECT_EQ(3, graph.symbol_count());
+
+    // tuples of @new_path belong to path, repeated derivations are grouped under their tuple
+    ASSERT_TRUE(4 == graph.tuple_count());
+    EXPECT_EQ(4, graph.derivation_count());
+    for (uint32_t tuple = 0; tuple < 2; ++tuple) {
+        EXPECT_EQ(0, graph.tuple(tuple).relation);
+        EXPECT_EQ(0, graph.tuple(tuple).derivationCount);
+    }
+    EXPECT_EQ("(a,b)", graph.render_tuple(2));
+    EXPECT_EQ("(b,c)", graph.render_tuple(3));
+    for (uint32_t tuple = 2; tuple < 4; ++tuple) {
+        const pg::TupleEntry& entry = graph.tuple(tuple);
+        EXPECT_EQ(1, entry.relation);
+        ASSERT_TRUE(2 == entry.derivationCount);
+        for (uint32_t d = entry.firstDerivation; d < entry.firstDerivation + entry.derivationCount; ++d) {
+            EXPECT_EQ(tuple, graph.derivation(d).tuple);
+            EXPECT_EQ(1, graph.derivation(d).rule);
+            ASSERT_TRUE(1 == graph.derivation(d).edgeCount);
+            EXPECT_EQ(tuple - 2, graph.premises(d)[0]);
+        }
+    }
+    std::remove(file.c_str());
+}
+
+TEST(ProofGraph, ScansDecodedByOrderId) {
+    namespace pg = ::modified_souffle::proof_graph;
+    const std::string file = "trace_order_id.pg";
+    SymbolTable symbolTable;
+    for (const char* symbol : {"a", "b", "c"}) {
+        symbolTable.encode(symbol);
+    }
+    {
+        TupleDataAnalyzer analyzer(file, &symbolTable, false, TraceFormat::Graph);
+        analyzer.register_relation(0, "edge");
+        analyzer.register_relation(1, "path");
+        auto rule = analyzer.register_rule("path(x,z) :- edge(x,y), path(y,z). in file t.dl [2:1-2:40]");
+        auto primary = analyzer.register_order({0, 1});
+        auto reversed = analyzer.register_order({1, 0});
+        EXPECT_EQ(primary, analyzer.register_order({0, 1}));
+        EXPECT_NE(primary, reversed);
+
+        analyzer.emit(TraceOp::Debug, rule);
+        analyzer.emit(TraceOp::ScanTarget, 0);
+        RamDomain edge[2] = {0, 1};
+        analyzer.emit(TraceOp::ScanEval, 0, primary, edge, 2);
+        // path(b,c) as stored in an index on its second attribute
+        analyzer.emit(TraceOp::ScanTarget, 1);
+        RamDomain path[2] = {2, 1};
+        analyzer.emit(TraceOp::ScanIndex, 0, reversed, path, 2);
+        analyzer.emit(TraceOp::InsertTarget, 1);
+        RamDomain result[2] = {0, 2};
+        analyzer.emit(TraceOp::Insert, 0, 0, result, 2);
+        analyzer.emit(TraceOp::EndScan);
+        analyzer.emit(TraceOp::EndScan);
+        analyzer.emit(TraceOp::Output, 1);
+        analyzer.flush();
+    }
+
+    pg::ProofGraph graph;
+    ASSERT_TRUE(graph.open(file));
+    ASSERT_TRUE(1 == graph.derivation_count());
+    ASSERT_TRUE(2 == graph.derivation(0).edgeCount);
+    EXPECT_EQ("(a,c)", graph.render_tuple(graph.derivation(0).tuple));
+    EXPECT_EQ("(a,b)", graph.render_tuple(graph.premises(0)[0]));
+    EXPECT_EQ("(b,c)", graph.render_tuple(graph.premises(0)[1]));
+    std::remove(file.c_str());
+}
+
+TEST(ProofGraph, ValuesDecodedByType) {
+    namespace pg = ::modified_souffle::proof_graph;
+    SymbolTable symbolTable({"a", "b"});
+    RecordTable recordTable;
+    const RamDomain pair[2] = {-7, 1};
+    const RamDomain tuple[5] = {0, -3, ramBitCast(RamUnsigned(4)), ramBitCast(RamFloat(1.5)),
+            recordTable.pack(pair, 2)};
+    auto trace = [&](const std::string& file, TraceFormat format) {
+        TupleDataAnalyzer analyzer(file, &symbolTable, false, format);
+        analyzer.set_record_table(&recordTable);
+        analyzer.register_record("r:Pair", {"i:number", "s:symbol"});
+        analyzer.register_relation(0, "cost", {"s:symbol", "i:number", "u:unsigned", "f:float", "r:Pair"});
+        analyzer.emit(TraceOp::Debug, analyzer.register_rule("cost(a,-3,4,1.5,[-7,b]). in file t.dl [1:1-1:25]"));
+        analyzer.begin_input(0);
+        analyzer.insert_from_file(5, tuple);
+        analyzer.end_input();
+        analyzer.emit(TraceOp::Output, 0);
+        analyzer.flush();
+    };
+    const std::string expected = "(a,-3,4,1.5,[-7, b])";
+
+    const std::string text = "trace_typed.out";
+    trace(text, TraceFormat::Text);
+    std::ifstream in(text);
+    std::stringstream content;
+    content << in.rdbuf();
+    in.close();
+    std::remove(text.c_str());
+    EXPECT_NE(std::string::npos, content.str().find("+" + expected));
+
+    const std::string file = "trace_typed.pg";
+    trace(file, TraceFormat::Graph);
+    pg::ProofGraph graph;
+    ASSERT_TRUE(graph.open(file));
+    ASSERT_TRUE(1 == graph.tuple_count());
+    EXPECT_EQ(pg::NUMBER, graph.value_kind(0, 1));
+    EXPECT_EQ(expected, graph.render_tuple(0));
+    std::remove(file.c_str());
+}
+
+TEST(LiveSpectrum, ScoredAtStratumBoundary) {
+    SymbolTable symbolTable({"a", "b", "c"});
+    {
+        std::ofstream expected("path.csv");
+        expected << "a\tb\n"
+                 << "b\tc\n";
+    }
+    std::ostringstream report;
+    TupleDataAnalyzer analyzer("trace_live_spectrum.pg", &symbolTable, false, TraceFormat::Graph);
+    analyzer.set_expected_output(".", report);
+    analyzer.register_relation(0, "edge");
+    analyzer.register_relation(1, "path");
+    analyzer.register_relation(2, "@new_path");
+    auto input = analyzer.register_rule("edge(x,y). in file t.dl [1:1-1:10]");
+    auto base = analyzer.register_rule("path(x,y) :- edge(x,y). in file t.dl [2:1-2:30]");
+    auto step = analyzer.register_rule("path(x,z) :- edge(x,y), path(y,z). in file t.dl [3:1-3:40]");
+    auto order = analyzer.register_order({0, 1});
+
+    analyzer.emit(TraceOp::Debug, input);
+    analyzer.begin_input(0);
+    RamDomain edges[2][2] = {{0, 1}, {1, 2}};
+    for (auto& edge : edges) {
+        analyzer.insert_from_file(2, edge);
+    }
+    analyzer.end_input();
+
+    // both edges are copied to path, the second copy of (a,b) is not counted again
+    analyzer.emit(TraceOp::Debug, base);
+    analyzer.emit(TraceOp::ScanTarget, 0);
+    for (RamDomain* edge : {edges[0], edges[1], edges[0]}) {
+        analyzer.emit(TraceOp::ScanEval, 0, order, edge, 2);
+        analyzer.emit(TraceOp::InsertTarget, 2);
+        analyzer.emit(TraceOp::Insert, 0, 0, edge, 2);
+    }
+    analyzer.emit(TraceOp::EndScan);
+
+    // (a,c) is not expected and its proof uses both rules
+    analyzer.emit(TraceOp::Debug, step);
+    analyzer.emit(TraceOp::ScanTarget, 0);
+    analyzer.emit(TraceOp::ScanEval, 0, order, edges[0], 2);
+    analyzer.emit(TraceOp::ScanTarget, 1);
+    analyzer.emit(TraceOp::ScanEval, 0, order, edges[1], 2);
+    analyzer.emit(TraceOp::InsertTarget, 2);
+    RamDomain result[2] = {0, 2};
+    analyzer.emit(TraceOp::Insert, 0, 0, result, 2);
+    analyzer.emit(TraceOp::EndScan);
+    analyzer.emit(TraceOp::EndScan);
+    analyzer.emit(TraceOp::Stratum, 0);
+    analyzer.flush();
+    std::remove("path.csv");
+    std::remove("trace_live_spectrum.pg");
+
+    const auto* spectrum = analyzer.live_spectrum();
+    ASSERT_TRUE(spectrum != nullptr);
+    EXPECT_EQ(2, spectrum->p);
+    EXPECT_EQ(1, spectrum->f);
+    ASSERT_TRUE(spectrum->pr.size() == 3);
+    EXPECT_EQ(0, spectrum->pr[input] + spectrum->fr[input]);
+    EXPECT_EQ(2, spectrum->pr[base]);
+    EXPECT_EQ(1, spectrum->fr[base]);
+    EXPECT_EQ(0, spectrum->pr[step]);
+    EXPECT_EQ(1, spectrum->fr[step]);
+
+    // the rule only seen in failing proofs is reported first
+    const std::string text = report.str();
+    EXPECT_EQ(0, text.find("stratum 0:\tP = 2\tF = 1\n"));
+    const auto stepLine = text.find("path(x,z) :- edge(x,y), path(y,z).");
+    const auto baseLine = text.find("path(x,y) :- edge(x,y).");
+    ASSERT_TRUE(stepLine != std::string::npos && baseLine != std::string::npos);
+    EXPECT_TRUE(stepLine < baseLine);
+    EXPECT_EQ(std::string::npos, text.find("edge(x,y). in file t.dl [1:1-1:10]"));
+}
+
+TEST(TraceProgress, CountsTuplesAndBytes) {
+    const std::string file = "trace_progress.out";
+    SymbolTable symbolTable({"a", "b", "c"});
+    uint64_t tuples = 0;
+    uint64_t bytes = 0;
+    uint64_t events = 0;
+    {
+        TupleDataAnalyzer analyzer(file, &symbolTable);
+        analyzer.progress.set_interval(std::chrono::milliseconds(0));
+        analyzer.register_relation(0, "edge");
+        analyzer.emit(TraceOp::Debug, analyzer.register_rule("edge(x,y). in file t.dl [1:1-1:10]"));
+        analyzer.begin_input(0);
+        RamDomain edges[2][2] = {{0, 1}, {1, 2}};
+        for (auto& edge : edges) {
+            analyzer.insert_from_file(2, edge);
+        }
+        analyzer.end_input();
+        analyzer.emit(TraceOp::Output, 0);
+        analyzer.flush();
+        tuples = analyzer.progress.tuple_count();
+        bytes = analyzer.progress.byte_count();
+        events = analyzer.progress.event_count();
+    }
+    std::ifstream in(file, std::ios::binary | std::ios::ate);
+    const auto size = static_cast<uint64_t>(in.tellg());
+    in.close();
+    std::remove(file.c_str());
+    EXPECT_EQ(2, tuples);
+    EXPECT_EQ(size, bytes);
+    // Counted even though no progress is printed: Debug, InsertTarget, two input tuples and Output.
+    EXPECT_EQ(5, events);
+}
+
+TEST(TraceProgress, FinishedByFlush) {
+    const std::string file = "trace_progress_finish.out";
+    SymbolTable symbolTable;
+    std::stringstream err;
+    std::streambuf* original = std::cerr.rdbuf(err.rdbuf());
+    {
+        TupleDataAnalyzer analyzer(file, &symbolTable);
+        analyzer.progress.set_interval(std::chrono::milliseconds(1));
+        analyzer.register_relation(0, "edge");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        analyzer.begin_input(0);
+        // enough events for the progress to read the clock once
+        for (RamDomain i = 0; i < 5000; ++i) {
+            RamDomain edge[2] = {i, i + 1};
+            analyzer.insert_from_file(2, edge);
+        }
+        analyzer.end_input();
+        analyzer.flush();
+        // the final line is written by flush(), while the analyzer is still alive
+        const std::string output = err.str();
+        std::cerr.rdbuf(original);
+        EXPECT_FALSE(output.empty());
+        EXPECT_TRUE(!output.empty() && output.back() == '\n');
+    }
+    std::remove(file.c_str());
+}
+
+TEST(TraceDedup, FirstDerivationPerRule) {
+    namespace pg = ::modified_souffle::proof_graph;
+    const std::string file = "trace_dedup_rule.pg";
+    SymbolTable symbolTable({"a", "b", "c"});
+    {
+        TupleDataAnalyzer analyzer(file, &symbolTable, false, TraceFormat::Graph);
+        analyzer.set_dedup(::modified_souffle::TraceDedup::Rule);
+        analyzer.register_relation(0, "edge");
+        analyzer.register_relation(1, "path");
+        analyzer.register_relation(2, "@new_path");
+        auto rule = analyzer.register_rule("path(x,y) :- edge(x,y). in file t.dl [2:1-2:30]");
+        auto order = analyzer.register_order({0, 1});
+        RamDomain edges[2][2] = {{0, 1}, {1, 2}};
+
+        analyzer.emit(TraceOp::Debug, rule);
+        analyzer.emit(TraceOp::ScanTarget, 0);
+        for (int repeat = 0; repeat < 3; ++repeat) {
+            for (auto& edge : edges) {
+                analyzer.emit(TraceOp::ScanEval, 0, order, edge, 2);
+                analyzer.emit(TraceOp::InsertTarget, 2);
+                analyzer.emit(TraceOp::Insert, 0, 0, edge, 2);
+            }
+        }
+        analyzer.emit(TraceOp::EndScan);
+        analyzer.emit(TraceOp::Output, 1);
+        analyzer.flush();
+    }
+
+    pg::ProofGraph graph;
+    ASSERT_TRUE(graph.open(file));
+    EXPECT_EQ(2, graph.derivation_count());
+    std::remove(file.c_str());
+}
+
+TEST(TraceDedup, RedundantInsertEndsExistenceChecks) {
+    namespace pg = ::modified_souffle::proof_graph;
+    const std::string file = "trace_dedup_tuple.pg";
+    SymbolTable symbolTable({"a", "b", "c", "d"});
+    {
+        TupleDataAnalyzer analyzer(file, &symbolTable, false, TraceFormat::Graph);
+        analyzer.set_dedup(::modified_souffle::TraceDedup::Tuple);
+        analyzer.register_relation(0, "edge");
+        analyzer.register_relation(1, "path");
+        analyzer.register_relation(2, "@new_path");
+        auto rule = analyzer.register_rule("path(x,z) :- edge(x,y), path(y,z). in file t.dl [2:1-2:40]");
+        auto order = analyzer.register_order({0, 1});
+        RamDomain edges[2][2] = {{0, 1}, {1, 2}};
+        RamDomain paths[2][2] = {{1, 2}, {2, 3}};
+
+        analyzer.emit(TraceOp::Debug, rule);
+        analyzer.emit(TraceOp::ScanTarget, 0);
+        // (a,c) is already known, the engine only reports that the insert ended
+        analyzer.emit(TraceOp::ScanEval, 0, order, edges[0], 2);
+        analyzer.emit(TraceOp::ExistTarget, 1);
+        analyzer.emit(TraceOp::ScanIndex, 0, order, paths[0], 2);
+        analyzer.emit(TraceOp::InsertTarget, 2);
+        analyzer.emit(TraceOp::Redundant);
+        analyzer.emit(TraceOp::ScanEval, 0, order, edges[1], 2);
+        analyzer.emit(TraceOp::ExistTarget, 1);
+        analyzer.emit(TraceOp::ScanIndex, 0, order, paths[1], 2);
+        analyzer.emit(TraceOp::InsertTarget, 2);
+        RamDomain result[2] = {1, 3};
+        analyzer.emit(TraceOp::Insert, 0, 0, result, 2);
+        analyzer.emit(TraceOp::EndScan);
+        analyzer.emit(TraceOp::Output, 1);
+        analyzer.flush();
+    }
+
+    pg::ProofGraph graph;
+    ASSERT_TRUE(graph.open(file));
+    ASSERT_TRUE(1 == graph.derivation_count());
+    ASSERT_TRUE(2 == graph.derivation(0).edgeCount);
+    EXPECT_EQ("(b,d)", graph.render_tuple(graph.derivation(0).tuple));
+    EXPECT_EQ("(b,c)", graph.render_tuple(graph.premises(0)[0]));
+    EXPECT_EQ("(c,d)", graph.render_tuple(graph.premises(0)[1]));
+    std::remove(file.c_str());
+}
+
+}  // namespace souffle::interpreter::test
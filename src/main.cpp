@@ -89,9 +89,11 @@
 #include "ram/transform/TupleId.h"
 #include "reports/DebugReport.h"
 #include "reports/ErrorReport.h"
+#include "souffle/Modify.h"
 #include "souffle/RamTypes.h"
 #include "souffle/profile/Tui.h"
 #include "souffle/provenance/Explain.h"
+#include "souffle/provenance/ProofGraphProvenance.h"
 #include "souffle/utility/ContainerUtil.h"
 #include "souffle/utility/FileUtil.h"
 #include "souffle/utility/MiscUtil.h"
@@ -267,8 +269,9 @@ int main(int argc, char** argv) {
                 {"profile-frequency", '\2', "", "", false, "Enable the frequency counter in the profiler."},
                 {"debug-report", 'r', "FILE", "", false, "Write HTML debug report to <FILE>."},
                 {"pragma", 'P', "OPTIONS", "", false, "Set pragma options."},
-                {"provenance", 't', "[ none | explain | explore ]", "", false,
-                        "Enable provenance instrumentation and interaction."},
+                {"provenance", 't', "[ none | explain | explore | proof-graph ]", "", false,
+                        "Enable provenance instrumentation and interaction; proof-graph rebuilds the proofs of "
+                        "all output tuples after evaluation instead of tracing it."},
                 {"verbose", 'v', "", "", false, "Verbose output."},
                 {"version", '\3', "", "", false, "Version."},
                 {"show", '\4',
@@ -276,6 +279,36 @@ int main(int argc, char** argv) {
                         "transformed-ram | type-analysis ]",
                         "", false, "Print selected program information."},
                 {"mdebug-output", 'O', "", "", false, "Show modified souffle output."},
+                {"no-trace", '\x9', "", "", false,
+                        "Do not trace the evaluation; the interpreter runs like upstream Souffle."},
+                {"trace-filter", '\xa', "FILTER", "", false,
+                        "Only trace the given relations and rules, e.g. `path,reach.dl:12` traces all rules "
+                        "of path and the rule at line 12 of reach.dl."},
+                {"trace-format", '\xb', "[ graph | text ]", "graph", false,
+                        "Format of the trace: a binary proof graph (default) or the legacy text form."},
+                {"trace-compiled", '\xc', "", "", false,
+                        "Instrument compiled programs to write their trace events to <output-dir>/trace_stream; "
+                        "the stream is analysed after the program has run."},
+                {"trace-memory", '\xd', "MIB", "256", false,
+                        "Memory the derivations of a single rule may take before they are spilled to disk."},
+                {"trace-expected", '\xe', "DIR", "", false,
+                        "Judge derived tuples against the expected <relation>.csv files in DIR while the "
+                        "program runs, and print the suspiciousness of each rule after every stratum."},
+                {"trace-progress", '\xf', "MS", "1000", false,
+                        "Interval between two progress lines of the traced evaluation; 0 turns them off."},
+                {"trace-dedup", '\x10', "[ none | tuple | rule ]", "none", false,
+                        "Record every derivation (default), only the one that adds a tuple to its relation, "
+                        "or the first derivation of a tuple by each rule."},
+                {"trace-stats", '\x11', "FILE", "", false,
+                        "Write the number of trace events, inserted tuples and trace bytes of the run to FILE "
+                        "as a JSON object."},
+                {"interpreter-dispatch", '\x12', "[ closure | adaptive | switch ]", "closure", false,
+                        "Run untraced queries as closures bound to their relations, lowered up front "
+                        "(default); lower the queries of recursive strata only once they are hot, between "
+                        "two iterations (adaptive); or run every query on the switch dispatcher."},
+                {"hot-query-threshold", '\x13', "MS", "5", false,
+                        "Time a query of a recursive stratum runs on the switch dispatcher before adaptive "
+                        "dispatch lowers it."},
                 {"parse-errors", '\5', "", "", false, "Show parsing errors, if any, then exit."},
                 {"help", 'h', "", "", false, "Display this help message."},
                 {"legacy", '\6', "", "", false, "Enable legacy support."}};
@@ -672,10 +705,17 @@ int main(int argc, char** argv) {
                 profiler = std::thread([]() { profile::Tui().runProf(); });
             }
 
+            // the proof graph is rebuilt from the provenance annotations, evaluation needs no tracing
+            const bool rebuildProofGraph = Global::config().get("provenance") == "proof-graph";
+            if (rebuildProofGraph) {
+                Global::config().set("no-trace");
+            }
+
             // configure and execute interpreter
-            Own<interpreter::Engine> interpreter(mk<interpreter::Engine>(*ramTranslationUnit,
-                    "./souffle-analyze-data/output_" + std::to_string(modified_souffle::countFilesInDirectory(
-                                                               "./souffle-analyze-data/"))));
+            const std::string analyzerOutput =
+                    "./souffle-analyze-data/output_" +
+                    std::to_string(modified_souffle::countFilesInDirectory("./souffle-analyze-data/"));
+            Own<interpreter::Engine> interpreter(mk<interpreter::Engine>(*ramTranslationUnit, analyzerOutput));
             interpreter->executeMain();
             // If the profiler was started, join back here once it exits.
             if (profiler.joinable()) {
@@ -688,6 +728,8 @@ int main(int argc, char** argv) {
                     explain(interface, false);
                 } else if (Global::config().get("provenance") == "explore") {
                     explain(interface, true);
+                } else if (rebuildProofGraph) {
+                    modified_souffle::ProofGraphProvenance(interface).write(analyzerOutput);
                 }
             }
         } else {
@@ -761,6 +803,19 @@ int main(int argc, char** argv) {
                 // run compiled C++ program if requested.
                 if (!Global::config().has("dl-program") && !Global::config().has("swig")) {
                     executeBinary(baseFilename);
+                    if (Global::config().has("trace-compiled")) {
+                        // analyse the events of the compiled program as the interpreter would have
+                        const std::string stream = Global::config().get("output-dir") + "/trace_stream";
+                        const std::string analyzerOutput =
+                                "./souffle-analyze-data/output_" +
+                                std::to_string(modified_souffle::countFilesInDirectory("./souffle-analyze-data/"));
+                        const auto format = Global::config().get("trace-format") == "text"
+                                                    ? modified_souffle::TraceFormat::Text
+                                                    : modified_souffle::TraceFormat::Graph;
+                        if (!modified_souffle::replay_trace_stream(stream, analyzerOutput, format)) {
+                            throw std::runtime_error("failed to read trace stream " + stream);
+                        }
+                    }
                 }
             }
             if (Global::config().has("verbose")) {
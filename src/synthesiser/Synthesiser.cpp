@@ -19,6 +19,7 @@
 #include "FunctorOps.h"
 #include "Global.h"
 #include "RelationTag.h"
+#include "ram/AbstractExistenceCheck.h"
 #include "ram/AbstractParallel.h"
 #include "ram/Aggregate.h"
 #include "ram/AutoIncrement.h"
@@ -86,6 +87,7 @@
 #include "ram/utility/Utils.h"
 #include "ram/utility/Visitor.h"
 #include "souffle/BinaryConstraintOps.h"
+#include "souffle/Modify.h"
 #include "souffle/RamTypes.h"
 #include "souffle/TypeAttribute.h"
 #include "souffle/utility/ContainerUtil.h"
@@ -101,6 +103,7 @@
 #include <cctype>
 #include <functional>
 #include <iomanip>
+#include <iostream>
 #include <iterator>
 #include <limits>
 #include <map>
@@ -142,6 +145,39 @@ std::size_t Synthesiser::lookupReadIdx(const std::string& txt) {
     }
 }
 
+/** Check that the node accesses no relation that is too wide to be traced */
+bool Synthesiser::isTraceable(const ram::Node& node) const {
+    if (untraceableRelations.empty()) {
+        return true;
+    }
+    bool traceable = true;
+    auto check = [&](const std::string& relation) {
+        traceable = traceable && untraceableRelations.count(relation) == 0;
+    };
+    visit(node, [&](const ram::Node& cur) {
+        if (const auto* operation = as<ram::RelationOperation>(cur)) {
+            check(operation->getRelation());
+        } else if (const auto* exists = as<ram::AbstractExistenceCheck>(cur)) {
+            check(exists->getRelation());
+        } else if (const auto* insert = as<ram::Insert>(cur)) {
+            check(insert->getRelation());
+        } else if (const auto* io = as<ram::IO>(cur)) {
+            check(io->getRelation());
+        }
+    });
+    return traceable;
+}
+
+/** Lookup trace id of a rule */
+std::size_t Synthesiser::lookupTraceRule(const std::string& rule) {
+    auto pos = traceRuleIdx.find(rule);
+    if (pos != traceRuleIdx.end()) {
+        return pos->second;
+    }
+    traceRules.push_back(rule);
+    return traceRuleIdx[rule] = traceRules.size() - 1;
+}
+
 /** Convert RAM identifier */
 const std::string Synthesiser::convertRamIdent(const std::string& name) {
     auto it = identifiers.find(name);
@@ -248,8 +284,37 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
         std::ostringstream preamble;
         bool preambleIssued = false;
 
+        // whether the statement being emitted reports to the trace stream
+        bool tracing;
+        bool withinRule = false;
+        // trace calls issued after the parallel region of the current query
+        std::string parallelEpilogue;
+
+        /** Emit a call on the trace stream if the current statement is traced */
+        void emitTrace(std::ostream& out, const std::string& call) {
+            if (tracing) {
+                out << "traceStream." << call << ";\n";
+            }
+        }
+
+        static std::string traceOp(const std::string& op) {
+            return "modified_souffle::TraceOp::" + op;
+        }
+
+        std::string traceRelation(const ram::Relation& rel) {
+            return std::to_string(synthesiser.lookupTraceRelation(rel.getName()));
+        }
+
+        /** Open the trace lanes of a parallel loop over `part`; they are merged after the region */
+        void emitTraceLanes(std::ostream& out, const std::string& epilogue) {
+            emitTrace(out, "begin_lanes(part.size())");
+            if (tracing) {
+                parallelEpilogue = "traceStream.merge_lanes();\n" + epilogue;
+            }
+        }
+
     public:
-        CodeEmitter(Synthesiser& syn) : synthesiser(syn) {
+        CodeEmitter(Synthesiser& syn, bool traced) : synthesiser(syn), tracing(traced) {
             rec = [&](auto& out, const auto* value) {
                 out << "ramBitCast(";
                 dispatch(*value, out);
@@ -344,6 +409,8 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
 
             const auto& directives = io.getDirectives();
             const std::string& op = io.get("operation");
+            const bool traceIO = tracing && synthesiser.traceFilter->match_relation(io.getRelation()) &&
+                                 synthesiser.isTraceable(io);
             out << "if (performIO) {\n";
 
             // get some table details
@@ -359,6 +426,11 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
                 out << "directiveMap, symTable, recordTable";
                 out << ")->readAll(*" << synthesiser.getRelationName(synthesiser.lookup(io.getRelation()));
                 out << ");\n";
+                if (traceIO) {
+                    const auto* rel = synthesiser.lookup(io.getRelation());
+                    emitTrace(out, "input(" + traceRelation(*rel) + ", *" + synthesiser.getRelationName(rel) +
+                                           ", " + std::to_string(rel->getArity()) + ")");
+                }
                 out << "} catch (std::exception& e) {std::cerr << \"Error loading data: \" << e.what() "
                        "<< "
                        "'\\n';}\n";
@@ -370,6 +442,10 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
                 out << R"_(if (!outputDirectory.empty()) {)_";
                 out << R"_(directiveMap["output-dir"] = outputDirectory;)_";
                 out << "}\n";
+                if (traceIO) {
+                    emitTrace(out, "emit(" + traceOp("Output") + ", " +
+                                           traceRelation(*synthesiser.lookup(io.getRelation())) + ")");
+                }
                 out << "IOSystem::getInstance().getWriter(";
                 out << "directiveMap, symTable, recordTable";
                 out << ")->writeAll(*" << synthesiser.getRelationName(synthesiser.lookup(io.getRelation()))
@@ -427,6 +503,17 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             preamble.str("");
             preamble.clear();
             preambleIssued = false;
+            parallelEpilogue.clear();
+
+            // queries outside of rules merge new knowledge into a relation; follow the filter of the target
+            const bool tracingBefore = tracing;
+            if (tracing && !withinRule) {
+                tracing = false;
+                visit(query, [&](const Insert& insert) {
+                    tracing = tracing || synthesiser.traceFilter->match_relation(insert.getRelation());
+                });
+                tracing = tracing && synthesiser.isTraceable(query);
+            }
 
             // create operation contexts for this operation
             for (const ram::Relation* rel : synthesiser.getReferencedRelations(query.getOperation())) {
@@ -461,7 +548,9 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
 
             if (isParallel) {
                 out << "PARALLEL_END\n";  // end parallel
+                out << parallelEpilogue;
             }
+            tracing = tracingBefore;
 
             out << "}\n";
             out << "();";  // call lambda
@@ -631,8 +720,24 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             out << dbg.getMessage();
             out << ")_\");\n";
 
+            // rules excluded by the trace filter are emitted without instrumentation
+            const bool tracingBefore = tracing;
+            if (tracing) {
+                std::string message = dbg.getMessage();
+                std::replace(message.begin(), message.end(), '\n', ' ');
+                tracing = synthesiser.traceFilter->match_rule(message) &&
+                          synthesiser.isTraceable(dbg.getStatement());
+                if (tracing) {
+                    emitTrace(out, "emit(" + traceOp("Debug") + ", " +
+                                           std::to_string(synthesiser.lookupTraceRule(message)) + ")");
+                }
+            }
+
             // insert statements of the rule
+            withinRule = true;
             dispatch(dbg.getStatement(), out);
+            withinRule = false;
+            tracing = tracingBefore;
             PRINT_END_COMMENT(out);
         }
 
@@ -666,17 +771,23 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
 
             PRINT_BEGIN_COMMENT(out);
 
+            emitTrace(out, "emit(" + traceOp("ScanTarget") + ", " + traceRelation(*rel) + ")");
             out << "auto part = " << relName << "->partition();\n";
+            emitTraceLanes(out, "traceStream.emit(" + traceOp("EndScan") + ");\n");
             out << "PARALLEL_START\n";
             out << preamble.str();
             out << "pfor(auto it = part.begin(); it<part.end();++it){\n";
+            emitTrace(out, "enter_lane(it - part.begin())");
             out << "try{\n";
             out << "for(const auto& env0 : *it) {\n";
+            emitTrace(out, "emit(" + traceOp("ScanEval") + ", 0, env0.data(), " +
+                                   std::to_string(rel->getArity()) + ")");
 
             visit_(type_identity<TupleOperation>(), pscan, out);
 
             out << "}\n";
             out << "} catch(std::exception &e) { signalHandler->error(e.what());}\n";
+            emitTrace(out, "leave_lane()");
             out << "}\n";
 
             PRINT_END_COMMENT(out);
@@ -691,12 +802,16 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
 
             assert(rel->getArity() > 0 && "AstToRamTranslator failed/no scans for nullaries");
 
+            emitTrace(out, "emit(" + traceOp("ScanTarget") + ", " + traceRelation(*rel) + ")");
             out << "for(const auto& env" << id << " : "
                 << "*" << relName << ") {\n";
+            emitTrace(out, "emit(" + traceOp("ScanEval") + ", 0, env" + std::to_string(id) + ".data(), " +
+                                   std::to_string(rel->getArity()) + ")");
 
             visit_(type_identity<TupleOperation>(), scan, out);
 
             out << "}\n";
+            emitTrace(out, "emit(" + traceOp("EndScan") + ")");
 
             PRINT_END_COMMENT(out);
         }
@@ -742,9 +857,11 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             PRINT_BEGIN_COMMENT(out);
 
             out << "auto part = " << relName << "->partition();\n";
+            emitTraceLanes(out, "");
             out << "PARALLEL_START\n";
             out << preamble.str();
             out << "pfor(auto it = part.begin(); it<part.end();++it){\n";
+            emitTrace(out, "enter_lane(it - part.begin())");
             out << "try{\n";
             out << "for(const auto& env0 : *it) {\n";
             out << "if( ";
@@ -759,6 +876,7 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             out << "}\n";
             out << "}\n";
             out << "} catch(std::exception &e) { signalHandler->error(e.what());}\n";
+            emitTrace(out, "leave_lane()");
             out << "}\n";
 
             PRINT_END_COMMENT(out);
@@ -780,14 +898,18 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             auto ctxName = "READ_OP_CONTEXT(" + synthesiser.getOpContextName(*rel) + ")";
             auto rangeBounds = getPaddedRangeBounds(*rel, rangePatternLower, rangePatternUpper);
 
+            emitTrace(out, "emit(" + traceOp("ScanTarget") + ", " + traceRelation(*rel) + ")");
             out << "auto range = " << relName << "->"
                 << "lowerUpperRange_" << keys << "(" << rangeBounds.first.str() << ","
                 << rangeBounds.second.str() << "," << ctxName << ");\n";
             out << "for(const auto& env" << identifier << " : range) {\n";
+            emitTrace(out, "emit(" + traceOp("ScanEval") + ", 0, env" + std::to_string(identifier) +
+                                   ".data(), " + std::to_string(arity) + ")");
 
             visit_(type_identity<TupleOperation>(), iscan, out);
 
             out << "}\n";
+            emitTrace(out, "emit(" + traceOp("EndScan") + ")");
             PRINT_END_COMMENT(out);
         }
 
@@ -816,16 +938,21 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
                 << "lowerUpperRange_" << keys << "(" << rangeBounds.first.str() << ","
                 << rangeBounds.second.str() << ");\n";
             out << "auto part = range.partition();\n";
+            emitTrace(out, "emit(" + traceOp("ScanTarget") + ", " + traceRelation(*rel) + ")");
+            emitTraceLanes(out, "traceStream.emit(" + traceOp("EndScan") + ");\n");
             out << "PARALLEL_START\n";
             out << preamble.str();
             out << "pfor(auto it = part.begin(); it<part.end(); ++it) { \n";
+            emitTrace(out, "enter_lane(it - part.begin())");
             out << "try{\n";
             out << "for(const auto& env0 : *it) {\n";
+            emitTrace(out, "emit(" + traceOp("ScanEval") + ", 0, env0.data(), " + std::to_string(arity) + ")");
 
             visit_(type_identity<TupleOperation>(), piscan, out);
 
             out << "}\n";
             out << "} catch(std::exception &e) { signalHandler->error(e.what());}\n";
+            emitTrace(out, "leave_lane()");
             out << "}\n";
 
             PRINT_END_COMMENT(out);
@@ -891,9 +1018,11 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
                 << "lowerUpperRange_" << keys << "(" << rangeBounds.first.str() << ","
                 << rangeBounds.second.str() << ");\n";
             out << "auto part = range.partition();\n";
+            emitTraceLanes(out, "");
             out << "PARALLEL_START\n";
             out << preamble.str();
             out << "pfor(auto it = part.begin(); it<part.end(); ++it) { \n";
+            emitTrace(out, "enter_lane(it - part.begin())");
             out << "try{";
             out << "for(const auto& env0 : *it) {\n";
             out << "if( ";
@@ -908,6 +1037,7 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             out << "}\n";
             out << "}\n";
             out << "} catch(std::exception &e) { signalHandler->error(e.what());}\n";
+            emitTrace(out, "leave_lane()");
             out << "}\n";
 
             PRINT_END_COMMENT(out);
@@ -1071,7 +1201,11 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
 
             // produce condition inside the loop if necessary
             out << "if( ";
+            // the condition is evaluated by all threads at once and is not traced
+            const bool tracingBefore = tracing;
+            tracing = false;
             dispatch(aggregate.getCondition(), out);
+            tracing = tracingBefore;
             out << ") {\n";
 
             out << "shouldRunNested = true;\n";
@@ -1423,7 +1557,11 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
 
             // produce condition inside the loop
             out << "if( ";
+            // the condition is evaluated by all threads at once and is not traced
+            const bool tracingBefore = tracing;
+            tracing = false;
             dispatch(aggregate.getCondition(), out);
+            tracing = tracingBefore;
             out << ") {\n";
 
             out << "shouldRunNested = true;\n";
@@ -1652,6 +1790,7 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             // create inserted tuple
             out << "Tuple<RamDomain," << arity << "> tuple{{" << join(guardedInsert.getValues(), ",", rec)
                 << "}};\n";
+            emitTrace(out, "insert(" + traceRelation(*rel) + ", tuple.data(), " + std::to_string(arity) + ")");
 
             // insert tuple
             out << relName << "->"
@@ -1673,6 +1812,7 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             // create inserted tuple
             out << "Tuple<RamDomain," << arity << "> tuple{{" << join(insert.getValues(), ",", rec)
                 << "}};\n";
+            emitTrace(out, "insert(" + traceRelation(*rel) + ", tuple.data(), " + std::to_string(arity) + ")");
 
             // insert tuple
             out << relName << "->"
@@ -1828,6 +1968,22 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
             }
 
             // if it is total we use the contains function
+            if (isa->isTotalSignature(&exists) && tracing) {
+                // the matched tuple is a premise of the rule, report it before returning the result
+                out << "[&]() {\n";
+                out << "Tuple<RamDomain," << arity << "> tuple{{" << join(exists.getValues(), ",", rec)
+                    << "}};\n";
+                out << "const bool found = " << relName << "->contains(tuple," << ctxName << ");\n";
+                out << "if (found) {\n";
+                emitTrace(out, "emit(" + traceOp("ExistTarget") + ", " + traceRelation(*rel) + ")");
+                emitTrace(out, "emit(" + traceOp("ScanEval") + ", 0, tuple.data(), " + std::to_string(arity) +
+                                       ")");
+                out << "}\n";
+                out << "return found;\n";
+                out << "}()" << after;
+                PRINT_END_COMMENT(out);
+                return;
+            }
             if (isa->isTotalSignature(&exists)) {
                 out << relName << "->"
                     << "contains(Tuple<RamDomain," << arity << ">{{" << join(exists.getValues(), ",", rec)
@@ -2313,7 +2469,8 @@ void Synthesiser::emitCode(std::ostream& out, const Statement& stmt) {
 
     out << std::setprecision(std::numeric_limits<RamFloat>::max_digits10);
     // emit code
-    CodeEmitter(*this).dispatch(stmt, out);
+    CodeEmitter(*this, traceFilter != nullptr && &stmt == &translationUnit.getProgram().getMain())
+            .dispatch(stmt, out);
 }
 
 void Synthesiser::generateCode(std::ostream& os, const std::string& id, bool& withSharedLibrary) {
@@ -2330,6 +2487,33 @@ void Synthesiser::generateCode(std::ostream& os, const std::string& id, bool& wi
 
     std::string classname = "Sf_" + id;
 
+    // set up trace instrumentation; relations are traced by their position in the program
+    const bool traceCompiled = Global::config().has("trace-compiled");
+    if (traceCompiled) {
+        traceFilter = mk<modified_souffle::TraceFilter>(Global::config().get("trace-filter"));
+        // the inputs, outputs and merges of a relation are traced if any of its rules is
+        visit(prog, [&](const DebugInfo& dbg) {
+            std::string message = dbg.getMessage();
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            if (traceFilter->match_rule(message)) {
+                traceFilter->include_relation(modified_souffle::TraceFilter::rule_head(message));
+            }
+        });
+        for (auto rel : prog.getRelations()) {
+            traceRelationIdx[rel->getName()] = traceRelationIdx.size();
+            // the trace stream stores the arity of a tuple in one byte and the replay holds at most
+            // MAX_TRACE_ARITY values per event; wider relations and the rules using them are not traced
+            if (rel->getArity() > modified_souffle::MAX_TRACE_ARITY) {
+                untraceableRelations.insert(rel->getName());
+                if (!Global::config().has("no-warn") && rel->getName()[0] != '@') {
+                    std::cerr << "Warning: relation " << rel->getName() << " has " << rel->getArity()
+                              << " attributes, more than the " << modified_souffle::MAX_TRACE_ARITY
+                              << " a trace event holds; it and the rules using it are not traced\n";
+                }
+            }
+        }
+    }
+
     // generate C++ program
 
     if (Global::config().has("verbose")) {
@@ -2339,6 +2523,10 @@ void Synthesiser::generateCode(std::ostream& os, const std::string& id, bool& wi
     if (Global::config().has("provenance")) {
         os << "#include <mutex>\n";
         os << "#include \"souffle/provenance/Explain.h\"\n";
+        os << "#include \"souffle/provenance/ProofGraphProvenance.h\"\n";
+    }
+    if (traceCompiled) {
+        os << "#include \"souffle/TraceStream.h\"\n";
     }
 
     if (Global::config().has("live-profile")) {
@@ -2456,6 +2644,11 @@ void Synthesiser::generateCode(std::ostream& os, const std::string& id, bool& wi
     os << "RecordTable recordTable;"
        << "\n";
 
+    if (traceCompiled) {
+        os << "// -- trace events of the evaluation --\n";
+        os << "modified_souffle::trace_stream::TraceStreamWriter traceStream;\n";
+    }
+
     if (Global::config().has("profile")) {
         os << "private:\n";
         std::size_t numFreq = 0;
@@ -2825,6 +3018,27 @@ void runFunction(std::string  inputDirectoryArg   = "",
         }
         os << "}\n";  // end of dumpFreqs() method
     }
+    // openTrace method
+    //  Emitted last so that all traced rules have been assigned an id.
+    if (traceCompiled) {
+        os << "public:\n";
+        os << "bool openTrace(const std::string& path) {\n";
+        os << "return traceStream.open(path, {";
+        os << join(prog.getRelations(), ",", [](auto& out, auto* rel) { out << '"' << rel->getName() << '"'; });
+        os << "}, {";
+        os << join(traceRules, ",", [](auto& out, auto& rule) { out << "R\"_(" << rule << ")_\""; });
+        os << "}, {";
+        os << join(prog.getRelations(), ",", [](auto& out, auto* rel) {
+            out << "{" << join(rel->getAttributeTypes(), ",", [](auto& typeOut, auto& type) {
+                typeOut << '"' << type << '"';
+            }) << "}";
+        });
+        os << "});\n";
+        os << "}\n";  // end of openTrace() method
+        os << "void closeTrace() {\n";
+        os << "traceStream.close(symTable);\n";
+        os << "}\n";  // end of closeTrace() method
+    }
     os << "};\n";  // end of class declaration
 
     // hidden hooks
@@ -2889,12 +3103,22 @@ void runFunction(std::string  inputDirectoryArg   = "",
         os << R"_(souffle::ProfileEventSingleton::instance().makeConfigRecord("version", ")_"
            << Global::config().get("version") << R"_(");)_" << '\n';
     }
+    if (traceCompiled) {
+        os << "if (!obj.openTrace(opt.getOutputFileDir() + \"/trace_stream\")) {\n";
+        os << "std::cerr << \"cannot write trace stream to \" << opt.getOutputFileDir() << \"\\n\";\n";
+        os << "}\n";
+    }
     os << "obj.runAll(opt.getInputFileDir(), opt.getOutputFileDir());\n";
+    if (traceCompiled) {
+        os << "obj.closeTrace();\n";
+    }
 
     if (Global::config().get("provenance") == "explain") {
         os << "explain(obj, false);\n";
     } else if (Global::config().get("provenance") == "explore") {
         os << "explain(obj, true);\n";
+    } else if (Global::config().get("provenance") == "proof-graph") {
+        os << "modified_souffle::ProofGraphProvenance(obj).write(opt.getOutputFileDir() + \"/proof_graph\");\n";
     }
     os << "return 0;\n";
     os << "} catch(std::exception &e) { souffle::SignalHandler::instance()->error(e.what());}\n";
@@ -21,6 +21,7 @@
 #include "ram/Statement.h"
 #include "ram/TranslationUnit.h"
 #include "ram/utility/Visitor.h"
+#include "souffle/Modify.h"
 #include "souffle/RecordTable.h"
 #include "souffle/utility/ContainerUtil.h"
 #include "synthesiser/Relation.h"
@@ -65,6 +66,21 @@ private:
     /** Symbol map */
     mutable std::vector<std::string> symbolIndex;
 
+    /** Trace filter of the instrumented program, nullptr if compiled programs are not traced */
+    Own<modified_souffle::TraceFilter> traceFilter;
+
+    /** Trace ids of the relations */
+    std::map<std::string, std::size_t> traceRelationIdx;
+
+    /** Relations wider than a trace event holds, see MAX_TRACE_ARITY */
+    std::set<std::string> untraceableRelations;
+
+    /** Trace ids of the traced rules */
+    std::map<std::string, std::size_t> traceRuleIdx;
+
+    /** Traced rules in the order of their trace ids */
+    std::vector<std::string> traceRules;
+
 protected:
     /** Get record table */
     // const RecordTable& getRecordTable();
@@ -94,6 +110,17 @@ protected:
     /** Lookup read counter */
     std::size_t lookupReadIdx(const std::string& txt);
 
+    /** Lookup trace id of a relation */
+    std::size_t lookupTraceRelation(const std::string& relName) {
+        return traceRelationIdx.at(relName);
+    }
+
+    /** Lookup trace id of a rule, registering it on first use */
+    std::size_t lookupTraceRule(const std::string& rule);
+
+    /** Whether the node only accesses relations whose tuples fit into a trace event */
+    bool isTraceable(const ram::Node& node) const;
+
     /** Lookup relation by relation name */
     const ram::Relation* lookup(const std::string& relName) {
         auto it = relationMap.find(relName);